@@ -0,0 +1,87 @@
+#include "callgraph.hpp"
+#include "parser/visitor.hpp"
+
+//Gathers every function name referenced below a node, called or used as a value
+class CalleeCollector: public ConstAstVisitor<CalleeCollector>{
+	private:
+	std::vector<std::string> &callees;
+
+	public:
+	explicit CalleeCollector(std::vector<std::string> &callees_): callees(callees_) {}
+
+	void VisitNode(const Node &node) { VisitChildren(node); }
+	void VisitVal(const ValNode &node){
+		if(node.val.type == Token::Type::IDENT)
+			callees.push_back(node.val.Name());
+	}
+	void VisitFuncCall(const FuncCallNode &node){
+		callees.push_back(node.funcName.Name());
+		VisitChildren(node);
+	}
+};
+
+CallGraph::CallGraph(const BlockNode &root){
+	bool hasRoots = false;
+
+	for(auto &stmt: root.stmts){
+		if(stmt->type != NodeType::FUNCDECL){
+			//Top level initializers always run, so whatever they reference is a root
+			std::vector<std::string> callees;
+			CalleeCollector(callees).Visit(*stmt);
+			roots.insert(roots.end(), callees.begin(), callees.end());
+			continue;
+		}
+
+		auto decl = std::static_pointer_cast<FuncDeclNode>(stmt);
+		//Defined in another file, nothing to generate either way
+		if(decl->IsPrototype()) continue;
+
+		auto &func = functions[decl->ident.Name()];
+		func.decl = decl.get();
+		CalleeCollector(func.callees).Visit(*decl);
+
+		if(decl->isExported || decl->ident.Name() == "main"){
+			roots.push_back(decl->ident.Name());
+			hasRoots = true;
+		}
+	}
+
+	if(!hasRoots){
+		for(auto &[name, func]: functions)
+			roots.push_back(name);
+	}
+
+	for(auto &name: roots)
+		Visit(name);
+}
+
+void CallGraph::Visit(const std::string &name){
+	std::vector<std::string> stack{ name };
+
+	while(stack.size()){
+		auto curr = stack.back();
+		stack.pop_back();
+
+		auto found = functions.find(curr);
+		if(found == functions.end() || found->second.reachable) continue;
+
+		found->second.reachable = true;
+		stack.insert(stack.end(), found->second.callees.begin(), found->second.callees.end());
+	}
+}
+
+bool CallGraph::IsReachable(const std::string &name) const{
+	auto found = functions.find(name);
+	return found != functions.end() && found->second.reachable;
+}
+
+size_t CallGraph::MarkUnreachable(){
+	size_t skipped = 0;
+
+	for(auto &[name, func]: functions){
+		func.decl->isReachable = func.reachable;
+		if(!func.reachable) skipped++;
+	}
+
+	return skipped;
+}
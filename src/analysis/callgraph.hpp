@@ -0,0 +1,31 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+#include "parser/parser.hpp"
+
+//Call graph over the top level functions of a translation unit.
+//Roots are main and every exported function, if the file has neither
+//(a plain library) every function is treated as a root.
+class CallGraph{
+	private:
+	struct Function{
+		FuncDeclNode *decl;
+		std::vector<std::string> callees;
+		bool reachable = false;
+	};
+
+	std::unordered_map<std::string, Function> functions;
+	std::vector<std::string> roots;
+
+	void Visit(const std::string &name);
+
+	public:
+	explicit CallGraph(const BlockNode &root);
+
+	bool IsReachable(const std::string &name) const;
+	//Flags every unreachable FuncDeclNode so codegen skips it, returns how many were skipped
+	size_t MarkUnreachable();
+};
@@ -0,0 +1,414 @@
+#include "consteval.hpp"
+#include <deque>
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+
+#include "parser/visitor.hpp"
+
+using Value = ConstEvaluator::Value;
+
+//Flags anything a pure function mustn't do and collects what it calls
+class PurityChecker: public ConstAstVisitor<PurityChecker>{
+	private:
+	const ConstEvaluator::FunctionTable &functions;
+	std::shared_ptr<Scope> scope;
+
+	bool IsGlobal(const Token &name){
+		bool isGlobal = false;
+		Scope::Lookup(scope, name, &isGlobal);
+		return isGlobal;
+	}
+
+	public:
+	bool pure = true;
+	std::vector<const FuncDeclNode*> callees;
+
+	PurityChecker(const ConstEvaluator::FunctionTable &functions_, std::shared_ptr<Scope> scope_): functions(functions_), scope(scope_) {}
+
+	void VisitNode(const Node &node) { VisitChildren(node); }
+	void VisitMember(const MemberNode&) { pure = false; }
+	void VisitBlock(const BlockNode &node){
+		auto parent = scope;
+		if(node.myScope) scope = node.myScope;
+		VisitChildren(node);
+		scope = parent;
+	}
+	void VisitVal(const ValNode &node){
+		if(node.val.type == Token::Type::IDENT && IsGlobal(node.val)) pure = false;
+	}
+	void VisitVarAssign(const VarAssignNode &node){
+		if(IsGlobal(node.varName)) pure = false;
+		VisitChildren(node);
+	}
+	void VisitIndex(const IndexNode &node){
+		if(IsGlobal(node.array)) pure = false;
+		VisitChildren(node);
+	}
+	void VisitFuncCall(const FuncCallNode &node){
+		auto callee = functions.find(node.funcName.symbol);
+		if(callee == functions.end() || callee->second->IsPrototype()) pure = false;
+		else callees.push_back(callee->second);
+		VisitChildren(node);
+	}
+};
+
+ConstEvaluator::PureSet ConstEvaluator::FindPure(const FunctionTable &functions){
+	std::unordered_map<const FuncDeclNode*, std::vector<const FuncDeclNode*>> candidates;
+	for(auto &[symbol, func]: functions){
+		if(func->IsPrototype() || !func->block || func->block->type != NodeType::BLOCK) continue;
+
+		//Arrays come from the caller's memory
+		bool takesArray = false;
+		for(auto &param: func->params)
+			takesArray |= param->varType->isArray;
+		if(takesArray) continue;
+
+		PurityChecker checker(functions, static_cast<BlockNode&>(*func->block).myScope);
+		checker.Visit(*func->block);
+		if(checker.pure) candidates.emplace(func, std::move(checker.callees));
+	}
+
+	//Calling something impure makes a function impure too, until nothing changes
+	for(bool changed = true; changed;){
+		changed = false;
+		for(auto it = candidates.begin(); it != candidates.end();){
+			bool callsImpure = false;
+			for(auto callee: it->second)
+				callsImpure |= !candidates.contains(callee);
+
+			if(callsImpure){
+				it = candidates.erase(it);
+				changed = true;
+			}
+			else{
+				++it;
+			}
+		}
+	}
+
+	PureSet pure;
+	for(auto &[func, callees]: candidates)
+		pure.insert(func);
+	return pure;
+}
+
+//Integers are wrapped to their width and sign extended, floats rounded to theirs
+static Value Int(unsigned bits, std::int64_t val){
+	if(bits < 64){
+		std::uint64_t shift = 64 - bits;
+		val = (std::int64_t)((std::uint64_t)val << shift) >> shift;
+	}
+	return Value{ false, bits, val, 0 };
+}
+static Value Float(unsigned bits, double val){
+	return Value{ true, bits, 0, bits == 32 ? (double)(float)val : val };
+}
+
+//Walks a pure function's body the way its code would run
+class Interpreter: public ConstAstVisitor<Interpreter, Value>{
+	public:
+	struct Unknown{};
+
+	private:
+	struct Slot{
+		Value val;
+		bool set = false;
+	};
+	struct Frame{
+		const FuncDeclNode *func;
+		std::shared_ptr<Scope> scope;
+		std::unordered_map<const Scope::Variable*, std::vector<Slot>> vars;
+		size_t memory = 0;
+		bool returned = false;
+		Value result;
+	};
+
+	const ConstEvaluator::FunctionTable &functions;
+	const ConstEvaluator::PureSet &pure;
+	//A deque so a caller's frame stays put while callees push theirs
+	std::deque<Frame> frames;
+	size_t steps = 0, memory = 0;
+
+	static void Check(bool cond) { if(!cond) throw Unknown{}; }
+	void Step() { Check(++steps <= ConstEvaluator::STEP_LIMIT); }
+
+	//Width a variable of this type is stored with
+	static Value Like(const VarType &type){
+		switch(type.type){
+			case VarType::Type::CHAR: return Int(8, 0);
+			case VarType::Type::SHORT: return Int(16, 0);
+			case VarType::Type::INT: return Int(32, 0);
+			case VarType::Type::LONG: return Int(64, 0);
+			case VarType::Type::FLOAT: return Float(32, 0);
+			case VarType::Type::DOUBLE: return Float(64, 0);
+			default: throw Unknown{};
+		}
+	}
+	//Same conversions as CastTo in codegen, an i1 is zero extended and converted as signed
+	static Value Convert(const Value &val, const Value &to){
+		if(val.isFloat == to.isFloat && val.bits == to.bits) return val;
+
+		if(!val.isFloat && !to.isFloat)
+			return Int(to.bits, val.bits == 1 && to.bits > 1 ? val.intVal & 1 : val.intVal);
+		if(!val.isFloat)
+			return Float(to.bits, to.bits == 32 ? (double)(float)val.intVal : (double)val.intVal);
+		if(to.isFloat)
+			return Float(to.bits, val.floatVal);
+
+		//Out of range is poison in LLVM
+		double truncated = std::trunc(val.floatVal);
+		double limit = std::ldexp(1.0, to.bits - 1);
+		Check(!std::isnan(truncated) && truncated >= -limit && truncated < limit);
+		return Int(to.bits, (std::int64_t)truncated);
+	}
+	static bool Condition(const Value &val){
+		if(val.isFloat) return !std::isnan(val.floatVal) && val.floatVal != 0.0;
+		return val.intVal != 0;
+	}
+	static Value Bool(bool val) { return Int(1, val ? -1 : 0); }
+
+	std::vector<Slot> &Storage(const Token &name){
+		Check(!frames.empty());
+		bool isGlobal = false;
+		auto &var = Scope::Lookup(frames.back().scope, name, &isGlobal);
+		Check(!isGlobal);
+
+		auto found = frames.back().vars.find(&var);
+		Check(found != frames.back().vars.end());
+		return found->second;
+	}
+	const VarType &TypeOf(const Token &name){
+		return Scope::Lookup(frames.back().scope, name).type;
+	}
+	size_t Element(std::vector<Slot> &storage, const Node &index){
+		auto at = Convert(Visit(index), Int(64, 0)).intVal;
+		Check(at >= 0 && (size_t)at < storage.size());
+		return at;
+	}
+
+	public:
+	Interpreter(const ConstEvaluator::FunctionTable &functions_, const ConstEvaluator::PureSet &pure_): functions(functions_), pure(pure_) {}
+
+	Value Call(const FuncDeclNode &func, const std::vector<Value> &args){
+		Step();
+		Check(frames.size() < ConstEvaluator::DEPTH_LIMIT && func.block && func.block->type == NodeType::BLOCK);
+
+		auto &frame = frames.emplace_back();
+		frame.func = &func;
+		frame.scope = static_cast<BlockNode&>(*func.block).myScope;
+		for(size_t i = 0; i < func.params.size(); ++i){
+			auto &param = *func.params[i];
+			frame.vars[&Scope::Lookup(frame.scope, param.ident)] = { Slot{ Convert(args[i], Like(*param.varType)), true } };
+		}
+
+		Visit(*func.block);
+
+		//Falling off the end returns zero, a void function has no value to give
+		Value result = frame.returned ? frame.result : Value{};
+		if(!frame.returned && func.funcType->type != VarType::Type::VOID)
+			result = Convert(Int(32, 0), Like(*func.funcType));
+		memory -= frame.memory;
+		frames.pop_back();
+		return result;
+	}
+
+	Value VisitNode(const Node&) { throw Unknown{}; }
+	Value VisitVal(const ValNode &node){
+		auto &val = node.val;
+		switch(val.type){
+			case Token::Type::INTEGER_NUMBER: return Int(32, val.intVal);
+			case Token::Type::FLOATING_NUMBER: return Float(64, val.floatVal);
+			case Token::Type::CHAR_LITERAL: return Int(8, val.intVal);
+			case Token::Type::IDENT: break;
+			default: throw Unknown{};
+		}
+
+		auto &storage = Storage(val);
+		Check(storage.size() == 1 && !TypeOf(val).isArray && storage[0].set);
+		return storage[0].val;
+	}
+	Value VisitBinary(const BinaryNode &node){
+		auto l = Visit(*node.lhs);
+		auto r = Visit(*node.rhs);
+
+		//Float arithmetic done in double and rounded after is exact, like the float op would be
+		if(l.isFloat || r.isFloat){
+			unsigned bits = std::max<unsigned>(l.isFloat ? l.bits : 0, r.isFloat ? r.bits : 0);
+			l = Convert(l, Float(bits, 0));
+			r = Convert(r, Float(bits, 0));
+			double a = l.floatVal, b = r.floatVal;
+			bool ordered = !std::isnan(a) && !std::isnan(b);
+
+			switch(node.operand.type){
+				case Token::Type::PLUS: return Float(bits, a + b);
+				case Token::Type::MINUS: return Float(bits, a - b);
+				case Token::Type::STAR: return Float(bits, a * b);
+				case Token::Type::SLASH: return Float(bits, a / b);
+				case Token::Type::EQ: return Bool(a == b);
+				case Token::Type::NEQ: return Bool(ordered && a != b);
+				case Token::Type::GREATER: return Bool(a > b);
+				case Token::Type::GEQ: return Bool(a >= b);
+				case Token::Type::LESS: return Bool(a < b);
+				case Token::Type::LEQ: return Bool(a <= b);
+				default: throw Unknown{};
+			}
+		}
+
+		if(l.bits < r.bits) l = Convert(l, r);
+		else r = Convert(r, l);
+		unsigned bits = l.bits;
+		std::uint64_t a = l.intVal, b = r.intVal;
+
+		switch(node.operand.type){
+			case Token::Type::PLUS: return Int(bits, a + b);
+			case Token::Type::MINUS: return Int(bits, a - b);
+			case Token::Type::STAR: return Int(bits, a * b);
+			case Token::Type::SLASH:
+				//Both are undefined for sdiv
+				Check(r.intVal != 0 && !(r.intVal == -1 && l.intVal == Int(bits, (std::uint64_t)1 << (bits - 1)).intVal));
+				return Int(bits, l.intVal / r.intVal);
+			case Token::Type::EQ: return Bool(l.intVal == r.intVal);
+			case Token::Type::NEQ: return Bool(l.intVal != r.intVal);
+			case Token::Type::GREATER: return Bool(l.intVal > r.intVal);
+			case Token::Type::GEQ: return Bool(l.intVal >= r.intVal);
+			case Token::Type::LESS: return Bool(l.intVal < r.intVal);
+			case Token::Type::LEQ: return Bool(l.intVal <= r.intVal);
+			default: throw Unknown{};
+		}
+	}
+	Value VisitVarDecl(const VarDeclNode &node){
+		auto &frame = frames.back();
+		auto &var = Scope::Lookup(frame.scope, node.ident);
+		size_t count = node.varType->isArray ? node.varType->arrSize : 1;
+		Check(count);
+
+		//Declared again on every pass through a loop, the old storage goes away
+		auto &storage = frame.vars[&var];
+		memory += count - storage.size();
+		frame.memory += count - storage.size();
+		Check(memory <= ConstEvaluator::MEMORY_LIMIT);
+		storage.assign(count, Slot{});
+
+		if(node.initial->type != NodeType::ERR)
+			storage[0] = Slot{ Convert(Visit(*node.initial), Like(*node.varType)), true };
+		return Value{};
+	}
+	Value VisitBlock(const BlockNode &node){
+		auto &frame = frames.back();
+		auto parent = frame.scope;
+		if(node.myScope) frame.scope = node.myScope;
+
+		for(auto &stmt: node.stmts){
+			Step();
+			Visit(*stmt);
+			if(frame.returned) break;
+		}
+
+		frame.scope = parent;
+		return Value{};
+	}
+	Value VisitIf(const IfNode &node){
+		if(Condition(Visit(*node.cond))) Visit(*node.then);
+		else if(node.elseBody->type != NodeType::ERR) Visit(*node.elseBody);
+		return Value{};
+	}
+	Value VisitWhile(const WhileNode &node){
+		auto &frame = frames.back();
+		while(!frame.returned){
+			Step();
+			if(!Condition(Visit(*node.cond))) break;
+			Visit(*node.then);
+		}
+		return Value{};
+	}
+	Value VisitSwitch(const SwitchNode &node){
+		auto val = Visit(*node.value);
+		if(val.isFloat || val.bits == 1) val = Convert(val, Int(64, 0));
+
+		//Labels are narrowed to the value's width, the first arm one of them matches runs
+		const CaseNode *taken = nullptr;
+		for(auto &arm: node.cases){
+			for(auto &label: arm->labels){
+				if(!taken && Int(val.bits, label->val.intVal).intVal == val.intVal) taken = arm.get();
+			}
+		}
+		for(auto &arm: node.cases){
+			if(!taken && arm->isDefault) taken = arm.get();
+		}
+		if(taken) Visit(*taken->body);
+		return Value{};
+	}
+	Value VisitReturn(const ReturnNode &node){
+		auto &frame = frames.back();
+		bool isVoid = frame.func->funcType->type == VarType::Type::VOID;
+		//A bare return in a function with a value doesn't lower to anything valid
+		Check(isVoid == (node.expr->type == NodeType::ERR));
+
+		if(!isVoid) frame.result = Convert(Visit(*node.expr), Like(*frame.func->funcType));
+		frame.returned = true;
+		return Value{};
+	}
+	Value VisitVarAssign(const VarAssignNode &node){
+		auto &storage = Storage(node.varName);
+		auto &type = TypeOf(node.varName);
+
+		size_t at = 0;
+		if(node.index->type != NodeType::ERR) at = Element(storage, *node.index);
+		else Check(!type.isArray);
+		Check(node.expression->type != NodeType::ERR);
+
+		storage[at] = Slot{ Convert(Visit(*node.expression), Like(type)), true };
+		return Value{};
+	}
+	Value VisitIndex(const IndexNode &node){
+		auto &storage = Storage(node.array);
+		auto &slot = storage[Element(storage, *node.index)];
+		Check(slot.set);
+		return slot.val;
+	}
+	Value VisitFuncCall(const FuncCallNode &node){
+		auto callee = functions.find(node.funcName.symbol);
+		Check(callee != functions.end() && pure.contains(callee->second));
+
+		std::vector<Value> args;
+		for(auto &param: node.params)
+			args.push_back(Visit(*param));
+		return Call(*callee->second, args);
+	}
+};
+
+std::optional<Value> ConstEvaluator::Evaluate(const FuncCallNode &call){
+	auto callee = functions.find(call.funcName.symbol);
+	if(callee == functions.end() || !pure.contains(callee->second) || callee->second->funcType->type == VarType::Type::VOID)
+		return std::nullopt;
+
+	Interpreter interpreter(functions, pure);
+	std::vector<Value> args;
+	std::vector<std::int64_t> key;
+	try{
+		//Outside of any frame an argument can only be made of literals and other pure calls
+		for(auto &param: call.params){
+			args.push_back(interpreter.Visit(*param));
+
+			auto &arg = args.back();
+			std::int64_t bits = arg.intVal;
+			if(arg.isFloat) std::memcpy(&bits, &arg.floatVal, sizeof(bits));
+			key.insert(key.end(), { arg.isFloat, arg.bits, bits });
+		}
+	}
+	catch(const Interpreter::Unknown&){
+		return std::nullopt;
+	}
+
+	auto [found, added] = results.try_emplace({ callee->second, key });
+	if(!added) return found->second;
+
+	try{
+		found->second = interpreter.Call(*callee->second, args);
+	}
+	catch(const Interpreter::Unknown&){
+		found->second = std::nullopt;
+	}
+	return found->second;
+}
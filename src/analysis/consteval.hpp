@@ -0,0 +1,46 @@
+#pragma once
+
+#include <map>
+#include <vector>
+#include <cstdint>
+#include <optional>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "parser/parser.hpp"
+
+//Runs calls to pure functions with constant arguments at compile time. A function is pure when
+//all it touches are its own parameters and locals and all it calls are other pure functions.
+//Evaluation computes exactly what the generated code would, anything undefined there (reading
+//an uninitialized local, dividing by zero, an index out of range) or running past the limits
+//leaves the call to run time.
+class ConstEvaluator{
+	public:
+	struct Value{
+		bool isFloat = false;
+		//Integers are kept sign extended from their width, so an i1 true is -1
+		unsigned bits = 32;
+		std::int64_t intVal = 0;
+		double floatVal = 0;
+	};
+	using FunctionTable = std::unordered_map<std::uint32_t, FuncDeclNode*>;
+	using PureSet = std::unordered_set<const FuncDeclNode*>;
+
+	//Per evaluated call: statements and loop iterations, array elements alive, nested calls
+	static constexpr size_t STEP_LIMIT = 1 << 20;
+	static constexpr size_t MEMORY_LIMIT = 1 << 20;
+	static constexpr size_t DEPTH_LIMIT = 256;
+
+	static PureSet FindPure(const FunctionTable &functions);
+
+	ConstEvaluator(const FunctionTable &functions_, const PureSet &pure_): functions(functions_), pure(pure_) {}
+
+	//The call's result, if the callee is pure, returns a value and the arguments are constants
+	std::optional<Value> Evaluate(const FuncCallNode &call);
+
+	private:
+	const FunctionTable &functions;
+	const PureSet &pure;
+	//Calls repeat (a table size used all over the file), failed ones are remembered as well
+	std::map<std::pair<const FuncDeclNode*, std::vector<std::int64_t>>, std::optional<Value>> results;
+};
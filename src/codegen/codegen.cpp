@@ -0,0 +1,1220 @@
+#include <mutex>
+#include <thread>
+#include <iostream>
+#include <algorithm>
+#include <unordered_map>
+
+#include <llvm/Pass.h>
+#include <llvm/IR/Type.h>
+#include <llvm/IR/Module.h>
+#include <llvm/IR/Verifier.h>
+#include <llvm/IR/Constant.h>
+#include <llvm/IR/MDBuilder.h>
+#include <llvm/IR/IRBuilder.h>
+#include <llvm/IR/Intrinsics.h>
+#include <llvm/IR/LLVMContext.h>
+#include <llvm/Linker/Linker.h>
+#include <llvm/Transforms/Utils.h>
+#include <llvm/Transforms/Scalar.h>
+#include <llvm/IR/LegacyPassManager.h>
+#include <llvm/IR/ModuleSlotTracker.h>
+#include <llvm/Analysis/ValueTracking.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Bitcode/BitcodeReader.h>
+#include <llvm/Bitcode/BitcodeWriter.h>
+#include <llvm/Transforms/InstCombine/InstCombine.h>
+
+#include "parser/parser.hpp"
+#include "parser/visitor.hpp"
+#include "util/logger.hpp"
+#include "util/memreport.hpp"
+#include "analysis/callgraph.hpp"
+#include "analysis/consteval.hpp"
+#include "codegen/inliner.hpp"
+#include "codegen/profile.hpp"
+#include "codegen/target.hpp"
+
+//Codegen state is per thread so functions can be lowered in parallel, each worker into its own module
+static thread_local std::unique_ptr<llvm::LLVMContext> context;
+static thread_local std::unique_ptr<llvm::IRBuilder<>> builder;
+static thread_local std::unique_ptr<llvm::Module> module;
+static thread_local llvm::BasicBlock *currentScope = nullptr;
+static thread_local llvm::Function *currFunc = nullptr;
+static thread_local std::shared_ptr<Scope> codegenScope;
+
+//Top level functions by name, filled before lowering starts and only read by the workers
+static std::unordered_map<std::uint32_t, FuncDeclNode*> functions;
+//Without main or an export every function is an entry point, same as for the call graph
+static bool hasEntryPoints = false;
+//Internal functions a tail call ties to one on the C calling convention, they keep it as well
+static std::unordered_set<const FuncDeclNode*> sharedConvention;
+
+//-fprofile-generate gives every function an array of counters, -fprofile-use reads them back
+static bool profileGenerate = false;
+static const Profile *profileUse = nullptr;
+static std::string profileFile;
+//Counters of the function being lowered and the next site to number
+static thread_local llvm::GlobalVariable *profCounters = nullptr;
+static thread_local const std::vector<std::uint64_t> *profCounts = nullptr;
+static thread_local size_t profNextSite = 0;
+
+//Set by -march/-mtune, null leaves modules without a triple
+static const Target *codegenTarget = nullptr;
+
+//Calls to pure functions with constant arguments are evaluated instead of emitted. Each thread
+//has its own evaluator, the functions some call was folded into are collected for cleanup
+static ConstEvaluator::PureSet pureFunctions;
+static thread_local std::unique_ptr<ConstEvaluator> evaluator;
+static std::unordered_set<const FuncDeclNode*> foldedFunctions;
+static std::mutex foldedLock;
+
+//Parser whose tree is being lowered, errors found while lowering go to its diagnostics
+static const Parser *loweredParser = nullptr;
+static std::mutex diagLock;
+
+//Arrays are aligned for vector loads and stores. Every array starts out as a local or global
+//of ours, so array parameters can promise the same alignment
+static constexpr unsigned ARRAY_ALIGN = 16;
+static bool emitBoundsChecks = false;
+//Shared target of the failed bounds checks in the function being lowered
+static thread_local llvm::BasicBlock *trapBlock = nullptr;
+
+//Arrays of vectors are aligned for the vectors as well
+static llvm::Align ArrayAlign(const VarType &type){
+	return std::max(llvm::Align(ARRAY_ALIGN), module->getDataLayout().getABITypeAlign(type.Codegen()));
+}
+
+//Workers report from their own threads. Past the error limit there is nothing left to stop,
+//lowering carries on and the run fails anyway
+template<typename ...Args>
+static void CodegenError(const Token &at, Args&& ...args){
+	std::lock_guard lock(diagLock);
+	try{
+		Log::ErrorAt(*loweredParser, at, std::forward<Args>(args)...);
+	}
+	catch(const Diagnostics::LimitReached&){}
+}
+
+static Scope::Variable &FindCodegenIdent(const Token &name){
+	return Scope::Lookup(codegenScope, name);
+}
+//What a variable is stored as, arrays with a size hold their elements in place
+static llvm::Type *StorageType(const VarType &type){
+	if(type.isArray && type.arrSize) return llvm::ArrayType::get(type.Codegen(), type.arrSize);
+	return type.Codegen();
+}
+//Globals are looked up by name in the module being generated instead of through
+//Variable::val, a parallel worker only has a declaration of them in its own module
+static llvm::Value *VariableAddress(const Token &name){
+	bool isGlobal = false;
+	auto &var = Scope::Lookup(codegenScope, name, &isGlobal);
+	if(!isGlobal || var.type.type == VarType::Type::ERR) return var.val;
+
+	if(auto global = module->getNamedGlobal(name.Name())) return global;
+	auto global = new llvm::GlobalVariable(*module, StorageType(var.type), false, llvm::GlobalValue::ExternalLinkage, nullptr, name.Name());
+	if(var.type.isArray) global->setAlignment(ArrayAlign(var.type));
+	return global;
+}
+
+llvm::Type *VarType::Codegen() const {
+	if(type == Type::VECTOR) return llvm::FixedVectorType::get(baseType->Codegen(), lanes);
+	if(type == Type::PTR){
+		switch(type){
+			case Type::VOID:
+				return llvm::Type::getInt64Ty(*context);
+			case Type::CHAR:
+				return llvm::Type::getInt8PtrTy(*context);
+			case Type::SHORT:
+				return llvm::Type::getInt16PtrTy(*context);
+			case Type::INT:
+				return llvm::Type::getInt32PtrTy(*context);
+			case Type::LONG:
+				return llvm::Type::getInt64PtrTy(*context);
+			case Type::FLOAT:
+				return llvm::Type::getFloatPtrTy(*context);
+			case Type::DOUBLE:
+				return llvm::Type::getDoublePtrTy(*context);
+		}
+	}
+	else {
+		switch(type){
+			case Type::VOID:
+				return llvm::Type::getVoidTy(*context);
+			case Type::CHAR:
+				return llvm::Type::getInt8Ty(*context);
+			case Type::SHORT:
+				return llvm::Type::getInt16Ty(*context);
+			case Type::INT:
+				return llvm::Type::getInt32Ty(*context);
+			case Type::LONG:
+				return llvm::Type::getInt64Ty(*context);
+			case Type::FLOAT:
+				return llvm::Type::getFloatTy(*context);
+			case Type::DOUBLE:
+				return llvm::Type::getDoubleTy(*context);
+		}
+	}
+
+	std::cerr << "Type not found\n";
+	return nullptr;
+}
+//Brings a value to the type it is stored or returned as. A scalar goes to every lane of a
+//vector, vectors of the same length are converted lane by lane
+static llvm::Value *CastTo(llvm::Value *val, llvm::Type *type){
+	auto from = val->getType();
+	if(from == type) return val;
+
+	if(auto vector = llvm::dyn_cast<llvm::FixedVectorType>(type); vector && !from->isVectorTy())
+		return builder->CreateVectorSplat(vector->getNumElements(), CastTo(val, vector->getElementType()), "splat");
+
+	if(from->isIntOrIntVectorTy() && type->isIntOrIntVectorTy())
+		return builder->CreateIntCast(val, type, from->getScalarSizeInBits() > 1, "cast");
+	if(from->isIntOrIntVectorTy() && type->isFPOrFPVectorTy())
+		return builder->CreateSIToFP(val, type, "cast");
+	if(from->isFPOrFPVectorTy() && type->isIntOrIntVectorTy())
+		return builder->CreateFPToSI(val, type, "cast");
+	if(from->isFPOrFPVectorTy() && type->isFPOrFPVectorTy())
+		return builder->CreateFPCast(val, type, "cast");
+
+	return val;
+}
+//Anything after a terminator goes to a fresh block nothing branches to
+static void EnsureInsertable(){
+	auto curr = builder->GetInsertBlock();
+	if(!curr || !curr->getTerminator()) return;
+
+	builder->SetInsertPoint(llvm::BasicBlock::Create(*context, "dead", curr->getParent()));
+}
+//Turns any scalar into an i1 the branch instructions can take
+static llvm::Value *ToCondition(llvm::Value *val){
+	if(val->getType()->isIntegerTy(1)) return val;
+	if(val->getType()->isFloatingPointTy())
+		return builder->CreateFCmpONE(val, llvm::ConstantFP::get(val->getType(), 0.0), "cond");
+
+	return builder->CreateICmpNE(val, llvm::ConstantInt::get(val->getType(), 0), "cond");
+}
+//Traps unless index is below size. Constant indices in range need no check, the parser
+//already rejected the ones out of it
+static void CheckBounds(llvm::Value *index, size_t size){
+	if(auto constant = llvm::dyn_cast<llvm::ConstantInt>(index); constant && constant->getValue().ult(size)) return;
+
+	auto func = builder->GetInsertBlock()->getParent();
+	if(!trapBlock){
+		trapBlock = llvm::BasicBlock::Create(*context, "boundsfail", func);
+		llvm::IRBuilder<> trap(trapBlock);
+		trap.CreateCall(llvm::Intrinsic::getDeclaration(module.get(), llvm::Intrinsic::trap));
+		trap.CreateUnreachable();
+	}
+
+	auto inBounds = llvm::BasicBlock::Create(*context, "inbounds", func);
+	auto check = builder->CreateCondBr(builder->CreateICmpULT(index, builder->getInt64(size), "inrange"), inBounds, trapBlock);
+	check->setMetadata(llvm::LLVMContext::MD_prof, llvm::MDBuilder(*context).createBranchWeights(1 << 20, 1));
+	builder->SetInsertPoint(inBounds);
+}
+//The lane a subscript of a vector picks, checked like an array's
+static llvm::Value *LaneIndex(const VarType &vector, llvm::Value *index){
+	index = CastTo(index, builder->getInt64Ty());
+	if(emitBoundsChecks)
+		CheckBounds(index, vector.lanes);
+	return index;
+}
+//Array parameters are a pointer to the first element, everything else holds the elements in place
+static llvm::Value *ArrayPointer(const Token &name){
+	auto &var = FindCodegenIdent(name);
+	auto base = VariableAddress(name);
+	if(!base || llvm::isa<llvm::Argument>(base)) return base;
+
+	return builder->CreateConstInBoundsGEP2_64(StorageType(var.type), base, 0, 0, name.Name());
+}
+static llvm::Value *ElementAddress(const Token &name, llvm::Value *index){
+	auto &var = FindCodegenIdent(name);
+	auto base = ArrayPointer(name);
+	if(!base || !index) return nullptr;
+
+	index = CastTo(index, builder->getInt64Ty());
+	if(emitBoundsChecks && var.type.arrSize)
+		CheckBounds(index, var.type.arrSize);
+	return builder->CreateInBoundsGEP(var.type.Codegen(), base, index, name.Name() + ".elem");
+}
+
+//Functions nothing outside the file can call get internal linkage and the fast calling convention
+static bool IsInternal(const FuncDeclNode &node){
+	return hasEntryPoints && !node.isExported && !node.IsPrototype() && node.ident.Name() != "main";
+}
+static bool IsFastConvention(const FuncDeclNode &node){
+	return IsInternal(node) && !sharedConvention.contains(&node);
+}
+
+//An argument of the lowered function. A soa array is passed as one array per member, type is
+//the element of an array and the value's type otherwise
+struct LoweredParam{
+	const VarDeclNode *param;
+	const VarType *type;
+	Token ident;
+};
+static std::vector<LoweredParam> LowerParams(const FuncDeclNode &node){
+	std::vector<LoweredParam> lowered;
+	for(auto &param: node.params){
+		if(!param->varType->isSoa){
+			lowered.push_back(LoweredParam{ param.get(), param->varType, param->ident });
+			continue;
+		}
+		for(auto &member: param->varType->members)
+			lowered.push_back(LoweredParam{ param.get(), member.type, SoaMember(param->ident, member) });
+	}
+	return lowered;
+}
+static llvm::FunctionType *FunctionType(const FuncDeclNode &node){
+	std::vector<llvm::Type*> params;
+	for(auto &arg: LowerParams(node)){
+		auto type = arg.type->Codegen();
+		params.push_back(arg.param->varType->isArray ? llvm::PointerType::getUnqual(type) : type);
+	}
+	return llvm::FunctionType::get(node.funcType->Codegen(), params, false);
+}
+//The function in the current module, declared with its signature if it isn't there yet
+static llvm::Function *DeclareFunction(const FuncDeclNode &node){
+	if(auto func = module->getFunction(node.ident.Name())) return func;
+
+	auto lowered = LowerParams(node);
+
+	//Linkage is made internal once all workers' modules are linked, an internal
+	//declaration couldn't be resolved against another module's definition
+	auto func = llvm::Function::Create(
+		FunctionType(node), 
+		llvm::Function::ExternalLinkage, 
+		node.ident.Name(), 
+		*module
+	);
+	if(IsFastConvention(node)) func->setCallingConv(llvm::CallingConv::Fast);
+	if(node.isInline) func->addFnAttr(llvm::Attribute::InlineHint);
+	for(size_t i = 0; i < lowered.size(); ++i){
+		auto &param = *lowered[i].param;
+		func->getArg(i)->setName(lowered[i].ident.Name());
+		if(!param.varType->isArray) continue;
+
+		func->addParamAttr(i, llvm::Attribute::getWithAlignment(*context, ArrayAlign(*lowered[i].type)));
+		func->addParamAttr(i, llvm::Attribute::NonNull);
+		if(param.isRestrict) func->addParamAttr(i, llvm::Attribute::NoAlias);
+		//The parser only lets arrays of at least this size through
+		if(param.varType->arrSize)
+			func->addDereferenceableParamAttr(i, param.varType->arrSize * module->getDataLayout().getTypeAllocSize(lowered[i].type->Codegen()));
+	}
+
+	return func;
+}
+
+//Callees of the returns that are a call, where a tail call can come from
+class TailCallFinder: public ConstAstVisitor<TailCallFinder>{
+	public:
+	std::vector<std::uint32_t> callees;
+
+	void VisitNode(const Node &node) { VisitChildren(node); }
+	void VisitReturn(const ReturnNode &node){
+		if(node.expr->type == NodeType::FUNCTIONCALL)
+			callees.push_back(static_cast<const FuncCallNode&>(*node.expr).funcName.symbol);
+	}
+};
+//Caller and callee of a tail call have to be on the same calling convention. Whatever tail calls
+//or is tail called by a function that has to keep the C one (exported, main, defined elsewhere)
+//keeps it too
+static void SettleConventions(){
+	sharedConvention.clear();
+	std::vector<std::pair<const FuncDeclNode*, const FuncDeclNode*>> tailCalls;
+	for(auto &[symbol, decl]: functions){
+		if(!decl->block) continue;
+
+		TailCallFinder finder;
+		finder.Visit(*decl->block);
+		for(auto callee: finder.callees){
+			auto found = functions.find(callee);
+			if(found != functions.end() && FunctionType(*found->second) == FunctionType(*decl))
+				tailCalls.emplace_back(decl, found->second);
+		}
+	}
+
+	std::unordered_set<const FuncDeclNode*> cConvention;
+	for(auto &[symbol, decl]: functions){
+		if(!IsInternal(*decl)) cConvention.insert(decl);
+	}
+	for(bool changed = true; changed;){
+		changed = false;
+		for(auto [caller, callee]: tailCalls){
+			if(cConvention.contains(caller) == cConvention.contains(callee)) continue;
+			cConvention.insert(caller);
+			cConvention.insert(callee);
+			changed = true;
+		}
+	}
+	for(auto decl: cConvention){
+		if(IsInternal(*decl)) sharedConvention.insert(decl);
+	}
+}
+//A call the caller can return through by handing its frame over: same prototype and convention,
+//and none of the caller's stack passed on since it is gone once the callee runs
+static bool CanTailCall(const llvm::CallInst &call){
+	const llvm::Function *caller = call.getFunction(), *callee = call.getCalledFunction();
+	if(!callee || callee->isIntrinsic() || callee->getFunctionType() != caller->getFunctionType() || callee->getCallingConv() != caller->getCallingConv())
+		return false;
+
+	for(auto &arg: call.args()){
+		if(llvm::isa<llvm::AllocaInst>(llvm::getUnderlyingObject(arg))) return false;
+	}
+	return true;
+}
+
+static std::string CounterName(const FuncDeclNode &node){
+	return "__prof." + node.ident.Name();
+}
+//Sets up the counters of a function and counts the entry, the builder is at its entry block
+static void BeginProfile(const FuncDeclNode &node, llvm::Function &func){
+	profCounters = nullptr;
+	profCounts = nullptr;
+	profNextSite = 1;
+	if(!profileGenerate && !profileUse) return;
+
+	ProfileSites sites(node);
+	if(profileUse){
+		profCounts = profileUse->Counts(Profile::Key(profileFile, node.ident.Name()), sites);
+		if(profCounts) func.setEntryCount((*profCounts)[0]);
+		return;
+	}
+
+	auto type = llvm::ArrayType::get(builder->getInt64Ty(), sites.counters);
+	profCounters = new llvm::GlobalVariable(*module, type, false, llvm::GlobalValue::InternalLinkage, llvm::ConstantAggregateZero::get(type), CounterName(node));
+	auto entry = builder->CreateConstInBoundsGEP2_64(type, profCounters, 0, 0);
+	builder->CreateStore(builder->CreateAdd(builder->CreateLoad(builder->getInt64Ty(), entry), builder->getInt64(1)), entry);
+}
+//Reserves the two counters of an if or while
+static size_t NextProfileSite(){
+	size_t site = profNextSite;
+	profNextSite += 2;
+	return site;
+}
+//Bumps one counter at the start of the block the builder is in
+static void CountEdge(size_t counter){
+	if(!profCounters) return;
+
+	auto type = profCounters->getValueType();
+	auto address = builder->CreateConstInBoundsGEP2_64(type, profCounters, 0, counter);
+	builder->CreateStore(builder->CreateAdd(builder->CreateLoad(builder->getInt64Ty(), address), builder->getInt64(1)), address);
+}
+//Weights the two edges of a branch with their counters from the profile
+static void WeighBranch(llvm::BranchInst *branch, size_t site){
+	if(!profCounts) return;
+
+	std::uint64_t taken = (*profCounts)[site], notTaken = (*profCounts)[site + 1];
+	//Weights are 32 bit, only their ratio matters
+	std::uint64_t scale = std::max(taken, notTaken) / UINT32_MAX + 1;
+	branch->setMetadata(llvm::LLVMContext::MD_prof, llvm::MDBuilder(*context).createBranchWeights(taken / scale, notTaken / scale));
+}
+
+//Lowers one node (and everything below it) into the current thread's module
+class CodegenVisitor: public AstVisitor<CodegenVisitor, llvm::Value*>{
+	public:
+	llvm::Value *VisitVal(ValNode &node);
+	llvm::Value *VisitBinary(BinaryNode &node);
+	llvm::Value *VisitVarDecl(VarDeclNode &node);
+	llvm::Value *VisitBlock(BlockNode &node);
+	llvm::Value *VisitFuncDecl(FuncDeclNode &node);
+	llvm::Value *VisitVarAssign(VarAssignNode &node);
+	llvm::Value *VisitWhile(WhileNode &node);
+	llvm::Value *VisitIf(IfNode &node);
+	llvm::Value *VisitSwitch(SwitchNode &node);
+	llvm::Value *VisitReturn(ReturnNode &node);
+	llvm::Value *VisitFuncCall(FuncCallNode &node);
+	llvm::Value *VisitIndex(IndexNode &node);
+	llvm::Value *VisitVectorBuiltin(FuncCallNode &node, VectorBuiltin builtin);
+};
+
+llvm::Value *CodegenVisitor::VisitVal(ValNode &node) {
+	auto &val = node.val;
+	if((int)val.type >= (int)Token::Type::VALUES_BEGIN && (int)val.type <= (int)Token::Type::VALUES_END){
+		switch(val.type){
+			case Token::Type::INTEGER_NUMBER:
+				return llvm::ConstantInt::get(llvm::Type::getInt32Ty(*context), val.intVal, true);
+			case Token::Type::FLOATING_NUMBER:
+				return llvm::ConstantFP::get(*context, llvm::APFloat(val.floatVal));
+			case Token::Type::CHAR_LITERAL:
+				return llvm::ConstantInt::get(llvm::Type::getInt8Ty(*context), val.intVal);
+			default:
+				return nullptr;
+		}
+	}
+
+	auto &ident = FindCodegenIdent(val);
+	auto address = VariableAddress(val);
+	if(ident.type.type == VarType::Type::ERR || !address){
+		CodegenError(val, "Invalid variable '", val.Name(), "' referenced");
+		return nullptr;
+	}
+	//Arrays are only ever passed on, as a pointer to their first element
+	if(ident.type.isArray) return ArrayPointer(val);
+	return builder->CreateLoad(ident.type.Codegen(), address, val.Name());
+}
+llvm::Value *CodegenVisitor::VisitBinary(BinaryNode &node) {
+	auto l = Visit(*node.lhs);
+	auto r = Visit(*node.rhs);
+
+	if(!l || !r) return nullptr;
+
+	//Mixed operands are promoted to the floating point side's type, two floating point or two
+	//integer operands to the wider of the two. Vectors work lane by lane, a scalar operand is
+	//converted to the lanes' type and used for each
+	if(l->getType()->isVectorTy() || r->getType()->isVectorTy()){
+		auto type = l->getType()->isVectorTy() ? l->getType() : r->getType();
+		l = CastTo(l, type);
+		r = CastTo(r, type);
+	}
+	else if(l->getType()->isFloatingPointTy() || r->getType()->isFloatingPointTy()){
+		auto type = l->getType()->isFloatingPointTy() ? l->getType() : r->getType();
+		if(r->getType()->isFloatingPointTy() && r->getType()->getPrimitiveSizeInBits() > type->getPrimitiveSizeInBits())
+			type = r->getType();
+		l = CastTo(l, type);
+		r = CastTo(r, type);
+	}
+	else if(l->getType()->getIntegerBitWidth() < r->getType()->getIntegerBitWidth()){
+		l = CastTo(l, r->getType());
+	}
+	else{
+		r = CastTo(r, l->getType());
+	}
+	bool isFloat = l->getType()->isFPOrFPVectorTy();
+
+	switch(node.operand.type){
+		case Token::Type::PLUS:
+			return isFloat ? builder->CreateFAdd(l, r, "addtmp") : builder->CreateAdd(l, r, "addtmp");
+		case Token::Type::MINUS:
+			return isFloat ? builder->CreateFSub(l, r, "subtemp") : builder->CreateSub(l, r, "subtemp");
+		case Token::Type::STAR:
+			return isFloat ? builder->CreateFMul(l, r, "multemp") : builder->CreateMul(l, r, "multemp");
+		case Token::Type::SLASH:
+			return isFloat ? builder->CreateFDiv(l, r, "divtemp") : builder->CreateSDiv(l, r, "divtemp");
+		case Token::Type::EQ:
+			return isFloat ? builder->CreateFCmpOEQ(l, r, "cmptmp") : builder->CreateICmpEQ(l, r, "cmptmp");
+		case Token::Type::NEQ:
+			return isFloat ? builder->CreateFCmpONE(l, r, "cmptmp") : builder->CreateICmpNE(l, r, "cmptmp");
+		case Token::Type::GREATER:
+			return isFloat ? builder->CreateFCmpOGT(l, r, "cmptmp") : builder->CreateICmpSGT(l, r, "cmptmp");
+		case Token::Type::GEQ:
+			return isFloat ? builder->CreateFCmpOGE(l, r, "cmptmp") : builder->CreateICmpSGE(l, r, "cmptmp");
+		case Token::Type::LESS:
+			return isFloat ? builder->CreateFCmpOLT(l, r, "cmptmp") : builder->CreateICmpSLT(l, r, "cmptmp");
+		case Token::Type::LEQ:
+			return isFloat ? builder->CreateFCmpOLE(l, r, "cmptmp") : builder->CreateICmpSLE(l, r, "cmptmp");
+		default:
+			CodegenError(node.operand, "Invalid operator");
+			return nullptr;
+	}
+}
+//Locals are allocated on entry, one declared in a loop mustn't grow the stack every iteration
+//and mem2reg only promotes the allocas it finds there
+static llvm::AllocaInst *EntryAlloca(llvm::Type *type, const std::string &name){
+	auto &entry = builder->GetInsertBlock()->getParent()->getEntryBlock();
+	llvm::IRBuilder<> entryBuilder(&entry, entry.begin());
+	return entryBuilder.CreateAlloca(type, nullptr, name);
+}
+//A global outside of functions, a local allocated on entry otherwise
+static llvm::Value *DeclareArray(const VarType &varType, const Token &name){
+	auto type = StorageType(varType);
+	if(!builder->GetInsertBlock()){
+		auto global = new llvm::GlobalVariable(*module, type, false, llvm::GlobalValue::ExternalLinkage, llvm::Constant::getNullValue(type), name.Name());
+		global->setAlignment(ArrayAlign(varType));
+		return global;
+	}
+
+	auto array = EntryAlloca(type, name.Name());
+	array->setAlignment(ArrayAlign(varType));
+	FindCodegenIdent(name).val = array;
+
+	return array;
+}
+
+llvm::Value *CodegenVisitor::VisitVarDecl(VarDeclNode &node) {
+	auto varType = node.varType;
+	auto &ident = FindCodegenIdent(node.ident);
+	llvm::Value *toRet = nullptr;
+	if(varType->isArray && varType->isSoa){
+		//Every member is an array of its own, element accesses were rewritten to them
+		for(auto &member: varType->members){
+			auto name = SoaMember(node.ident, member);
+			toRet = DeclareArray(FindCodegenIdent(name).type, name);
+		}
+		return toRet;
+	}
+	if(varType->isArray) return DeclareArray(*varType, node.ident);
+
+	if(!builder->GetInsertBlock()){
+		//Top level declarations become globals with a constant initializer
+		llvm::Constant *init = llvm::Constant::getNullValue(varType->Codegen());
+		if(node.initial->type != NodeType::ERR){
+			auto val = Visit(*node.initial);
+			if(auto constant = llvm::dyn_cast_or_null<llvm::Constant>(val ? CastTo(val, varType->Codegen()) : nullptr))
+				init = constant;
+			else
+				CodegenError(node.ident, "Initializer of global '", node.ident.Name(), "' is not constant");
+		}
+
+		return new llvm::GlobalVariable(*module, varType->Codegen(), false, llvm::GlobalValue::ExternalLinkage, init, node.ident.Name());
+	}
+
+	toRet = EntryAlloca(varType->Codegen(), node.ident.Name());
+
+	if(node.initial->type != NodeType::ERR){
+		auto init = Visit(*node.initial);
+		if(init) builder->CreateStore(CastTo(init, varType->Codegen()), toRet, false);
+	}
+	ident.val = toRet;
+
+	return toRet;
+}
+llvm::Value *CodegenVisitor::VisitBlock(BlockNode &node) {
+	auto parentScope = codegenScope;
+	codegenScope = node.myScope;
+
+	for(auto &stmt: node.stmts){
+		EnsureInsertable();
+		Visit(*stmt);
+	}
+
+	codegenScope = parentScope;
+
+	return nullptr;
+}
+llvm::Value *CodegenVisitor::VisitFuncDecl(FuncDeclNode &node) {
+	//Prototypes are declared by the first call that needs them
+	if(!node.isReachable || node.IsPrototype()) return nullptr;
+
+	auto func = DeclareFunction(node);
+
+	auto body = llvm::BasicBlock::Create(*context, "entry", func);
+	builder->SetInsertPoint(body);
+	auto lastScope = currentScope;
+	BeginProfile(node, *func);
+
+	//Parameters live in the body's scope and are spilled to the stack like any other local
+	auto parentScope = codegenScope;
+	if(node.block && node.block->type == NodeType::BLOCK)
+		codegenScope = static_cast<BlockNode&>(*node.block).myScope;
+	trapBlock = nullptr;
+	auto lowered = LowerParams(node);
+	for(size_t i = 0; i < lowered.size(); ++i){
+		auto &param = lowered[i];
+		//Array parameters are never assigned, the pointer is used as it came in
+		if(param.param->varType->isArray){
+			FindCodegenIdent(param.ident).val = func->getArg(i);
+			continue;
+		}
+		auto address = builder->CreateAlloca(func->getArg(i)->getType(), 0, nullptr, param.ident.Name() + ".addr");
+		builder->CreateStore(func->getArg(i), address);
+		FindCodegenIdent(param.ident).val = address;
+	}
+	codegenScope = parentScope;
+
+	currentScope = body;
+	currFunc = func;
+	if(node.block){
+		Visit(*node.block);
+	}
+
+	//Falling off the end returns the zero value of the return type
+	if(!builder->GetInsertBlock()->getTerminator()){
+		if(func->getReturnType()->isVoidTy()) builder->CreateRetVoid();
+		else builder->CreateRet(llvm::Constant::getNullValue(func->getReturnType()));
+	}
+	currFunc = nullptr;
+	currentScope = lastScope;
+	profCounters = nullptr;
+	profCounts = nullptr;
+	trapBlock = nullptr;
+	builder->ClearInsertionPoint();
+
+	std::string error_str;
+	llvm::raw_string_ostream ostream{error_str};
+	if(llvm::verifyFunction(*func, &ostream)){
+		CodegenError(node.ident, "Invalid IR generated for '", node.ident.Name(), "': ", ostream.str());
+	}
+
+	return func;
+}
+llvm::Value *CodegenVisitor::VisitVarAssign(VarAssignNode &node) {
+	const auto &varFind = FindCodegenIdent(node.varName);
+	auto address = VariableAddress(node.varName);
+	if(varFind.type.type != VarType::Type::ERR && address && node.index->type != NodeType::ERR && varFind.type.IsVector()){
+		//A lane is stored by putting it into the whole vector
+		auto index = Visit(*node.index);
+		auto val = Visit(*node.expression);
+		if(!index || !val) return nullptr;
+
+		auto type = varFind.type.Codegen();
+		index = LaneIndex(varFind.type, index);
+		auto vector = builder->CreateLoad(type, address, node.varName.Name());
+		return builder->CreateStore(builder->CreateInsertElement(vector, CastTo(val, type->getScalarType()), index, "lane"), address, false);
+	}
+	if(varFind.type.type != VarType::Type::ERR && address){
+		if(node.index->type != NodeType::ERR)
+			address = ElementAddress(node.varName, Visit(*node.index));
+		auto val = Visit(*node.expression);
+		if(!val || !address) return nullptr;
+
+		return builder->CreateStore(CastTo(val, varFind.type.Codegen()), address, false);
+	}
+
+	CodegenError(node.varName, "Invalid type of variable '", node.varName.Name(), "'");
+	return nullptr;
+}
+llvm::Value *CodegenVisitor::VisitWhile(WhileNode &node) {
+	auto func = builder->GetInsertBlock()->getParent();
+	size_t site = NextProfileSite();
+
+	auto condBB = llvm::BasicBlock::Create(*context, "whilecond", func);
+	auto bodyBB = llvm::BasicBlock::Create(*context, "whilebody", func);
+	auto endBB = llvm::BasicBlock::Create(*context, "whileend", func);
+
+	builder->CreateBr(condBB);
+	builder->SetInsertPoint(condBB);
+	auto condVal = Visit(*node.cond);
+	if(!condVal) return nullptr;
+	WeighBranch(builder->CreateCondBr(ToCondition(condVal), bodyBB, endBB), site);
+
+	builder->SetInsertPoint(bodyBB);
+	CountEdge(site);
+	Visit(*node.then);
+	if(!builder->GetInsertBlock()->getTerminator())
+		builder->CreateBr(condBB);
+
+	builder->SetInsertPoint(endBB);
+	CountEdge(site + 1);
+	return endBB;
+}
+llvm::Value *CodegenVisitor::VisitIf(IfNode &node) {
+	size_t site = NextProfileSite();
+	auto condVal = Visit(*node.cond);
+	if(!condVal) return nullptr;
+	condVal = ToCondition(condVal);
+	auto func = builder->GetInsertBlock()->getParent();
+
+	auto thenBB = llvm::BasicBlock::Create(*context, "then", func);
+	auto elseBB = llvm::BasicBlock::Create(*context, "else");
+	auto mergeBB = llvm::BasicBlock::Create(*context, "ifcont");
+
+	WeighBranch(builder->CreateCondBr(condVal, thenBB, elseBB), site);
+
+	builder->SetInsertPoint(thenBB);
+	CountEdge(site);
+	Visit(*node.then);
+	if(!builder->GetInsertBlock()->getTerminator())
+		builder->CreateBr(mergeBB);
+
+	func->getBasicBlockList().push_back(elseBB);
+	builder->SetInsertPoint(elseBB);
+	CountEdge(site + 1);
+	if(node.elseBody->type != NodeType::ERR){
+		Visit(*node.elseBody);
+	}
+	if(!builder->GetInsertBlock()->getTerminator())
+		builder->CreateBr(mergeBB);
+
+	func->getBasicBlockList().push_back(mergeBB);
+	builder->SetInsertPoint(mergeBB);
+
+	return mergeBB;
+}
+//One switch instruction, the backend picks a jump table, bit tests or a balanced tree of
+//compares depending on how dense the labels are
+llvm::Value *CodegenVisitor::VisitSwitch(SwitchNode &node) {
+	auto val = Visit(*node.value);
+	if(!val) return nullptr;
+	//Integers are compared at their own width like C's promoted labels, the rest as long
+	if(!val->getType()->isIntegerTy() || val->getType()->isIntegerTy(1))
+		val = CastTo(val, builder->getInt64Ty());
+	auto type = llvm::cast<llvm::IntegerType>(val->getType());
+	auto func = builder->GetInsertBlock()->getParent();
+
+	auto endBB = llvm::BasicBlock::Create(*context, "switchend");
+	std::vector<llvm::BasicBlock*> arms;
+	auto defaultBB = endBB;
+	size_t labels = 0;
+	for(auto &arm: node.cases){
+		arms.push_back(llvm::BasicBlock::Create(*context, arm->isDefault ? "default" : "case"));
+		if(arm->isDefault) defaultBB = arms.back();
+		labels += arm->labels.size();
+	}
+
+	auto inst = builder->CreateSwitch(val, defaultBB, labels);
+	for(size_t i = 0; i < arms.size(); ++i){
+		for(auto &label: node.cases[i]->labels){
+			//Labels only the parser saw as distinct can collide once narrowed, the first one wins
+			auto constant = llvm::ConstantInt::get(type, label->val.intVal, true);
+			if(inst->findCaseValue(constant) == inst->case_default())
+				inst->addCase(constant, arms[i]);
+		}
+	}
+
+	for(size_t i = 0; i < arms.size(); ++i){
+		func->getBasicBlockList().push_back(arms[i]);
+		builder->SetInsertPoint(arms[i]);
+		Visit(*node.cases[i]->body);
+		if(!builder->GetInsertBlock()->getTerminator())
+			builder->CreateBr(endBB);
+	}
+
+	func->getBasicBlockList().push_back(endBB);
+	builder->SetInsertPoint(endBB);
+	return endBB;
+}
+llvm::Value *CodegenVisitor::VisitReturn(ReturnNode &node) {
+	llvm::Value *ret = nullptr;
+	if(node.expr->type == NodeType::ERR){ ret = builder->CreateRetVoid(); }
+	else {
+		auto val = Visit(*node.expr);
+		if(!val) return nullptr;
+
+		//Returning a call runs it in the caller's frame, the stack stays flat however deep it recurses.
+		//A call const evaluation folded is already just its value
+		auto call = llvm::dyn_cast<llvm::CallInst>(val);
+		if(call && node.expr->type == NodeType::FUNCTIONCALL && CanTailCall(*call)){
+			call->setTailCallKind(llvm::CallInst::TCK_MustTail);
+			return call->getType()->isVoidTy() ? builder->CreateRetVoid() : builder->CreateRet(call);
+		}
+		if(call && node.isTailCall){
+			auto &callee = static_cast<FuncCallNode&>(*node.expr).funcName;
+			CodegenError(callee, "Can't guarantee the tail call to '", callee.Name(), "' in ", builder->GetInsertBlock()->getParent()->getName().str());
+		}
+		ret = builder->CreateRet(CastTo(val, builder->getCurrentFunctionReturnType()));
+	}
+
+	return ret;
+}
+
+llvm::Value *CodegenVisitor::VisitFuncCall(FuncCallNode &node) {
+	auto decl = functions.find(node.funcName.symbol);
+	if(decl == functions.end() && FindVectorBuiltin(node.funcName) != VectorBuiltin::NONE)
+		return VisitVectorBuiltin(node, FindVectorBuiltin(node.funcName));
+	if(decl == functions.end()){
+		CodegenError(node.funcName, "Call to unknown function '", node.funcName.Name(), "'");
+		return nullptr;
+	}
+	if(evaluator){
+		if(auto result = evaluator->Evaluate(node)){
+			{
+				std::lock_guard lock(foldedLock);
+				foldedFunctions.insert(decl->second);
+			}
+			auto type = decl->second->funcType->Codegen();
+			if(result->isFloat) return llvm::ConstantFP::get(type, result->floatVal);
+			return llvm::ConstantInt::get(type, result->intVal, true);
+		}
+	}
+	auto func = DeclareFunction(*decl->second);
+
+	std::vector<llvm::Value*> args;
+	for(size_t i = 0; i < node.params.size() && i < decl->second->params.size() && args.size() < func->arg_size(); ++i){
+		//A soa array goes as its member arrays, the parser made sure it is passed by name
+		auto &param = *decl->second->params[i];
+		if(param.varType->isSoa){
+			auto &array = static_cast<ValNode&>(*node.params[i]).val;
+			for(auto &member: param.varType->members)
+				args.push_back(ArrayPointer(SoaMember(array, member)));
+			continue;
+		}
+
+		auto val = Visit(*node.params[i]);
+		if(!val) return nullptr;
+		args.push_back(CastTo(val, func->getArg(args.size())->getType()));
+	}
+
+	auto call = builder->CreateCall(func, args, func->getReturnType()->isVoidTy() ? "" : "calltmp");
+	call->setCallingConv(func->getCallingConv());
+	return call;
+}
+
+llvm::Value *CodegenVisitor::VisitVectorBuiltin(FuncCallNode &node, VectorBuiltin builtin) {
+	std::vector<llvm::Value*> args;
+	for(auto &param: node.params){
+		auto val = Visit(*param);
+		if(!val) return nullptr;
+		args.push_back(val);
+	}
+
+	if(builtin == VectorBuiltin::CONSTRUCT){
+		auto type = llvm::cast<llvm::FixedVectorType>(VarType::Vector(node.funcName.Name()).Codegen());
+		if(args.size() == 1) return CastTo(args[0], type);
+
+		llvm::Value *vector = llvm::PoisonValue::get(type);
+		for(size_t i = 0; i < args.size(); ++i)
+			vector = builder->CreateInsertElement(vector, CastTo(args[i], type->getElementType()), (std::uint64_t)i, "lane");
+		return vector;
+	}
+	if(builtin == VectorBuiltin::SHUFFLE){
+		//The parser only lets constant lanes through
+		bool twoSources = args.size() > 1 && args[1]->getType()->isVectorTy();
+		std::vector<int> mask;
+		for(size_t i = twoSources ? 2 : 1; i < node.params.size(); ++i)
+			mask.push_back(static_cast<ValNode&>(*node.params[i]).val.intVal);
+		return builder->CreateShuffleVector(args[0], twoSources ? args[1] : llvm::PoisonValue::get(args[0]->getType()), mask, "shuffle");
+	}
+
+	//Floating point sums and products may be reassociated into a tree, like any vector
+	//reduction, instead of adding the lanes in order
+	auto vector = args[0];
+	auto elem = vector->getType()->getScalarType();
+	bool isFloat = elem->isFloatingPointTy();
+	llvm::CallInst *reduce = nullptr;
+	switch(builtin){
+		case VectorBuiltin::REDUCE_ADD:
+			reduce = isFloat ? builder->CreateFAddReduce(llvm::ConstantFP::get(elem, -0.0), vector) : builder->CreateAddReduce(vector);
+			break;
+		case VectorBuiltin::REDUCE_MUL:
+			reduce = isFloat ? builder->CreateFMulReduce(llvm::ConstantFP::get(elem, 1.0), vector) : builder->CreateMulReduce(vector);
+			break;
+		case VectorBuiltin::REDUCE_MIN:
+			reduce = isFloat ? builder->CreateFPMinReduce(vector) : builder->CreateIntMinReduce(vector, true);
+			break;
+		case VectorBuiltin::REDUCE_MAX:
+			reduce = isFloat ? builder->CreateFPMaxReduce(vector) : builder->CreateIntMaxReduce(vector, true);
+			break;
+		default:
+			return nullptr;
+	}
+	if(isFloat) reduce->setHasAllowReassoc(true);
+	return reduce;
+}
+llvm::Value *CodegenVisitor::VisitIndex(IndexNode &node) {
+	auto &array = FindCodegenIdent(node.array);
+	if(array.type.IsVector()){
+		auto address = VariableAddress(node.array);
+		auto index = Visit(*node.index);
+		if(!address || !index) return nullptr;
+
+		index = LaneIndex(array.type, index);
+		return builder->CreateExtractElement(builder->CreateLoad(array.type.Codegen(), address, node.array.Name()), index, node.array.Name() + ".lane");
+	}
+	auto address = ElementAddress(node.array, Visit(*node.index));
+	if(!address){
+		CodegenError(node.array, "Invalid array '", node.array.Name(), "' referenced");
+		return nullptr;
+	}
+	return builder->CreateLoad(array.type.Codegen(), address, node.array.Name());
+}
+
+//Lowers the top level functions on worker threads, each into a private context and module.
+//Workers hand their module back as bitcode, which is linked into the main module in source order.
+static void CodegenParallel(BlockNode &root, unsigned threads, const std::string &moduleName){
+	std::vector<FuncDeclNode*> funcs;
+
+	codegenScope = root.myScope;
+	for(auto &stmt: root.stmts){
+		if(stmt->type == NodeType::FUNCDECL){
+			auto func = static_cast<FuncDeclNode*>(stmt.get());
+			if(func->isReachable) funcs.push_back(func);
+			continue;
+		}
+		CodegenVisitor().Visit(*stmt);
+	}
+	codegenScope = nullptr;
+
+	threads = std::min<size_t>(threads, funcs.size());
+	if(!threads) return;
+
+	size_t chunk = (funcs.size() + threads - 1) / threads;
+	std::vector<llvm::SmallVector<char, 0>> bitcode(threads);
+	std::vector<std::thread> workers;
+	for(unsigned i = 0; i < threads; ++i){
+		workers.emplace_back([&, i](){
+			context = std::make_unique<llvm::LLVMContext>();
+			module = std::make_unique<llvm::Module>(moduleName, *context);
+			builder = std::make_unique<llvm::IRBuilder<>>(*context);
+			if(codegenTarget) codegenTarget->Apply(*module);
+			if(!pureFunctions.empty()) evaluator = std::make_unique<ConstEvaluator>(functions, pureFunctions);
+			codegenScope = root.myScope;
+
+			for(size_t f = i * chunk; f < std::min(funcs.size(), (i + 1) * chunk); ++f)
+				CodegenVisitor().Visit(*funcs[f]);
+
+			llvm::raw_svector_ostream out(bitcode[i]);
+			llvm::WriteBitcodeToFile(*module, out);
+
+			codegenScope = nullptr;
+			evaluator.reset();
+			builder.reset();
+			module.reset();
+			context.reset();
+		});
+	}
+	for(auto &worker: workers)
+		worker.join();
+
+	for(auto &buffer: bitcode){
+		auto parsed = llvm::parseBitcodeFile(llvm::MemoryBufferRef(llvm::StringRef(buffer.data(), buffer.size()), moduleName), *context);
+		if(!parsed){
+			std::cerr << "Failed to read worker module: " << llvm::toString(parsed.takeError()) << "\n";
+			continue;
+		}
+		if(llvm::Linker::linkModules(*module, std::move(*parsed)))
+			std::cerr << "Failed to link worker module\n";
+	}
+}
+void Parser::Lower(){
+	//Diagnostics from here on locate tokens anywhere in the tree
+	SettleOffsets();
+	if(lazyCodegen){
+		CallGraph graph(*rootNode);
+		size_t skipped = graph.MarkUnreachable();
+		if(skipped && verbose)
+			std::cerr << "[INFO] Skipped codegen for " << skipped << " unreferenced function" << (skipped == 1 ? "" : "s") << "\n";
+	}
+
+	MemReport::BeginPhase("codegen");
+	loweredParser = this;
+	context = std::make_unique<llvm::LLVMContext>();
+	module = std::make_unique<llvm::Module>(fileName, *context);
+	builder = std::make_unique<llvm::IRBuilder<>>(*context);
+	codegenTarget = target;
+	emitBoundsChecks = boundsChecks;
+	if(target) target->Apply(*module);
+
+	functions.clear();
+	hasEntryPoints = false;
+	profileGenerate = !profileGeneratePath.empty();
+	profileUse = profile;
+	profileFile = fileName;
+	for(auto &stmt: rootNode->stmts){
+		if(stmt->type != NodeType::FUNCDECL) continue;
+
+		//A definition wins over any prototype of the same function
+		auto func = static_cast<FuncDeclNode*>(stmt.get());
+		auto [found, added] = functions.emplace(func->ident.symbol, func);
+		if(!added && found->second->IsPrototype()) found->second = func;
+		hasEntryPoints |= func->isExported || func->ident.Name() == "main";
+	}
+	SettleConventions();
+
+	foldedFunctions.clear();
+	pureFunctions.clear();
+	if(constEval) pureFunctions = ConstEvaluator::FindPure(functions);
+	if(!pureFunctions.empty()) evaluator = std::make_unique<ConstEvaluator>(functions, pureFunctions);
+
+	if(codegenThreads > 1)
+		CodegenParallel(*rootNode, codegenThreads, fileName);
+	else
+		CodegenVisitor().Visit(*rootNode);
+
+	for(auto &[symbol, decl]: functions){
+		auto func = module->getFunction(decl->ident.Name());
+		if(func && !func->isDeclaration() && IsInternal(*decl))
+			func->setLinkage(llvm::GlobalValue::InternalLinkage);
+	}
+	evaluator.reset();
+
+	//Internal functions whose every call was evaluated have nothing left to do
+	for(auto decl: foldedFunctions){
+		auto func = module->getFunction(decl->ident.Name());
+		if(func && func->hasLocalLinkage() && func->use_empty())
+			func->eraseFromParent();
+	}
+
+	if(profileGenerate){
+		std::vector<ProfileRuntime::Function> counted;
+		for(auto &stmt: rootNode->stmts){
+			if(stmt->type != NodeType::FUNCDECL) continue;
+
+			auto &func = static_cast<FuncDeclNode&>(*stmt);
+			if(auto counters = module->getNamedGlobal(CounterName(func)))
+				counted.push_back({Profile::Key(fileName, func.ident.Name()), ProfileSites(func).hash, counters});
+		}
+		ProfileRuntime::Emit(*module, counted, profileGeneratePath);
+	}
+	if(target){
+		for(auto &func: *module){
+			if(!func.isDeclaration()) target->Apply(func);
+		}
+	}
+	//Lets LLVM's own passes tell hot from cold when the module is optimized further
+	if(profileUse)
+		module->setProfileSummary(profileUse->Summary(*context), llvm::ProfileSummary::PSK_Instr);
+}
+void Parser::Codegen(){
+	Lower();
+
+	if(inlining){
+		MemReport::BeginPhase("inline");
+		Inliner(*module).Run();
+	}
+
+	MemReport::BeginPhase("emit");
+	module->print(llvm::errs(), nullptr);
+
+	//The module has to go before the context it lives in, the next file makes new ones
+	builder.reset();
+	module.reset();
+	context.reset();
+	MemReport::EndPhase();
+}
+
+//Prints functions one at a time into one output. The printer numbers attribute groups per print,
+//so every set seen so far gets a placeholder in a module that is never printed, in the order the
+//printer would number them, and a set keeps its number for the whole output
+class StreamPrinter{
+	private:
+	llvm::Module numbering;
+	std::vector<llvm::AttributeSet> groups;
+
+	void Number(llvm::AttributeSet attrs){
+		if(!attrs.hasAttributes() || std::find(groups.begin(), groups.end(), attrs) != groups.end()) return;
+
+		auto &context = numbering.getContext();
+		auto placeholder = llvm::Function::Create(llvm::FunctionType::get(llvm::Type::getVoidTy(context), false), llvm::GlobalValue::ExternalLinkage, "", numbering);
+		placeholder->setAttributes(llvm::AttributeList::get(context, llvm::AttributeList::FunctionIndex, attrs));
+		groups.push_back(attrs);
+	}
+
+	public:
+	StreamPrinter(llvm::LLVMContext &context): numbering("", context) {}
+
+	void Print(const llvm::Function &func){
+		Number(func.getAttributes().getFnAttrs());
+		llvm::ModuleSlotTracker slots(&numbering);
+		llvm::errs() << "\n";
+		static_cast<const llvm::Value&>(func).print(llvm::errs(), slots);
+
+		//Call sites are numbered after the function, in the order they appear
+		for(auto &block: func){
+			for(auto &inst: block){
+				if(auto call = llvm::dyn_cast<llvm::CallBase>(&inst)) Number(call->getAttributes().getFnAttrs());
+			}
+		}
+	}
+	void PrintGroups(){
+		for(size_t i = 0; i < groups.size(); ++i)
+			llvm::errs() << "\nattributes #" << i << " = { " << groups[i].getAsString(true) << " }";
+		llvm::errs() << "\n";
+	}
+};
+bool Parser::CodegenStreaming(){
+	MemReport::BeginPhase("stream");
+	loweredParser = this;
+	context = std::make_unique<llvm::LLVMContext>();
+	module = std::make_unique<llvm::Module>(fileName, *context);
+	builder = std::make_unique<llvm::IRBuilder<>>(*context);
+	codegenTarget = target;
+	emitBoundsChecks = boundsChecks;
+	if(target) target->Apply(*module);
+
+	//Without the whole file nothing is known to be internal, every function keeps the C convention
+	functions.clear();
+	hasEntryPoints = false;
+	sharedConvention.clear();
+	pureFunctions.clear();
+	profileGenerate = false;
+	profileUse = nullptr;
+
+	//Each definition is cleaned up on its own before it's printed, nothing looks across functions
+	auto passes = std::make_unique<llvm::legacy::FunctionPassManager>(module.get());
+	passes->add(llvm::createPromoteMemoryToRegisterPass());
+	passes->add(llvm::createInstructionCombiningPass());
+	passes->add(llvm::createCFGSimplificationPass());
+	passes->doInitialization();
+	auto printer = std::make_unique<StreamPrinter>(*context);
+
+	//The header goes first, what is left of the module is printed after the last function
+	module->print(llvm::errs(), nullptr);
+	std::vector<llvm::Function*> printed;
+
+	auto &globals = *currScope;
+	codegenScope = currScope;
+	try{
+		while(currTok.type != Token::Type::TEOF){
+			//Whatever came before is lowered and reported on, its line starts aren't needed again
+			tokenizer.Release(currTok.offset);
+			size_t scopeCount = globals.scopes.size();
+			auto node = ParseStmtOrRecover(true);
+			if(node->type == NodeType::ERR) continue;
+			if(node->type != NodeType::FUNCDECL){
+				rootNode->AddStmt(node);
+				if(!diag.HasErrors()) CodegenVisitor().Visit(*node);
+				continue;
+			}
+
+			auto &decl = static_cast<FuncDeclNode&>(*node);
+			auto [found, added] = functions.emplace(decl.ident.symbol, &decl);
+			if(!added && found->second->IsPrototype()) found->second = &decl;
+			rootNode->AddStmt(node);
+			if(decl.IsPrototype() || diag.HasErrors()) continue;
+
+			auto func = llvm::cast<llvm::Function>(CodegenVisitor().Visit(decl));
+			if(target) target->Apply(*func);
+			passes->run(*func);
+			//Metadata is printed with the module, the definition would refer to nodes that never are
+			for(auto &block: *func){
+				for(auto &inst: block)
+					inst.dropUnknownNonDebugMetadata();
+			}
+			printer->Print(*func);
+			func->deleteBody();
+			printed.push_back(func);
+
+			//Only the parameters of the body's scope are looked at again, by calls to the function
+			decl.block = std::make_shared<Node>();
+			if(globals.scopes.size() > scopeCount){
+				auto &scope = *globals.scopes.back();
+				scope.identifiers.resize(std::min(scope.identifiers.size(), paramIdents));
+				scope.identifiers.shrink_to_fit();
+				for(auto &param: scope.identifiers)
+					param.val = nullptr;
+				scope.types.clear();
+				scope.scopes.clear();
+			}
+		}
+	}
+	catch(const Diagnostics::LimitReached&){}
+	codegenScope = nullptr;
+	CheckInputSize();
+
+	passes->doFinalization();
+	passes.reset();
+
+	//Declarations of what was printed would clash with the definitions. The other declarations go
+	//through the printer as well, only globals are left for the module to print
+	for(auto func: printed)
+		func->eraseFromParent();
+	std::vector<llvm::Function*> declared;
+	for(auto &func: *module){
+		printer->Print(func);
+		declared.push_back(&func);
+	}
+	for(auto func: declared)
+		func->removeFromParent();
+
+	module->setModuleIdentifier("");
+	module->setSourceFileName("");
+	module->setDataLayout("");
+	module->setTargetTriple("");
+	module->print(llvm::errs(), nullptr);
+	printer->PrintGroups();
+
+	for(auto func: declared)
+		module->getFunctionList().push_back(func);
+	printer.reset();
+
+	builder.reset();
+	module.reset();
+	context.reset();
+	MemReport::EndPhase();
+	return !diag.HasErrors();
+}
+std::string Parser::CodegenBitcode(){
+	Lower();
+
+	MemReport::BeginPhase("emit");
+	std::string bitcode;
+	llvm::raw_string_ostream out(bitcode);
+	llvm::WriteBitcodeToFile(*module, out);
+	out.flush();
+
+	builder.reset();
+	module.reset();
+	context.reset();
+	MemReport::EndPhase();
+	return bitcode;
+}
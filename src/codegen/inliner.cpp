@@ -0,0 +1,78 @@
+#include "inliner.hpp"
+#include <vector>
+#include <algorithm>
+#include <unordered_set>
+
+#include <llvm/ADT/SCCIterator.h>
+#include <llvm/IR/Instructions.h>
+#include <llvm/Analysis/CallGraph.h>
+#include <llvm/Transforms/Utils/Cloning.h>
+
+bool Inliner::ShouldInline(const llvm::Function &caller, size_t callerSize, const llvm::CallBase &call) const{
+	auto callee = call.getCalledFunction();
+	if(!callee || callee == &caller || callee->isDeclaration() || callee->isVarArg()) return false;
+
+	size_t calleeSize = callee->getInstructionCount();
+	size_t threshold = callee->hasFnAttribute(llvm::Attribute::InlineHint) ? HINT_THRESHOLD : THRESHOLD;
+	if(auto count = callee->getEntryCount(); count && hotCount){
+		if(!count->getCount()) return false;
+		if(count->getCount() >= hotCount) threshold = HINT_THRESHOLD;
+	}
+	return calleeSize <= threshold && callerSize + calleeSize <= CALLER_LIMIT;
+}
+
+size_t Inliner::Run(){
+	size_t inlined = 0;
+	std::unordered_set<llvm::Function*> callees;
+
+	//Callees come before their callers, the graph is taken up front since inlining changes it
+	std::vector<llvm::Function*> order;
+	{
+		llvm::CallGraph graph(module);
+		for(auto scc = llvm::scc_begin(&graph); !scc.isAtEnd(); ++scc){
+			for(auto node: *scc){
+				if(auto func = node->getFunction(); func && !func->isDeclaration())
+					order.push_back(func);
+			}
+		}
+	}
+
+	//Hot is anything entered at least a hundredth as often as the busiest function
+	hotCount = 0;
+	for(auto func: order){
+		if(auto count = func->getEntryCount())
+			hotCount = std::max<std::uint64_t>(hotCount, count->getCount() / 100 + 1);
+	}
+
+	for(auto func: order){
+		std::vector<llvm::CallBase*> calls;
+		for(auto &block: *func){
+			for(auto &inst: block){
+				if(auto call = llvm::dyn_cast<llvm::CallBase>(&inst))
+					calls.push_back(call);
+			}
+		}
+
+		size_t size = func->getInstructionCount();
+		for(auto call: calls){
+			if(!ShouldInline(*func, size, *call)) continue;
+
+			auto callee = call->getCalledFunction();
+			size_t calleeSize = callee->getInstructionCount();
+			llvm::InlineFunctionInfo info;
+			//Nothing downstream uses lifetime markers, they would only bloat the caller
+			if(!llvm::InlineFunction(*call, info, nullptr, false).isSuccess()) continue;
+
+			size += calleeSize;
+			callees.insert(callee);
+			inlined++;
+		}
+	}
+
+	for(auto callee: callees){
+		if(callee->hasLocalLinkage() && callee->use_empty())
+			callee->eraseFromParent();
+	}
+
+	return inlined;
+}
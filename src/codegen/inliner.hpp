@@ -0,0 +1,28 @@
+#pragma once
+
+#include <llvm/IR/Module.h>
+#include <llvm/IR/InstrTypes.h>
+
+//Cost based inliner over a finished module. A callee is inlined when its instruction count is
+//under the threshold, functions declared inline get a much larger one. Functions are visited
+//bottom-up over the call graph, so a callee's size already includes whatever was inlined into it.
+//With profile entry counts, callees that never ran stay out of line and hot ones get the larger threshold.
+class Inliner{
+	private:
+	llvm::Module &module;
+	//Entry count from which a profiled callee counts as hot, 0 without a profile
+	std::uint64_t hotCount = 0;
+
+	bool ShouldInline(const llvm::Function &caller, size_t callerSize, const llvm::CallBase &call) const;
+
+	public:
+	static constexpr size_t THRESHOLD = 40;
+	static constexpr size_t HINT_THRESHOLD = 400;
+	//A caller stops taking in more code once it grows this big
+	static constexpr size_t CALLER_LIMIT = 4000;
+
+	explicit Inliner(llvm::Module &module_): module(module_) {}
+
+	//Returns how many calls were inlined, internal functions left without callers are removed
+	size_t Run();
+};
@@ -0,0 +1,100 @@
+#include "lto.hpp"
+#include <iostream>
+
+#include <llvm/IR/Verifier.h>
+#include <llvm/IR/InstrTypes.h>
+#include <llvm/IR/Instructions.h>
+#include <llvm/Pass.h>
+#include <llvm/IR/LegacyPassManager.h>
+#include <llvm/Linker/Linker.h>
+#include <llvm/Transforms/IPO.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Bitcode/BitcodeReader.h>
+
+#include "codegen/inliner.hpp"
+#include "util/memreport.hpp"
+
+LinkTimeOptimizer::LinkTimeOptimizer(const std::string &name): module(std::make_unique<llvm::Module>(name, context)) {}
+
+bool LinkTimeOptimizer::Add(const std::string &bitcode, const std::string &fileName){
+	MemReport::BeginPhase("link");
+
+	auto parsed = llvm::parseBitcodeFile(llvm::MemoryBufferRef(llvm::StringRef(bitcode.data(), bitcode.size()), fileName), context);
+	if(!parsed){
+		std::cerr << "Failed to read module of " << fileName << ": " << llvm::toString(parsed.takeError()) << "\n";
+		return false;
+	}
+	if(llvm::Linker::linkModules(*module, std::move(*parsed))){
+		std::cerr << "Failed to link " << fileName << "\n";
+		return false;
+	}
+
+	MemReport::EndPhase();
+	return true;
+}
+
+//Caller and callee of a musttail call have to stay on the same calling convention
+static bool IsMustTail(const llvm::User *user){
+	auto call = llvm::dyn_cast<llvm::CallInst>(user);
+	return call && call->isMustTailCall();
+}
+static bool MakesMustTailCall(const llvm::Function &func){
+	for(auto &block: func){
+		for(auto &inst: block){
+			if(IsMustTail(&inst)) return true;
+		}
+	}
+	return false;
+}
+
+size_t LinkTimeOptimizer::Internalize(){
+	auto main = module->getFunction("main");
+	if(!main || main->isDeclaration()) return 0;
+
+	size_t internalized = 0;
+	for(auto &global: module->global_values()){
+		//Appending globals are LLVM's constructor and destructor lists, they have to keep their linkage
+		if(&global == main || global.isDeclaration() || global.hasLocalLinkage() || global.hasAppendingLinkage()) continue;
+
+		global.setLinkage(llvm::GlobalValue::InternalLinkage);
+		internalized++;
+	}
+
+	for(auto &func: *module){
+		if(!func.hasLocalLinkage() || func.isDeclaration() || func.getCallingConv() == llvm::CallingConv::Fast || MakesMustTailCall(func)) continue;
+
+		//Every caller is in this module now, so the calling convention can change along with them
+		bool onlyCalled = true;
+		for(auto user: func.users()){
+			auto call = llvm::dyn_cast<llvm::CallBase>(user);
+			onlyCalled &= call && call->getCalledOperand() == &func && !IsMustTail(call);
+		}
+		if(!onlyCalled) continue;
+
+		func.setCallingConv(llvm::CallingConv::Fast);
+		for(auto user: func.users())
+			llvm::cast<llvm::CallBase>(user)->setCallingConv(llvm::CallingConv::Fast);
+	}
+
+	return internalized;
+}
+
+void LinkTimeOptimizer::Emit(bool inlining){
+	MemReport::BeginPhase("lto");
+	Internalize();
+	if(inlining)
+		Inliner(*module).Run();
+
+	llvm::legacy::PassManager passes;
+	passes.add(llvm::createGlobalDCEPass());
+	passes.run(*module);
+
+	std::string error;
+	llvm::raw_string_ostream out(error);
+	if(llvm::verifyModule(*module, &out))
+		std::cerr << "Error in linked IR: " << out.str() << "\n";
+
+	MemReport::BeginPhase("emit");
+	module->print(llvm::errs(), nullptr);
+	MemReport::EndPhase();
+}
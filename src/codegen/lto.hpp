@@ -0,0 +1,26 @@
+#pragma once
+
+#include <string>
+#include <memory>
+
+#include <llvm/IR/Module.h>
+#include <llvm/IR/LLVMContext.h>
+
+//Whole program optimization for -flto. Every file is lowered to bitcode on its own, the modules
+//are linked into one here and only then internalized, inlined and stripped of dead code.
+class LinkTimeOptimizer{
+	private:
+	llvm::LLVMContext context;
+	std::unique_ptr<llvm::Module> module;
+
+	//With main in the program nothing else has to stay visible, every other definition becomes
+	//internal and functions switch to fastcc. Returns how many were internalized
+	size_t Internalize();
+
+	public:
+	explicit LinkTimeOptimizer(const std::string &name);
+
+	//Links in one file's bitcode, returns false if it can't be read or clashes with what is there
+	bool Add(const std::string &bitcode, const std::string &fileName);
+	void Emit(bool inlining);
+};
@@ -0,0 +1,176 @@
+#include "profile.hpp"
+#include <fstream>
+#include <sstream>
+
+#include <llvm/IR/IRBuilder.h>
+#include <llvm/ProfileData/InstrProf.h>
+#include <llvm/ProfileData/ProfileCommon.h>
+#include <llvm/Transforms/Utils/ModuleUtils.h>
+
+#include "parser/visitor.hpp"
+
+//Counts the sites in the order codegen numbers them, the hash is over the kind of each one
+class SiteCounter: public ConstAstVisitor<SiteCounter>{
+	private:
+	ProfileSites &sites;
+
+	void Add(std::uint64_t kind){
+		sites.counters += 2;
+		sites.hash = (sites.hash ^ kind) * 0x100000001b3ull;
+	}
+
+	public:
+	explicit SiteCounter(ProfileSites &sites_): sites(sites_) {}
+
+	void VisitNode(const Node &node) { VisitChildren(node); }
+	void VisitIf(const IfNode &node){
+		Add(1);
+		VisitChildren(node);
+	}
+	void VisitWhile(const WhileNode &node){
+		Add(2);
+		VisitChildren(node);
+	}
+};
+
+ProfileSites::ProfileSites(const FuncDeclNode &func): hash(0xcbf29ce484222325ull){
+	SiteCounter counter(*this);
+	if(func.block) counter.Visit(*func.block);
+	hash = (hash ^ counters) * 0x100000001b3ull;
+}
+
+//One line per function and module instance: hash, counter count, the counters, then the key
+bool Profile::Load(const std::string &path){
+	std::ifstream in(path);
+	if(!in) return false;
+
+	std::string line;
+	while(std::getline(in, line)){
+		std::istringstream fields(line);
+		std::uint64_t hash = 0;
+		size_t count = 0;
+		if(!(fields >> hash >> count) || !count) return false;
+
+		std::vector<std::uint64_t> counts(count);
+		for(auto &counter: counts){
+			if(!(fields >> counter)) return false;
+		}
+		std::string key;
+		fields.get();
+		if(!std::getline(fields, key) || key.empty()) return false;
+
+		auto [found, added] = functions.try_emplace(key, Function{hash, counts});
+		if(added) continue;
+		//Stale records of the same function are dropped in favour of the last one
+		if(found->second.hash != hash || found->second.counts.size() != count){
+			found->second = Function{hash, counts};
+			continue;
+		}
+		for(size_t i = 0; i < count; ++i)
+			found->second.counts[i] += counts[i];
+	}
+	return true;
+}
+const std::vector<std::uint64_t> *Profile::Counts(const std::string &key, const ProfileSites &sites) const{
+	auto found = functions.find(key);
+	if(found == functions.end() || found->second.hash != sites.hash || found->second.counts.size() != sites.counters)
+		return nullptr;
+	return &found->second.counts;
+}
+
+llvm::Metadata *Profile::Summary(llvm::LLVMContext &context) const{
+	llvm::InstrProfSummaryBuilder summary(llvm::ProfileSummaryBuilder::DefaultCutoffs);
+	//The first counter of a record is taken as the entry count, same as in our layout
+	for(auto &[key, func]: functions)
+		summary.addRecord(llvm::InstrProfRecord(func.counts));
+	return summary.getSummary()->getMD(context);
+}
+
+void ProfileRuntime::Emit(llvm::Module &module, const std::vector<Function> &functions, const std::string &path){
+	if(functions.empty()) return;
+
+	auto &context = module.getContext();
+	llvm::IRBuilder<> builder(context);
+	auto i64 = builder.getInt64Ty();
+	auto i8Ptr = builder.getInt8PtrTy();
+	auto i64Ptr = llvm::Type::getInt64PtrTy(context);
+
+	//{ key, hash, counter count, counters }
+	auto recordType = llvm::StructType::get(context, {i8Ptr, i64, i64, i64Ptr});
+	std::vector<llvm::Constant*> records;
+	for(auto &func: functions){
+		auto key = llvm::ConstantDataArray::getString(context, func.key);
+		auto keyGlobal = new llvm::GlobalVariable(module, key->getType(), true, llvm::GlobalValue::PrivateLinkage, key, "__prof_key");
+		auto counters = func.counters;
+		auto zero = builder.getInt64(0);
+		records.push_back(llvm::ConstantStruct::get(recordType, {
+			llvm::ConstantExpr::getInBoundsGetElementPtr(key->getType(), keyGlobal, llvm::ArrayRef<llvm::Constant*>{zero, zero}),
+			builder.getInt64(func.hash),
+			builder.getInt64(counters->getValueType()->getArrayNumElements()),
+			llvm::ConstantExpr::getInBoundsGetElementPtr(counters->getValueType(), counters, llvm::ArrayRef<llvm::Constant*>{zero, zero})
+		}));
+	}
+	auto tableType = llvm::ArrayType::get(recordType, records.size());
+	auto table = new llvm::GlobalVariable(module, tableType, true, llvm::GlobalValue::PrivateLinkage, llvm::ConstantArray::get(tableType, records), "__prof_table");
+
+	auto fopen = module.getOrInsertFunction("fopen", i8Ptr, i8Ptr, i8Ptr);
+	auto fclose = module.getOrInsertFunction("fclose", builder.getInt32Ty(), i8Ptr);
+	auto fprintf = module.getOrInsertFunction("fprintf", llvm::FunctionType::get(builder.getInt32Ty(), {i8Ptr, i8Ptr}, true));
+
+	//Appends, so every run (and every module of the program) adds its own records
+	auto write = llvm::Function::Create(llvm::FunctionType::get(builder.getVoidTy(), false), llvm::GlobalValue::InternalLinkage, "__prof_write", module);
+	auto entry = llvm::BasicBlock::Create(context, "entry", write);
+	auto record = llvm::BasicBlock::Create(context, "record", write);
+	auto counterCond = llvm::BasicBlock::Create(context, "counter.cond", write);
+	auto counter = llvm::BasicBlock::Create(context, "counter", write);
+	auto next = llvm::BasicBlock::Create(context, "next", write);
+	auto close = llvm::BasicBlock::Create(context, "close", write);
+	auto done = llvm::BasicBlock::Create(context, "done", write);
+
+	builder.SetInsertPoint(entry);
+	auto file = builder.CreateCall(fopen, {builder.CreateGlobalStringPtr(path, "__prof_path"), builder.CreateGlobalStringPtr("a", "__prof_mode")}, "file");
+	auto recordFormat = builder.CreateGlobalStringPtr("%llu %llu", "__prof_record");
+	auto counterFormat = builder.CreateGlobalStringPtr(" %llu", "__prof_counter");
+	auto keyFormat = builder.CreateGlobalStringPtr(" %s\n", "__prof_end");
+	builder.CreateCondBr(builder.CreateIsNull(file), done, record);
+
+	builder.SetInsertPoint(record);
+	auto index = builder.CreatePHI(i64, 2, "i");
+	index->addIncoming(builder.getInt64(0), entry);
+	auto field = [&](unsigned i, llvm::Type *type, const char *name){
+		return builder.CreateLoad(type, builder.CreateInBoundsGEP(tableType, table, {builder.getInt64(0), index, builder.getInt32(i)}), name);
+	};
+	auto key = field(0, i8Ptr, "key");
+	auto hash = field(1, i64, "hash");
+	auto count = field(2, i64, "count");
+	auto counters = field(3, i64Ptr, "counters");
+	builder.CreateCall(fprintf, {file, recordFormat, hash, count});
+	builder.CreateBr(counterCond);
+
+	builder.SetInsertPoint(counterCond);
+	auto c = builder.CreatePHI(i64, 2, "c");
+	c->addIncoming(builder.getInt64(0), record);
+	builder.CreateCondBr(builder.CreateICmpULT(c, count), counter, next);
+
+	builder.SetInsertPoint(counter);
+	auto value = builder.CreateLoad(i64, builder.CreateInBoundsGEP(i64, counters, c), "value");
+	builder.CreateCall(fprintf, {file, counterFormat, value});
+	c->addIncoming(builder.CreateAdd(c, builder.getInt64(1)), counter);
+	builder.CreateBr(counterCond);
+
+	builder.SetInsertPoint(next);
+	builder.CreateCall(fprintf, {file, keyFormat, key});
+	auto nextIndex = builder.CreateAdd(index, builder.getInt64(1));
+	index->addIncoming(nextIndex, next);
+	builder.CreateCondBr(builder.CreateICmpULT(nextIndex, builder.getInt64(records.size())), record, close);
+
+	builder.SetInsertPoint(close);
+	builder.CreateCall(fclose, {file});
+	builder.CreateBr(done);
+
+	builder.SetInsertPoint(done);
+	builder.CreateRetVoid();
+
+	//A destructor rather than atexit, JITs run those before tearing the module down
+	llvm::appendToGlobalDtors(module, write, 0);
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <unordered_map>
+
+#include <llvm/IR/Module.h>
+#include <llvm/IR/GlobalVariable.h>
+
+#include "parser/parser.hpp"
+
+//Counter layout shared by -fprofile-generate and -fprofile-use. Counter 0 counts entries to a
+//function, every if and while then gets two in the order codegen reaches them: then/else edges
+//for an if, body/exit edges for a loop. The hash catches a profile taken from different code.
+struct ProfileSites{
+	size_t counters = 1;
+	std::uint64_t hash = 0;
+
+	explicit ProfileSites(const FuncDeclNode &func);
+};
+
+//Counts read back for -fprofile-use. Records of the same function are summed, so a profile
+//appended to by several runs (or several modules of one program) merges on load.
+class Profile{
+	private:
+	struct Function{
+		std::uint64_t hash;
+		std::vector<std::uint64_t> counts;
+	};
+	std::unordered_map<std::string, Function> functions;
+
+	public:
+	//Functions are keyed by file and name, internal ones can share a name across files
+	static std::string Key(const std::string &fileName, const std::string &funcName) { return fileName + ":" + funcName; }
+
+	bool Load(const std::string &path);
+	//Null if the function has no counts, or was instrumented from different code
+	const std::vector<std::uint64_t> *Counts(const std::string &key, const ProfileSites &sites) const;
+	//Summary of all counts, what LLVM's passes use to decide what is hot
+	llvm::Metadata *Summary(llvm::LLVMContext &context) const;
+};
+
+//Writer for -fprofile-generate, emitted into the module itself so nothing has to be linked in.
+//It appends one line per function to the profile when the program exits.
+class ProfileRuntime{
+	public:
+	struct Function{
+		std::string key;
+		std::uint64_t hash;
+		llvm::GlobalVariable *counters;
+	};
+
+	static constexpr const char *DEFAULT_PATH = "default.profraw";
+
+	static void Emit(llvm::Module &module, const std::vector<Function> &functions, const std::string &path);
+};
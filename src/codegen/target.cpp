@@ -0,0 +1,64 @@
+#include "target.hpp"
+#include <memory>
+#include <vector>
+#include <algorithm>
+
+#include <llvm/ADT/StringMap.h>
+#include <llvm/MC/TargetRegistry.h>
+#include <llvm/MC/MCSubtargetInfo.h>
+#include <llvm/Support/Host.h>
+#include <llvm/Support/TargetSelect.h>
+#include <llvm/Target/TargetMachine.h>
+
+bool Target::Resolve(const std::string &arch, const std::string &tune, std::string &error){
+	//Only the host is targeted, the options pick the CPU within its architecture
+	llvm::InitializeNativeTarget();
+	triple = llvm::sys::getDefaultTargetTriple();
+	auto target = llvm::TargetRegistry::lookupTarget(triple, error);
+	if(!target) return false;
+
+	cpu = arch == "native" ? llvm::sys::getHostCPUName().str() : arch;
+	tuneCpu = tune == "native" ? llvm::sys::getHostCPUName().str() : tune;
+
+	//The host name alone can claim features the machine has turned off (AVX-512 on some
+	//virtual machines), so native asks the host what it really supports
+	features.clear();
+	llvm::StringMap<bool> hostFeatures;
+	if(arch == "native" && llvm::sys::getHostCPUFeatures(hostFeatures)){
+		std::vector<std::string> sorted;
+		for(auto &feature: hostFeatures)
+			sorted.push_back((feature.second ? "+" : "-") + feature.first().str());
+		std::sort(sorted.begin(), sorted.end());
+		for(auto &feature: sorted){
+			if(features.length()) features += ",";
+			features += feature;
+		}
+	}
+
+	//Names are checked against a generic machine, LLVM would warn about an unknown one on its own
+	std::unique_ptr<llvm::TargetMachine> machine(target->createTargetMachine(triple, "", "", llvm::TargetOptions(), llvm::None));
+	if(!machine){
+		error = "no target machine for " + triple;
+		return false;
+	}
+	auto subtarget = machine->getMCSubtargetInfo();
+	for(auto &name: {cpu, tuneCpu}){
+		if(name.length() && !subtarget->isCPUStringValid(name)){
+			error = "unknown CPU '" + name + "'";
+			return false;
+		}
+	}
+
+	dataLayout = machine->createDataLayout().getStringRepresentation();
+	return true;
+}
+
+void Target::Apply(llvm::Module &module) const{
+	module.setTargetTriple(triple);
+	module.setDataLayout(dataLayout);
+}
+void Target::Apply(llvm::Function &func) const{
+	if(cpu.length()) func.addFnAttr("target-cpu", cpu);
+	if(tuneCpu.length()) func.addFnAttr("tune-cpu", tuneCpu);
+	if(features.length()) func.addFnAttr("target-features", features);
+}
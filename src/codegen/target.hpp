@@ -0,0 +1,22 @@
+#pragma once
+
+#include <string>
+
+#include <llvm/IR/Module.h>
+#include <llvm/IR/Function.h>
+
+//The machine code is generated for, set up by -march/-mtune. Modules get its triple and data
+//layout and every function its CPU and features, so the backend and vectorizers can use the
+//whole instruction set. Resolved once up front and only read afterwards, workers share it.
+class Target{
+	private:
+	std::string triple, cpu, tuneCpu, features, dataLayout;
+
+	public:
+	//"native" picks the host's CPU, for -march also the features it actually has. An empty
+	//CPU leaves that part generic. Returns false with error set for a CPU LLVM doesn't know
+	bool Resolve(const std::string &arch, const std::string &tune, std::string &error);
+
+	void Apply(llvm::Module &module) const;
+	void Apply(llvm::Function &func) const;
+};
@@ -2,9 +2,20 @@
 #include <fstream>
 #include <vector>
 #include <string>
+#include <chrono>
 #include <cstring>
+#include <filesystem>
 #include "tokenizer/tokenizer.hpp"
 #include "parser/parser.hpp"
+#include "parser/astdump.hpp"
+#include "util/memreport.hpp"
+#include "util/diagnostics.hpp"
+#include "serializer/astfile.hpp"
+#include "codegen/lto.hpp"
+#include "codegen/profile.hpp"
+#include "codegen/target.hpp"
+#include "vm/compiler.hpp"
+#include "vm/vm.hpp"
 
 enum class Flags: char{
 	OUTPUT_FILE = 1 << 0,
@@ -19,6 +30,28 @@ int main(int argc, char **argv){
 	std::vector<std::string> inFilePaths;
 	std::string outFilePath;
 	char flagActive = 0;
+	Diagnostics diag;
+	bool lazyCodegen = true;
+	bool verbose = false;
+	bool inlining = true;
+	bool boundsChecks = false;
+	bool constEval = true;
+	bool lto = false;
+	bool astCache = false;
+	bool dumpAst = false;
+	AstDumper::Format dumpFormat = AstDumper::Format::TEXT;
+	unsigned codegenThreads = 1;
+	unsigned parseThreads = 1;
+	bool pipelinedLexer = false;
+	std::string profileGeneratePath;
+	std::string profileUsePath;
+	std::string arch, tune;
+	bool runVm = false;
+	bool emitBytecode = false;
+	bool dumpBytecode = false;
+	bool vmStats = false;
+	bool syntaxOnly = false;
+	bool streamCodegen = false;
 
 	for(int i = 1; i < argc; ++i){
 		if(flagActive){
@@ -33,6 +66,108 @@ int main(int argc, char **argv){
 			flagActive |= (char)Flags::OUTPUT_FILE;
 			continue;
 		}
+		if(!std::strcmp(argv[i], "-v")){
+			verbose = true;
+			continue;
+		}
+		if(!std::strcmp(argv[i], "-fmem-report")){
+			MemReport::Enable();
+			continue;
+		}
+		if(!std::strcmp(argv[i], "-fdump-ast") || !std::strcmp(argv[i], "-fdump-ast=text")){
+			dumpAst = true;
+			dumpFormat = AstDumper::Format::TEXT;
+			continue;
+		}
+		if(!std::strcmp(argv[i], "-fdump-ast=json")){
+			dumpAst = true;
+			dumpFormat = AstDumper::Format::JSON;
+			continue;
+		}
+		if(!std::strcmp(argv[i], "-fsyntax-only")){
+			syntaxOnly = true;
+			continue;
+		}
+		if(!std::strcmp(argv[i], "-fvm")){
+			runVm = true;
+			continue;
+		}
+		if(!std::strcmp(argv[i], "-fvm-stats")){
+			vmStats = true;
+			continue;
+		}
+		if(!std::strcmp(argv[i], "-emit-bytecode")){
+			emitBytecode = true;
+			continue;
+		}
+		if(!std::strcmp(argv[i], "-fdump-bytecode")){
+			dumpBytecode = true;
+			continue;
+		}
+		if(!std::strcmp(argv[i], "-fast-cache")){
+			astCache = true;
+			continue;
+		}
+		if(!std::strcmp(argv[i], "-fpipelined-lexer")){
+			pipelinedLexer = true;
+			continue;
+		}
+		if(!std::strcmp(argv[i], "-flto")){
+			lto = true;
+			continue;
+		}
+		if(!std::strcmp(argv[i], "-fno-inline")){
+			inlining = false;
+			continue;
+		}
+		if(!std::strcmp(argv[i], "-fno-const-eval")){
+			constEval = false;
+			continue;
+		}
+		if(!std::strcmp(argv[i], "-fbounds-check")){
+			boundsChecks = true;
+			continue;
+		}
+		if(!std::strcmp(argv[i], "-fstream-codegen")){
+			streamCodegen = true;
+			continue;
+		}
+		if(!std::strcmp(argv[i], "-fno-lazy-codegen")){
+			lazyCodegen = false;
+			continue;
+		}
+		if(!std::strncmp(argv[i], "-fcodegen-threads=", 18)){
+			codegenThreads = std::strtoul(argv[i] + 18, nullptr, 10);
+			continue;
+		}
+		if(!std::strncmp(argv[i], "-fparse-threads=", 16)){
+			parseThreads = std::strtoul(argv[i] + 16, nullptr, 10);
+			continue;
+		}
+		if(!std::strcmp(argv[i], "-fprofile-generate")){
+			profileGeneratePath = ProfileRuntime::DEFAULT_PATH;
+			continue;
+		}
+		if(!std::strncmp(argv[i], "-fprofile-generate=", 19)){
+			profileGeneratePath = argv[i] + 19;
+			continue;
+		}
+		if(!std::strncmp(argv[i], "-fprofile-use=", 14)){
+			profileUsePath = argv[i] + 14;
+			continue;
+		}
+		if(!std::strncmp(argv[i], "-march=", 7)){
+			arch = argv[i] + 7;
+			continue;
+		}
+		if(!std::strncmp(argv[i], "-mtune=", 7)){
+			tune = argv[i] + 7;
+			continue;
+		}
+		if(!std::strncmp(argv[i], "-ferror-limit=", 14)){
+			diag.SetErrorLimit(std::strtoul(argv[i] + 14, nullptr, 10));
+			continue;
+		}
 
 		inFilePaths.push_back(argv[i]);
 	}
@@ -41,24 +176,179 @@ int main(int argc, char **argv){
 		return 1;
 	}
 	if(!outFilePath.length()){
-		outFilePath = "a.asm";
+		outFilePath = emitBytecode ? "a.cbc" : "a.asm";
 	}
 
-	std::ifstream inFile(inFilePaths[0]);
-	Tokenizer tokenizer;
+	//Streaming prints each function as soon as it is parsed, nothing can look at the whole file
+	if(streamCodegen && !syntaxOnly && (lto || astCache || dumpAst || runVm || emitBytecode || dumpBytecode || profileGeneratePath.length() || profileUsePath.length())){
+		std::cout << "-fstream-codegen can't be combined with -flto, -fast-cache, -fdump-ast, the bytecode backends or profiles";
+		return 1;
+	}
 
-	std::string line;
-	while(std::getline(inFile, line)){
-		tokenizer.AddLine(line);
+	//-fsyntax-only stops after parsing, nothing below it sets up or calls into LLVM
+	Profile profile;
+	if(!syntaxOnly && profileUsePath.length() && !profile.Load(profileUsePath)){
+		std::cout << "Could not read profile " << profileUsePath;
+		return 1;
 	}
-	inFile.close();
 
-	Parser parser(tokenizer, inFilePaths[0]);
-	parser.Parse();
-	
-	//std::ofstream output(outFilePath);
-	parser.GenerateCode();
-	//output.close();
+	Target target;
+	std::string targetError;
+	bool targeted = !syntaxOnly && (arch.length() || tune.length());
+	if(targeted && !target.Resolve(arch, tune, targetError)){
+		std::cout << "Invalid target: " << targetError;
+		return 1;
+	}
+
+	//Without -flto every file is compiled and printed as a module of its own
+	std::unique_ptr<LinkTimeOptimizer> linker;
+	if(lto && !syntaxOnly) linker = std::make_unique<LinkTimeOptimizer>(outFilePath);
+	bool linked = true;
+
+	//The bytecode backends lower every file into one program instead of going through LLVM,
+	//a program written with -emit-bytecode is loaded back as the only input
+	bool useVm = !syntaxOnly && (runVm || emitBytecode || dumpBytecode);
+	std::unique_ptr<BytecodeCompiler> bytecodeCompiler;
+	if(useVm) bytecodeCompiler = std::make_unique<BytecodeCompiler>(boundsChecks);
+	Bytecode::Program program;
+	bool bytecodeInput = false;
+	auto compileStart = std::chrono::steady_clock::now();
+
+	//An AST image is only reused by a build with the same parse settings and target
+	std::string cacheSettings = "parse-threads=" + std::to_string(parseThreads) + "\nmarch=" + arch + "\nmtune=" + tune + "\n";
+
+	for(auto &path: inFilePaths){
+		if(useVm && path != "-" && Bytecode::Program::IsBytecode(path)){
+			if(inFilePaths.size() != 1){
+				std::cout << "Bytecode " << path << " has to be the only input";
+				return 1;
+			}
+			if(!program.Read(path)){
+				std::cout << "Could not read bytecode " << path;
+				return 1;
+			}
+			bytecodeInput = true;
+			break;
+		}
+
+		//Names are only compared within one input and the last one's tree is gone by now
+		Symbols::Clear();
+
+		MemReport::BeginPhase("read");
+		Tokenizer tokenizer;
+
+		//stdin ("-") and pipes are lexed as they are read. Regular files are read up front, unless
+		//codegen streams too and nothing needs the whole buffer
+		bool fromStdin = path == "-";
+		std::string fileName = fromStdin ? "<stdin>" : path;
+		bool streamed = fromStdin || streamCodegen || !std::filesystem::is_regular_file(path);
+		std::ifstream inFile;
+		if(!fromStdin) inFile.open(path);
+		std::istream &in = fromStdin ? std::cin : inFile;
+
+		std::string line;
+		std::uint64_t sourceHash = AstFile::Hash("");
+		if(streamed){
+			tokenizer.SetStream(in);
+		}
+		else{
+			while(std::getline(in, line)){
+				sourceHash = AstFile::Hash(line + "\n", sourceHash);
+				tokenizer.AddLine(line);
+			}
+			inFile.close();
+		}
+
+		Parser parser(tokenizer, fileName, diag);
+		parser.SetLazyCodegen(lazyCodegen);
+		parser.SetVerbose(verbose);
+		parser.SetInlining(inlining);
+		parser.SetBoundsChecks(boundsChecks);
+		parser.SetConstEval(constEval);
+		parser.SetCodegenThreads(codegenThreads);
+		parser.SetParseThreads(parseThreads);
+		parser.SetPipelinedLexer(pipelinedLexer);
+		parser.SetProfileGenerate(profileGeneratePath);
+		if(profileUsePath.length()) parser.SetProfileUse(&profile);
+		if(targeted) parser.SetTarget(&target);
+		if(streamCodegen && !syntaxOnly){
+			parser.CodegenStreaming();
+			continue;
+		}
+
+		//With the cache on, an image whose key matches replaces lexing and parsing. The key covers
+		//the settings the tree was parsed under too, not just the source. Streamed input isn't
+		//hashed up front, so it never uses one
+		bool parsed = false;
+		bool useCache = astCache && !streamed;
+		std::string cachePath = path + ".astc";
+		std::uint64_t cacheKey = AstFile::Hash(cacheSettings, sourceHash);
+		if(useCache){
+			MemReport::BeginPhase("astload");
+			AstView cached;
+			parsed = cached.Open(cachePath) && cached.Key() == cacheKey && AstFile::Load(cached, parser);
+		}
+		if(!parsed){
+			parsed = parser.Parse();
+			if(parsed && useCache)
+				AstFile::Write(cachePath, *parser.GetRootBlock(), cacheKey);
+		}
+		if(parsed && dumpAst)
+			AstDumper(std::cout, dumpFormat, tokenizer).Dump(*parser.GetRoot());
+		if(syntaxOnly)
+			continue;
+		if(parsed && bytecodeCompiler)
+			linked &= bytecodeCompiler->Add(*parser.GetRootBlock());
+		else if(parsed && linker)
+			linked &= linker->Add(parser.CodegenBitcode(), fileName);
+		else if(parsed)
+			parser.Codegen();
+	}
+	if(linker && linked && !diag.HasErrors())
+		linker->Emit(inlining);
+
+	diag.Flush();
+
+	if(useVm && linked && !diag.HasErrors()){
+		std::string error;
+		if(!bytecodeInput) linked = bytecodeCompiler->Finish(program);
+		if(linked && !program.Verify(error)){
+			std::cout << "Invalid bytecode: " << error;
+			return 1;
+		}
+		auto compileEnd = std::chrono::steady_clock::now();
+
+		if(linked && dumpBytecode)
+			program.Disassemble(std::cout);
+		if(linked && emitBytecode && !program.Write(outFilePath)){
+			std::cout << "Could not write " << outFilePath;
+			return 1;
+		}
+		if(linked && runVm){
+			VM vm(program);
+			Bytecode::Slot result{};
+			auto runStart = std::chrono::steady_clock::now();
+			bool ran = vm.Run("main", result);
+			auto runEnd = std::chrono::steady_clock::now();
+
+			if(vmStats){
+				auto ms = [](auto duration){ return std::chrono::duration<double, std::milli>(duration).count(); };
+				std::cerr << "[VM] " << program.functions.size() << " functions, " << program.code.size() << " instructions, " <<
+					(bytecodeInput ? "loaded in " : "compiled in ") << ms(compileEnd - compileStart) << "ms, ran in " << ms(runEnd - runStart) << "ms\n";
+			}
+			if(!ran){
+				std::cout << "Runtime error: " << vm.Error();
+				return 1;
+			}
+			//main's value is the exit status, like running the compiled program
+			if(MemReport::Enabled())
+				MemReport::Print();
+			return (int)result.i;
+		}
+	}
+
+	if(MemReport::Enabled())
+		MemReport::Print();
 	
-	return 0;
+	return diag.HasErrors() || !linked ? 1 : 0;
 }
\ No newline at end of file
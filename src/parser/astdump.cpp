@@ -0,0 +1,434 @@
+#include "astdump.hpp"
+#include <charconv>
+#include "parser/visitor.hpp"
+
+static const char *TokenSpelling(const Token &tok){
+	switch(tok.type){
+		case Token::Type::PLUS: return "+";
+		case Token::Type::MINUS: return "-";
+		case Token::Type::STAR: return "*";
+		case Token::Type::SLASH: return "/";
+		case Token::Type::ASSIGN: return "=";
+		case Token::Type::ADDASSIGN: return "+=";
+		case Token::Type::SUBASSIGN: return "-=";
+		case Token::Type::MULTASSIGN: return "*=";
+		case Token::Type::DIVASSIGN: return "/=";
+		case Token::Type::NOT: return "!";
+		case Token::Type::EQ: return "==";
+		case Token::Type::NEQ: return "!=";
+		case Token::Type::GREATER: return ">";
+		case Token::Type::GEQ: return ">=";
+		case Token::Type::LESS: return "<";
+		case Token::Type::LEQ: return "<=";
+		case Token::Type::COMMA: return ",";
+		case Token::Type::DOT: return ".";
+		case Token::Type::DEREFERENCE: return "->";
+		default: return "";
+	}
+}
+static void Quoted(std::ostream &out, std::string_view str){
+	static constexpr char hex[] = "0123456789abcdef";
+
+	out.put('"');
+	for(char c: str){
+		switch(c){
+			case '"': out.write("\\\"", 2); break;
+			case '\\': out.write("\\\\", 2); break;
+			case '\n': out.write("\\n", 2); break;
+			case '\t': out.write("\\t", 2); break;
+			default:
+				if((unsigned char)c < 0x20){
+					out.write("\\u00", 4);
+					out.put(hex[(c >> 4) & 0xF]);
+					out.put(hex[c & 0xF]);
+				}
+				else{
+					out.put(c);
+				}
+		}
+	}
+	out.put('"');
+}
+
+//Literals are printed the way they were written, names come from the symbol table. Streamed
+//input keeps no text for lines already lexed, its literals are printed from their value
+static std::string Spelling(const Token &tok, const Tokenizer &tokenizer){
+	auto text = tokenizer.Text(tok);
+	switch(tok.type){
+		case Token::Type::INTEGER_NUMBER:
+			return text.empty() ? std::to_string(tok.intVal) : std::string(text);
+		case Token::Type::FLOATING_NUMBER:{
+			if(!text.empty()) return std::string(text);
+			char buffer[32];
+			std::string number(buffer, std::to_chars(buffer, buffer + sizeof(buffer), tok.floatVal).ptr);
+			if(number.find_first_of(".en") == std::string::npos) number += ".0";
+			return number;
+		}
+		case Token::Type::CHAR_LITERAL:
+			return text.empty() ? std::string(1, (char)tok.intVal) : std::string(text.substr(1, 1));
+		default:
+			return tok.Name();
+	}
+}
+
+//Indented text, one line per node or label
+class TextDumper: public ConstAstVisitor<TextDumper>{
+	private:
+	std::ostream &out;
+	const Tokenizer &tokenizer;
+	int depth = 0;
+
+	void Indent(int extra){
+		static constexpr char tabs[] = "\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t";
+		static constexpr int tabCount = sizeof(tabs) - 1;
+
+		int count = depth + extra;
+		for(; count > tabCount; count -= tabCount)
+			out.write(tabs, tabCount);
+		out.write(tabs, count);
+	}
+	void Child(const Node &node, int extra){
+		depth += extra;
+		Visit(node);
+		depth -= extra;
+	}
+
+	public:
+	TextDumper(std::ostream &out_, const Tokenizer &tokenizer_): out(out_), tokenizer(tokenizer_) {}
+
+	void VisitErr(const Node&);
+	void VisitBlock(const BlockNode &node);
+	void VisitVal(const ValNode &node);
+	void VisitMember(const MemberNode &node);
+	void VisitReturn(const ReturnNode &node);
+	void VisitBinary(const BinaryNode &node);
+	void VisitVarDecl(const VarDeclNode &node);
+	void VisitVarAssign(const VarAssignNode &node);
+	void VisitFuncDecl(const FuncDeclNode &node);
+	void VisitFuncCall(const FuncCallNode &node);
+	void VisitIf(const IfNode &node);
+	void VisitWhile(const WhileNode &node);
+	void VisitSwitch(const SwitchNode &node);
+	void VisitCase(const CaseNode &node);
+	void VisitIndex(const IndexNode &node);
+};
+//A single JSON document, empty children are null
+class JsonDumper: public ConstAstVisitor<JsonDumper>{
+	private:
+	std::ostream &out;
+	const Tokenizer &tokenizer;
+
+	void Location(const Token &tok){
+		auto loc = tokenizer.Locate(tok.offset);
+		out << ",\"line\":" << loc.line << ",\"col\":" << loc.col;
+	}
+
+	public:
+	JsonDumper(std::ostream &out_, const Tokenizer &tokenizer_): out(out_), tokenizer(tokenizer_) {}
+
+	void VisitErr(const Node&);
+	void VisitBlock(const BlockNode &node);
+	void VisitVal(const ValNode &node);
+	void VisitMember(const MemberNode &node);
+	void VisitReturn(const ReturnNode &node);
+	void VisitBinary(const BinaryNode &node);
+	void VisitVarDecl(const VarDeclNode &node);
+	void VisitVarAssign(const VarAssignNode &node);
+	void VisitFuncDecl(const FuncDeclNode &node);
+	void VisitFuncCall(const FuncCallNode &node);
+	void VisitIf(const IfNode &node);
+	void VisitWhile(const WhileNode &node);
+	void VisitSwitch(const SwitchNode &node);
+	void VisitCase(const CaseNode &node);
+	void VisitIndex(const IndexNode &node);
+};
+
+void AstDumper::Dump(const Node &node){
+	if(format == Format::JSON){
+		JsonDumper(out, tokenizer).Visit(node);
+		out << '\n';
+	}
+	else{
+		TextDumper(out, tokenizer).Visit(node);
+	}
+	out.flush();
+}
+
+void TextDumper::VisitErr(const Node&){
+	Indent(0);
+	out << "VOID\n";
+}
+void TextDumper::VisitBlock(const BlockNode &node){
+	Indent(0);
+	out << "BLOCK:\n";
+	for(auto &stmt: node.stmts)
+		Child(*stmt, 1);
+}
+void TextDumper::VisitVal(const ValNode &node){
+	Indent(0);
+	out << Spelling(node.val, tokenizer) << '\n';
+}
+void TextDumper::VisitMember(const MemberNode &node){
+	Indent(0);
+	out << "MEMBER:\n";
+	Indent(1);
+	out << node.member.name << '\n';
+}
+void TextDumper::VisitReturn(const ReturnNode &node){
+	Indent(0);
+	out << (node.isTailCall ? "RETURN TAILCALL:\n" : "RETURN:\n");
+	Child(*node.expr, 1);
+}
+void TextDumper::VisitBinary(const BinaryNode &node){
+	Indent(0);
+	out << "BINARY:\n";
+	Indent(1);
+	out << "LHS:\n";
+	Child(*node.lhs, 2);
+	Indent(1);
+	out << "OPERAND: " << TokenSpelling(node.operand) << '\n';
+	Indent(1);
+	out << "RHS:\n";
+	Child(*node.rhs, 2);
+}
+void TextDumper::VisitVarDecl(const VarDeclNode &node){
+	Indent(0);
+	out << "VAR:\n";
+	Indent(1);
+	out << "Name: " << node.ident.Name() << '\n';
+	if(node.varType->isArray){
+		Indent(1);
+		out << "Array: " << node.varType->arrSize << (node.isRestrict ? " restrict" : "") << '\n';
+	}
+	Indent(1);
+	out << "Val:\n";
+	Child(*node.initial, 2);
+}
+void TextDumper::VisitVarAssign(const VarAssignNode &node){
+	Indent(0);
+	out << "ASSIGN:\n";
+	Indent(1);
+	out << node.varName.Name() << '\n';
+	if(node.index->type != NodeType::ERR){
+		Indent(1);
+		out << "INDEX:\n";
+		Child(*node.index, 2);
+	}
+	Indent(1);
+	out << "VALUE:\n";
+	Child(*node.expression, 2);
+}
+void TextDumper::VisitFuncDecl(const FuncDeclNode &node){
+	Indent(0);
+	out << "FUNC:\n";
+	Indent(1);
+	out << "Name: " << node.ident.Name() << '\n';
+	Indent(1);
+	out << "Params:\n";
+	for(auto &param: node.params)
+		Child(*param, 2);
+	Indent(1);
+	out << "Body:\n";
+	Child(*node.block, 2);
+}
+void TextDumper::VisitFuncCall(const FuncCallNode &node){
+	Indent(0);
+	out << "CALL:\n";
+	Indent(1);
+	out << "Name: " << node.funcName.Name() << '\n';
+	Indent(1);
+	out << "Args:\n";
+	for(auto &param: node.params)
+		Child(*param, 2);
+}
+void TextDumper::VisitIf(const IfNode &node){
+	Indent(0);
+	out << "IF:\n";
+	Indent(1);
+	out << "Cond:\n";
+	Child(*node.cond, 2);
+	Indent(1);
+	out << "Then:\n";
+	Child(*node.then, 2);
+
+	if(node.elseBody->type != NodeType::ERR){
+		Indent(1);
+		out << "Else:\n";
+		Child(*node.elseBody, 2);
+	}
+}
+void TextDumper::VisitWhile(const WhileNode &node){
+	Indent(0);
+	out << "WHILE:\n";
+	Indent(1);
+	out << "COND:\n";
+	Child(*node.cond, 2);
+	Indent(1);
+	out << "THEN:\n";
+	Child(*node.then, 2);
+}
+void TextDumper::VisitSwitch(const SwitchNode &node){
+	Indent(0);
+	out << "SWITCH:\n";
+	Indent(1);
+	out << "Value:\n";
+	Child(*node.value, 2);
+	Indent(1);
+	out << "Cases:\n";
+	for(auto &arm: node.cases)
+		Child(*arm, 2);
+}
+void TextDumper::VisitCase(const CaseNode &node){
+	Indent(0);
+	out << (node.isDefault ? "DEFAULT:\n" : "CASE:\n");
+	Indent(1);
+	out << "Labels:\n";
+	for(auto &label: node.labels)
+		Child(*label, 2);
+	Indent(1);
+	out << "Body:\n";
+	Child(*node.body, 2);
+}
+void TextDumper::VisitIndex(const IndexNode &node){
+	Indent(0);
+	out << "INDEX:\n";
+	Indent(1);
+	out << "Name: " << node.array.Name() << '\n';
+	Indent(1);
+	out << "Index:\n";
+	Child(*node.index, 2);
+}
+
+void JsonDumper::VisitErr(const Node&){
+	out << "null";
+}
+void JsonDumper::VisitBlock(const BlockNode &node){
+	out << "{\"kind\":\"block\",\"stmts\":[";
+	bool first = true;
+	for(auto &stmt: node.stmts){
+		if(!first) out.put(',');
+		first = false;
+		Visit(*stmt);
+	}
+	out << "]}";
+}
+void JsonDumper::VisitVal(const ValNode &node){
+	auto &tok = node.val;
+	out << "{\"kind\":\"" << (tok.type == Token::Type::IDENT ? "ident" : "literal") << "\",\"value\":";
+	Quoted(out, Spelling(tok, tokenizer));
+	Location(tok);
+	out << '}';
+}
+void JsonDumper::VisitMember(const MemberNode &node){
+	out << "{\"kind\":\"member\",\"name\":";
+	Quoted(out, node.member.name);
+	out << ",\"offset\":" << node.member.offset << '}';
+}
+void JsonDumper::VisitReturn(const ReturnNode &node){
+	out << "{\"kind\":\"return\",\"tailcall\":" << (node.isTailCall ? "true" : "false") << ",\"expr\":";
+	Visit(*node.expr);
+	out << '}';
+}
+void JsonDumper::VisitBinary(const BinaryNode &node){
+	out << "{\"kind\":\"binary\",\"op\":\"" << TokenSpelling(node.operand) << "\",\"lhs\":";
+	Visit(*node.lhs);
+	out << ",\"rhs\":";
+	Visit(*node.rhs);
+	out << '}';
+}
+void JsonDumper::VisitVarDecl(const VarDeclNode &node){
+	out << "{\"kind\":\"var\",\"name\":";
+	Quoted(out, node.ident.Name());
+	Location(node.ident);
+	if(node.varType->isArray)
+		out << ",\"size\":" << node.varType->arrSize << ",\"restrict\":" << (node.isRestrict ? "true" : "false");
+	out << ",\"init\":";
+	Visit(*node.initial);
+	out << '}';
+}
+void JsonDumper::VisitVarAssign(const VarAssignNode &node){
+	out << "{\"kind\":\"assign\",\"name\":";
+	Quoted(out, node.varName.Name());
+	if(node.index->type != NodeType::ERR){
+		out << ",\"index\":";
+		Visit(*node.index);
+	}
+	out << ",\"value\":";
+	Visit(*node.expression);
+	out << '}';
+}
+void JsonDumper::VisitFuncDecl(const FuncDeclNode &node){
+	out << "{\"kind\":\"func\",\"name\":";
+	Quoted(out, node.ident.Name());
+	Location(node.ident);
+	out << ",\"exported\":" << (node.isExported ? "true" : "false") << ",\"inline\":" << (node.isInline ? "true" : "false") << ",\"params\":[";
+	bool first = true;
+	for(auto &param: node.params){
+		if(!first) out.put(',');
+		first = false;
+		Visit(*param);
+	}
+	out << "],\"body\":";
+	Visit(*node.block);
+	out << '}';
+}
+void JsonDumper::VisitFuncCall(const FuncCallNode &node){
+	out << "{\"kind\":\"call\",\"name\":";
+	Quoted(out, node.funcName.Name());
+	out << ",\"args\":[";
+	bool first = true;
+	for(auto &param: node.params){
+		if(!first) out.put(',');
+		first = false;
+		Visit(*param);
+	}
+	out << "]}";
+}
+void JsonDumper::VisitIf(const IfNode &node){
+	out << "{\"kind\":\"if\",\"cond\":";
+	Visit(*node.cond);
+	out << ",\"then\":";
+	Visit(*node.then);
+	out << ",\"else\":";
+	Visit(*node.elseBody);
+	out << '}';
+}
+void JsonDumper::VisitWhile(const WhileNode &node){
+	out << "{\"kind\":\"while\",\"cond\":";
+	Visit(*node.cond);
+	out << ",\"body\":";
+	Visit(*node.then);
+	out << '}';
+}
+void JsonDumper::VisitSwitch(const SwitchNode &node){
+	out << "{\"kind\":\"switch\",\"value\":";
+	Visit(*node.value);
+	out << ",\"cases\":[";
+	bool first = true;
+	for(auto &arm: node.cases){
+		if(!first) out.put(',');
+		first = false;
+		Visit(*arm);
+	}
+	out << "]}";
+}
+void JsonDumper::VisitCase(const CaseNode &node){
+	out << "{\"kind\":\"case\",\"default\":" << (node.isDefault ? "true" : "false") << ",\"labels\":[";
+	bool first = true;
+	for(auto &label: node.labels){
+		if(!first) out.put(',');
+		first = false;
+		Visit(*label);
+	}
+	out << "],\"body\":";
+	Visit(*node.body);
+	out << '}';
+}
+void JsonDumper::VisitIndex(const IndexNode &node){
+	out << "{\"kind\":\"index\",\"name\":";
+	Quoted(out, node.array.Name());
+	Location(node.array);
+	out << ",\"index\":";
+	Visit(*node.index);
+	out << '}';
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <iostream>
+#include "parser/parser.hpp"
+
+//Writes the AST straight to a stream in one pass, no intermediate strings
+class AstDumper{
+	public:
+	enum class Format{
+		TEXT,
+		JSON
+	};
+
+	//Positions and literal spellings come from the tokenizer the tree was parsed from
+	AstDumper(std::ostream &out_, Format format_, const Tokenizer &tokenizer_): out(out_), format(format_), tokenizer(tokenizer_) {}
+
+	void Dump(const Node &node);
+
+	private:
+	std::ostream &out;
+	Format format;
+	const Tokenizer &tokenizer;
+};
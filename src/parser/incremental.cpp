@@ -0,0 +1,200 @@
+#include "parser.hpp"
+#include "parser/visitor.hpp"
+
+//Moves the tokens of a statement after an edit by the number of bytes it added or removed.
+//Offsets wrap around, so a removal is a shift by its two's complement
+class OffsetShifter: public AstVisitor<OffsetShifter>{
+	private:
+	std::uint32_t delta;
+
+	public:
+	explicit OffsetShifter(std::uint32_t delta_): delta(delta_) {}
+
+	void Shift(Token &tok){
+		tok.offset += delta;
+	}
+	void ShiftScope(Scope &scope){
+		for(auto &var: scope.identifiers)
+			Shift(var.ident);
+		for(auto &child: scope.scopes)
+			ShiftScope(*child);
+	}
+
+	void VisitNode(Node &node) { VisitChildren(node); }
+	void VisitVal(ValNode &node) { Shift(node.val); }
+	void VisitBinary(BinaryNode &node){
+		Shift(node.operand);
+		VisitChildren(node);
+	}
+	void VisitVarDecl(VarDeclNode &node){
+		Shift(node.ident);
+		VisitChildren(node);
+	}
+	void VisitFuncDecl(FuncDeclNode &node){
+		Shift(node.ident);
+		VisitChildren(node);
+	}
+	void VisitVarAssign(VarAssignNode &node){
+		Shift(node.varName);
+		VisitChildren(node);
+	}
+	void VisitFuncCall(FuncCallNode &node){
+		Shift(node.funcName);
+		VisitChildren(node);
+	}
+	void VisitIndex(IndexNode &node){
+		Shift(node.array);
+		VisitChildren(node);
+	}
+};
+
+//Calls in the rest of the file were checked against the old parameters
+static bool SameParams(const Scope::Variable &before, const Scope::Variable &after){
+	if(before.isFunction != after.isFunction || before.paramCount != after.paramCount) return false;
+	if(!before.paramScope || !after.paramScope) return before.paramScope == after.paramScope;
+
+	for(size_t i = 0; i < before.paramCount; ++i){
+		auto &a = before.paramScope->identifiers[i].type, &b = after.paramScope->identifiers[i].type;
+		if(a.type != b.type || a.name != b.name || a.isArray != b.isArray || a.arrSize != b.arrSize) return false;
+	}
+	return true;
+}
+
+bool Parser::Reparse(const TextEdit &edit){
+	//Streamed source is gone once lexed, there is nothing to apply the edit to
+	if(tokenizer.IsStreamed()) return false;
+
+	//Same clamping as the tokenizer, edits past the end land on the last line
+	size_t lineCount = std::max<size_t>(tokenizer.LineCount(), 1);
+	size_t editFirst = std::clamp<size_t>(edit.startLine, 1, lineCount);
+	size_t editLast = std::clamp<size_t>(edit.endLine, editFirst, lineCount);
+
+	//Byte range of the edited lines, trailing newline included
+	std::uint32_t editBegin = tokenizer.Offset(editFirst, 1);
+	std::uint32_t editEnd = tokenizer.Offset(editLast + 1, 1);
+
+	long delta = tokenizer.ApplyEdit(edit);
+	auto fullParse = [this](){
+		diag.Clear();
+		Reset();
+		Parse();
+		return false;
+	};
+
+	//Without spans (AST cache) or with errors around there is no known-good tree to patch
+	if(!haveSpans || diag.HasErrors()) return fullParse();
+
+	//Every statement with a token on an edited line is parsed again
+	auto first = std::partition_point(topLevelDecls.begin(), topLevelDecls.end(),
+		[this, editBegin](const TopLevelDecl &decl) { return Shifted(decl, decl.end) <= editBegin; });
+	auto last = std::partition_point(first, topLevelDecls.end(),
+		[this, editEnd](const TopLevelDecl &decl) { return Shifted(decl, decl.begin) < editEnd; });
+
+	auto &globals = *rootNode->myScope;
+	auto &rootStmts = rootNode->stmts;
+	size_t identsEnd = globals.identifiers.size();
+	size_t typesEnd = globals.types.size();
+	size_t scopesEnd = globals.scopes.size();
+
+	//Statements after the edit keep their place in the global scope, only the edited ones are counted
+	size_t identsBegin = identsEnd, typesBegin = typesEnd, scopesBegin = scopesEnd, stmtsBegin = rootStmts.size();
+	if(first != topLevelDecls.end()){
+		identsBegin = first->identsBegin;
+		typesBegin = first->typesBegin;
+		scopesBegin = first->scopesBegin;
+		stmtsBegin = first->stmtIndex;
+	}
+	size_t identCount = 0, scopeCount = 0, stmtCount = 0;
+	for(auto it = first; it != last; ++it){
+		//Struct types are referenced by address from all over the tree
+		if(it->typeCount) return fullParse();
+
+		identCount += it->identCount;
+		scopeCount += it->scopeCount;
+		stmtCount += it->node->type != NodeType::ERR;
+	}
+
+	//Lex from the first touched statement up to the first untouched one, nothing else is read
+	if(last != topLevelDecls.end())
+		tokenizer.SetLimit(Shifted(*last, last->begin) + delta);
+	std::uint32_t firstBegin = first != last ? Shifted(*first, first->begin) : editBegin;
+	StartAt(std::min(firstBegin, editBegin));
+
+	hiddenIdentsBegin = identsBegin;
+	hiddenIdentsEnd = identsEnd;
+	hiddenTypesBegin = typesBegin;
+	hiddenTypesEnd = typesEnd;
+
+	size_t errors = diag.ErrorCount();
+	currScope = rootNode->myScope;
+	auto decls = ParseTopLevel();
+
+	tokenizer.SetLimit();
+	hiddenIdentsBegin = hiddenIdentsEnd = 0;
+	hiddenTypesBegin = hiddenTypesEnd = 0;
+
+	//The rest of the file was parsed against the old globals, so they have to stay the same. So do
+	//the counts, the statements after the edit then keep their indices
+	size_t newStmts = std::count_if(decls.begin(), decls.end(), [](const TopLevelDecl &decl) { return decl.node->type != NodeType::ERR; });
+	bool unchanged = diag.ErrorCount() == errors && globals.types.size() == typesEnd && globals.identifiers.size() - identsEnd == identCount &&
+		globals.scopes.size() - scopesEnd == scopeCount && decls.size() == size_t(last - first) && newStmts == stmtCount;
+	for(size_t i = 0; unchanged && i < identCount; ++i){
+		auto &before = globals.identifiers[identsBegin + i];
+		auto &after = globals.identifiers[identsEnd + i];
+		unchanged = before.ident.symbol == after.ident.symbol && before.type.type == after.type.type && before.type.name == after.type.name &&
+			before.type.isArray == after.type.isArray && before.type.arrSize == after.type.arrSize && SameParams(before, after);
+	}
+	if(!unchanged) return fullParse();
+
+	for(size_t i = 0; i < identCount; ++i)
+		globals.identifiers[identsBegin + i] = globals.identifiers[identsEnd + i];
+	globals.identifiers.erase(globals.identifiers.begin() + identsEnd, globals.identifiers.end());
+	std::move(globals.scopes.begin() + scopesEnd, globals.scopes.end(), globals.scopes.begin() + scopesBegin);
+	globals.scopes.erase(globals.scopes.begin() + scopesEnd, globals.scopes.end());
+
+	//The statements after the edit are only moved once something reads the tree
+	if(delta && last != topLevelDecls.end())
+		pendingShifts.emplace_back(editEnd, (std::uint32_t)delta);
+
+	size_t stmt = stmtsBegin;
+	for(auto &decl: decls){
+		decl.identsBegin += identsBegin - identsEnd;
+		decl.scopesBegin += scopesBegin - scopesEnd;
+		decl.stmtIndex = stmt;
+		decl.shifted = pendingShifts.size();
+		if(decl.node->type != NodeType::ERR)
+			rootStmts[stmt++] = decl.node;
+	}
+	std::move(decls.begin(), decls.end(), first);
+
+	if(pendingShifts.size() > MAX_PENDING_SHIFTS) SettleOffsets();
+	return true;
+}
+std::uint32_t Parser::Shifted(const TopLevelDecl &decl, std::uint32_t offset) const{
+	//Each shift is in the offsets from right before its edit, so they are applied in order
+	for(size_t i = decl.shifted; i < pendingShifts.size(); ++i){
+		if(offset >= pendingShifts[i].first)
+			offset += pendingShifts[i].second;
+	}
+	return offset;
+}
+void Parser::SettleOffsets(){
+	if(pendingShifts.empty()) return;
+
+	auto &globals = *rootNode->myScope;
+	for(auto &decl: topLevelDecls){
+		std::uint32_t delta = Shifted(decl, decl.begin) - decl.begin;
+		decl.shifted = 0;
+		if(!delta) continue;
+
+		OffsetShifter shifter(delta);
+		decl.begin += delta;
+		decl.end += delta;
+		shifter.Visit(*decl.node);
+		for(size_t i = 0; i < decl.identCount; ++i)
+			shifter.Shift(globals.identifiers[decl.identsBegin + i].ident);
+		for(size_t i = 0; i < decl.scopeCount; ++i)
+			shifter.ShiftScope(*globals.scopes[decl.scopesBegin + i]);
+	}
+	pendingShifts.clear();
+}
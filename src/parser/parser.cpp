@@ -1,30 +1,18 @@
 #include "parser.hpp"
-#include <sstream>
 #include <iostream>
 #include <algorithm>
+#include <map>
+#include <mutex>
+#include <atomic>
 #include <stdexcept>
 #include <unordered_map>
-
-#include <llvm/IR/Type.h>
-#include <llvm/IR/Module.h>
-#include <llvm/IR/Verifier.h>
-#include <llvm/IR/Constant.h>
-#include <llvm/IR/IRBuilder.h>
-#include <llvm/IR/LLVMContext.h>
+#include <unordered_set>
 
 #include "util/logger.hpp"
-
-static std::unique_ptr<llvm::LLVMContext> context;
-static std::unique_ptr<llvm::IRBuilder<>> builder;
-static std::unique_ptr<llvm::Module> module;
-static llvm::BasicBlock *currentScope = nullptr;
-static llvm::Function *currFunc = nullptr;
-static Parser *currParser = nullptr;
+#include "util/memreport.hpp"
 
 const VarType VarType::ERROR = VarType();
 static Scope::Variable EmptyName;
-static bool parsingParams = false;
-static bool parsingCond = false;
 
 static int Precedence(const Token &tok){
 	switch(tok.type){
@@ -61,115 +49,109 @@ static int Precedence(const Token &tok){
 
 static std::unordered_map<Token::Type, VarType> primitives;
 
-static inline std::string Indent(int depth){
-	std::stringstream ss;
-	for(int i = 0; i < depth; ++i)
-		ss << "\t";
-
-	return ss.str();
+//Array types aren't declared anywhere, they are made on first use and kept by the outermost
+//scope of the tree, which outlives the element types it was made from. Worker threads parse
+//declarations too, hence the lock
+static std::mutex arrayTypesLock;
+static const VarType &ArrayOf(Scope &globals, const VarType &elem, size_t size){
+	std::lock_guard lock(arrayTypesLock);
+	auto [found, added] = globals.arrayTypes.try_emplace({&elem, size}, elem);
+	if(added){
+		found->second.isArray = true;
+		found->second.arrSize = size;
+	}
+	return found->second;
 }
 
-static std::string GetCode(Node &node, int depth = 0){
-	std::string ret = "";
+//Vector types are made on first use as well. The element is always the primitive, so it stays
+//valid after the type that was passed in is gone
+static std::map<std::pair<VarType::Type, size_t>, VarType> vectorTypes;
+static std::mutex vectorTypesLock;
+const VarType &VarType::Vector(const VarType &element, size_t lanes){
+	static const char *const names[] = { "char", "short", "int", "long", "float", "double" };
+	if(element.type < Type::CHAR || element.type > Type::DOUBLE || element.isArray) return ERROR;
+	if(lanes != 2 && lanes != 4 && lanes != 8 && lanes != 16) return ERROR;
+
+	std::lock_guard lock(vectorTypesLock);
+	auto found = vectorTypes.find({ element.type, lanes });
+	if(found != vectorTypes.end()) return found->second;
+
+	auto primitive = std::find_if(primitives.begin(), primitives.end(), [&element](const auto &prim){ return prim.second.type == element.type; });
+	if(primitive == primitives.end()) return ERROR;
+
+	std::string name = names[(int)element.type - (int)Type::CHAR] + std::to_string(lanes);
+	VarType vector(Type::VECTOR, name, element.typeSz * lanes, &primitive->second, std::vector<Member>(), false, false, 0);
+	vector.lanes = lanes;
+	return vectorTypes.emplace(std::make_pair(element.type, lanes), vector).first->second;
+}
+const VarType &VarType::Vector(std::string_view name){
+	Token keyword;
+	if(!Tokenizer::VectorKeyword(name, keyword)) return ERROR;
+	return Vector(primitives.at(keyword.VectorElement()), keyword.VectorLanes());
+}
 
-	switch(node.type){
-		case NodeType::BLOCK:
-			ret += Indent(depth) + "BLOCK:\n";
-			for(auto &node_: static_cast<BlockNode&>(node).stmts)
-				ret += GetCode(*node_.get(), depth + 1) + "\n";
-			if(static_cast<BlockNode&>(node).stmts.size() > 0) ret.erase(ret.end() - 1);
-			break;
-		case NodeType::VAL:
-			ret += Indent(depth) + static_cast<ValNode&>(node).val.val;
-			break;
-		case NodeType::MEMBER:
-			ret += Indent(depth) + "MEMBER:\n";
-			ret += Indent(depth + 1) + static_cast<MemberNode&>(node).member.name;
-			break;
-		case NodeType::RETURN:
-			ret += Indent(depth) + "RETURN:\n";
-			if(static_cast<ReturnNode&>(node).expr->type == NodeType::ERR)
-				ret += Indent(depth + 1) + "VOID";
-			else
-				ret += GetCode(*static_cast<ReturnNode&>(node).expr.get(), depth + 1);
-			break;
-		case NodeType::BINARY:
-			ret += Indent(depth) + "BINARY:\n";
-			ret += Indent(depth + 1) + "LHS:\n" + GetCode(*static_cast<BinaryNode&>(node).lhs.get(), depth + 2) + "\n";
-			ret += Indent(depth + 1) + "OPERAND: " + static_cast<BinaryNode&>(node).operand.val + "\n";
-			ret += Indent(depth + 1) + "RHS:\n" + GetCode(*static_cast<BinaryNode&>(node).rhs.get(), depth + 2);
-			break;
-		case NodeType::VARDECL:
-			ret += Indent(depth) + "VAR:\n";
-			ret += Indent(depth + 1) + "Name: " + static_cast<VarDeclNode&>(node).ident.val + "\n";
-			ret += Indent(depth + 1) + "Val:\n";
-			if(static_cast<VarDeclNode&>(node).initial->type == NodeType::ERR)
-				ret +=  Indent(depth + 2) + "VOID";
-			else
-				ret += GetCode(*static_cast<VarDeclNode&>(node).initial.get(), depth + 2);
-			break;
-		case NodeType::VARASSIGN:
-			ret += Indent(depth) + "ASSIGN:\n";
-			ret += Indent(depth + 1) + static_cast<VarAssignNode&>(node).varName.val + "\n";
-			ret += Indent(depth + 1) + "VALUE:\n";
-			ret += GetCode(*static_cast<VarAssignNode&>(node).expression.get(), depth + 2) + "\n";
-			break;
-		case NodeType::FUNCDECL:
-			ret += Indent(depth) + "FUNC:\n";
-			ret += Indent(depth + 1) + "Name: " + static_cast<FuncDeclNode&>(node).ident.val + "\n";
-			ret += Indent(depth + 1) + "Params:\n";
-			for(auto &param:  static_cast<FuncDeclNode&>(node).params){
-				ret += GetCode(*param.get(), depth + 2) + "\n";
-			}
-			ret += Indent(depth + 1) + "Body:\n";
-			ret += GetCode(*static_cast<FuncDeclNode&>(node).block.get(), depth + 2);
-			break;
-		case NodeType::IF:
-			ret += Indent(depth) + "IF:\n";
-			ret += Indent(depth + 1) + "Cond:\n";
-			ret += GetCode(*static_cast<IfNode&>(node).cond.get(), depth + 2) + "\n";
-			ret += Indent(depth + 1) + "Then:\n";
-			ret += GetCode(*static_cast<IfNode&>(node).then.get(), depth + 2);
-
-			if(static_cast<IfNode&>(node).elseBody->type != NodeType::ERR){
-				ret += "\n" + Indent(depth + 1) + "Else:\n";
-				ret += GetCode(*static_cast<IfNode&>(node).elseBody.get(), depth + 2);
-			}
-			break;
-		case NodeType::WHILE:
-			ret += Indent(depth) + "WHILE:\n";
-			ret += Indent(depth + 1) + "COND:\n";
-			ret += GetCode(*static_cast<WhileNode&>(node).cond.get(), depth + 2) + "\n";
-			ret += Indent(depth + 1) + "THEN:\n";
-			ret += GetCode(*static_cast<WhileNode&>(node).then.get(), depth + 2);
-			break;
+VectorBuiltin FindVectorBuiltin(const Token &name){
+	static const std::pair<const char*, VectorBuiltin> builtins[] = {
+		{ "shuffle", VectorBuiltin::SHUFFLE },
+		{ "reduceAdd", VectorBuiltin::REDUCE_ADD },
+		{ "reduceMul", VectorBuiltin::REDUCE_MUL },
+		{ "reduceMin", VectorBuiltin::REDUCE_MIN },
+		{ "reduceMax", VectorBuiltin::REDUCE_MAX },
+	};
+	if(name.type != Token::Type::IDENT) return VectorBuiltin::NONE;
+
+	if(VarType::Vector(name.Name()).type != VarType::Type::ERR) return VectorBuiltin::CONSTRUCT;
+	for(auto &[builtin, kind]: builtins){
+		if(name.Name() == builtin) return kind;
 	}
-
-	return ret;
+	return VectorBuiltin::NONE;
 }
-std::string Parser::GenerateCode() const{
-	return GetCode(*rootNode.get());
+
+Token SoaMember(const Token &array, const Member &member){
+	Token name(Token::Type::IDENT, array.offset, array.length);
+	name.symbol = Symbols::Intern(array.Name() + "." + member.name);
+	return name;
 }
 
-Scope::Variable &Parser::FindIdent(const Token &name) const{
-	std::shared_ptr<Scope> currentScope = currScope;
+Scope::Variable &Scope::Lookup(std::shared_ptr<Scope> currentScope, const Token &name, bool *isGlobal){
 	while(currentScope){
 		auto foundPos = std::find_if(
 			currentScope->identifiers.begin(), 
 			currentScope->identifiers.end(), 
 			[name](const Scope::Variable &var) {
-				return var.ident.val == name.val;
+				return var.ident.symbol == name.symbol;
 			}
 		);
-		if(foundPos != currentScope->identifiers.end())
+		if(foundPos != currentScope->identifiers.end()){
+			if(isGlobal) *isGlobal = !currentScope->parent;
 			return *foundPos;
+		}
 
 		currentScope = currentScope->parent;
 	}
 
 	return EmptyName;
 }
+Scope::Variable &Parser::FindIdent(const Token &name) const{
+	bool isGlobal = false;
+	auto &found = Scope::Lookup(currScope, name, &isGlobal);
+	if(!isGlobal || hiddenIdentsBegin == hiddenIdentsEnd) return found;
+
+	auto &globals = rootNode->myScope->identifiers;
+	size_t index = &found - globals.data();
+	if(index < hiddenIdentsBegin || index >= hiddenIdentsEnd) return found;
+
+	auto redeclared = std::find_if(globals.begin() + hiddenIdentsEnd, globals.end(),
+		[&name](const Scope::Variable &var) {
+			return var.ident.symbol == name.symbol;
+		}
+	);
+	return redeclared != globals.end() ? *redeclared : EmptyName;
+}
 const VarType &Parser::FindType(const Token &toFind) const{
+	if(toFind.type == Token::Type::TYPE_VECTOR){
+		return VarType::Vector(primitives.at(toFind.VectorElement()), toFind.VectorLanes());
+	}
 	if(primitives.contains(toFind.type)){
 		return primitives.at(toFind.type);
 	}
@@ -180,11 +162,14 @@ const VarType &Parser::FindType(const Token &toFind) const{
 			currentScope->types.begin(), 
 			currentScope->types.end(), 
 			[toFind](const VarType &type) {
-				return type.name == toFind.val;
+				return type.name == toFind.Name();
 			}
 		);
-		if(foundPos != currentScope->types.end())
-			return *foundPos;
+		if(foundPos != currentScope->types.end()){
+			size_t index = foundPos - currentScope->types.begin();
+			if(currentScope->parent || index < hiddenTypesBegin || index >= hiddenTypesEnd)
+				return *foundPos;
+		}
 
 		currentScope = currentScope->parent;
 	}
@@ -192,31 +177,215 @@ const VarType &Parser::FindType(const Token &toFind) const{
 	return VarType::ERROR;
 }
 
-static std::string GetIR() {
-	std::string module_str;
-	llvm::raw_string_ostream ostream{module_str};
-	module->print(ostream, nullptr, false);
-	return module_str;
+bool Parser::Parse(){
+	MemReport::BeginPhase("parse");
+
+	//On a single hardware thread the two sides would only take turns. Streamed input grows the
+	//line table while lexing, which diagnostics read from this thread
+	if(pipelinedLexer && !tokenizer.IsStreamed() && std::thread::hardware_concurrency() > 1)
+		lexerThread = std::make_unique<LexerThread>(tokenizer);
+	if(parseThreads > 1 && std::thread::hardware_concurrency() > 1)
+		ParseParallel();
+	else
+		topLevelDecls = ParseTopLevel();
+	lexerThread.reset();
+	CheckInputSize();
+
+	for(auto &decl: topLevelDecls){
+		decl.stmtIndex = rootNode->stmts.size();
+		if(decl.node->type != NodeType::ERR)
+			rootNode->AddStmt(decl.node);
+	}
+	haveSpans = true;
+
+	MemReport::EndPhase();
+	return !diag.HasErrors();
 }
-void Parser::Parse(){
-	context = std::make_unique<llvm::LLVMContext>();
-	module = std::make_unique<llvm::Module>(fileName, *context);
-	builder = std::make_unique<llvm::IRBuilder<>>(*context);
+std::vector<Parser::TopLevelDecl> Parser::ParseTopLevel(){
+	std::vector<TopLevelDecl> decls;
+	auto &globals = *currScope;
+
+	try{
+		while(currTok.type != Token::Type::TEOF){
+			TopLevelDecl decl{ nullptr, currTok.offset, 0, globals.identifiers.size(), 0, globals.types.size(), 0, globals.scopes.size(), 0, 0, pendingShifts.size() };
+
+			decl.node = ParseStmtOrRecover(true);
+			decl.end = prevEnd;
+			decl.identCount = globals.identifiers.size() - decl.identsBegin;
+			decl.typeCount = globals.types.size() - decl.typesBegin;
+			decl.scopeCount = globals.scopes.size() - decl.scopesBegin;
+			decls.push_back(decl);
+		}
+	}
+	catch(const Diagnostics::LimitReached&){}
 
-	currParser = this;
+	return decls;
+}
+//Parses the top level on this thread with function bodies skipped at their braces, so every
+//signature and global is known, then parses the bodies on worker threads
+void Parser::ParseParallel(){
+	std::vector<Token> tokens;
+	while(currTok.type != Token::Type::TEOF)
+		tokens.push_back(NextToken());
+	tokens.push_back(currTok);
+	lexerThread.reset();
+
+	auto rewind = [this, &tokens](){
+		currTok = tokens.front();
+		tokenCursor = tokens.data() + 1;
+		tokenEnd = tokens.data() + tokens.size();
+		fixedWindow = true;
+		endToken = tokens.back();
+	};
+
+	rewind();
+	deferBodies = true;
+	topLevelDecls = ParseTopLevel();
+	deferBodies = false;
+
+	bool parsed = !diag.HasErrors() && ParseDeferredBodies();
+	deferredBodies.clear();
+
+	//Diagnostics only come out in source order and within the error limit from a serial parse
+	if(!parsed){
+		diag.Clear();
+		currScope = std::make_shared<Scope>();
+		rootNode = std::make_shared<BlockNode>(std::vector<std::shared_ptr<Node>>(), currScope);
+		rewind();
+		topLevelDecls = ParseTopLevel();
+	}
 
-	while(true){
-		if(currTok.type == Token::Type::TEOF || currTok.type == Token::Type::ERR) break;
-		
-		auto node = ParseStmt();
-		if(node->type != NodeType::ERR)
-			rootNode->AddStmt(node);
+	//The buffer goes away with this frame, past here the parser only sees the end
+	tokenCursor = tokenEnd = nullptr;
+}
+bool Parser::ParseDeferredBodies(){
+	//The line table is built on first use, build it before the workers could race on it
+	tokenizer.Locate(0);
+
+	std::atomic<size_t> next{0};
+	std::atomic<bool> failed{false};
+	auto work = [&](){
+		Diagnostics local(0);
+
+		while(!failed.load(std::memory_order_relaxed)){
+			size_t i = next++;
+			if(i >= deferredBodies.size()) break;
+
+			auto &body = deferredBodies[i];
+			Parser worker(*this, local, body);
+
+			try{
+				body.func->block = worker.ParseBlock();
+			}
+			catch(const Diagnostics::Recover&){}
+			if(local.HasErrors()) failed = true;
+		}
+	};
+
+	unsigned threads = std::min<size_t>(parseThreads, deferredBodies.size());
+	std::vector<std::thread> workers;
+	for(unsigned i = 1; i < threads; ++i)
+		workers.emplace_back(work);
+	work();
+	for(auto &worker: workers)
+		worker.join();
+
+	return !failed;
+}
+void Parser::Reset(){
+	currScope = std::make_shared<Scope>();
+	rootNode = std::make_shared<BlockNode>(std::vector<std::shared_ptr<Node>>(), currScope);
+	topLevelDecls.clear();
+	pendingShifts.clear();
+	haveSpans = false;
+
+	tokenizer.SetLimit();
+	StartAt(0);
+}
+void Parser::StartAt(std::uint32_t offset){
+	tokenizer.Seek(offset);
+	tokenCursor = tokenEnd = nullptr;
+	fixedWindow = sourceEnded = false;
+	currTok = Refill();
+}
+Token Parser::Refill(){
+	if(fixedWindow || sourceEnded) return endToken;
+
+	size_t count = 0;
+	if(lexerThread){
+		count = lexerThread->Read(tokenBuffer, LexerThread::BATCH);
+	}
+	else{
+		do{
+			tokenBuffer[count] = tokenizer.NextToken();
+		}while(tokenBuffer[count++].type != Token::Type::TEOF && count < LexerThread::BATCH);
+	}
+
+	//Past the end the parser keeps getting the TEOF, same as from the tokenizer itself
+	if(tokenBuffer[count - 1].type == Token::Type::TEOF){
+		sourceEnded = true;
+		endToken = tokenBuffer[count - 1];
+	}
+	tokenCursor = tokenBuffer + 1;
+	tokenEnd = tokenBuffer + count;
+	return tokenBuffer[0];
+}
+void Parser::SetRoot(std::shared_ptr<BlockNode> root){
+	rootNode = root;
+	currScope = root->myScope;
+	topLevelDecls.clear();
+	pendingShifts.clear();
+	haveSpans = false;
+}
+void Parser::Expect(Token::Type type, const char *what){
+	if(currTok.type != type){
+		Log::Error(*this, "Expected ", what);
+	}
+	NextToken();
+}
+void Parser::Synchronize(bool topLevel){
+	size_t depth = 0;
+
+	while(currTok.type != Token::Type::TEOF){
+		switch(currTok.type){
+			case Token::Type::OPEN_BRACKET:
+				depth++;
+				break;
+			case Token::Type::CLOSED_BRACKET:
+				if(depth){
+					//Skipped a whole body, the statement that owned it is done
+					if(!--depth){
+						NextToken();
+						return;
+					}
+					break;
+				}
+				//Leave the bracket to the enclosing block so it can close itself
+				if(topLevel) NextToken();
+				return;
+			case Token::Type::SEMICOLON:
+				if(!depth){
+					NextToken();
+					return;
+				}
+				break;
+		}
+
+		NextToken();
 	}
+}
+std::shared_ptr<Node> Parser::ParseStmtOrRecover(bool topLevel){
+	auto scope = currScope;
 
-	auto tmp = rootNode->Codegen();
+	try{
+		return ParseStmt();
+	}
+	catch(const Diagnostics::Recover&){
+		currScope = scope;
+		Synchronize(topLevel);
+	}
 
-	module->print(llvm::errs(), nullptr);
-	currParser = nullptr;
+	return std::make_shared<Node>();
 }
 
 std::shared_ptr<Node> Parser::ParseBlock(){
@@ -228,20 +397,20 @@ std::shared_ptr<Node> Parser::ParseBlock(){
 	auto ret = std::make_shared<BlockNode>(std::vector<std::shared_ptr<Node>>(), currScope);
 	NextToken();
 
-	while(true){
-		auto tmp = ParseStmt();
-		if(tmp->type == NodeType::ERR) break;
-
-		ret->AddStmt(tmp);
-		if(currTok.type == Token::Type::CLOSED_BRACKET){
-			NextToken();
-			return ret;
+	while(currTok.type != Token::Type::CLOSED_BRACKET){
+		if(currTok.type == Token::Type::TEOF){
+			Log::Error(*this, "Missing }");
 		}
+
+		auto tmp = ParseStmtOrRecover(false);
+		if(tmp->type != NodeType::ERR)
+			ret->AddStmt(tmp);
 	}
+	NextToken();
 
-	return std::make_shared<Node>();
+	return ret;
 }
-void Parser::ParseStructdecl(){
+void Parser::ParseStructdecl(bool isSoa){
 	if(currTok.type != Token::Type::TYPE_STRUCT) return;
 	NextToken();
 
@@ -249,7 +418,7 @@ void Parser::ParseStructdecl(){
 
 	Token tmp = NextToken();
 	if(tmp.type != Token::Type::OPEN_BRACKET){
-		Log::Error(*this, "Missing (");
+		Log::Error(*this, "Missing {");
 	}
 	
 	std::vector<Member> members;
@@ -257,39 +426,119 @@ void Parser::ParseStructdecl(){
 	while(true){
 		auto &currType = FindType(NextToken());
 		if(currType.type == VarType::Type::ERR) break;
+		//Each member becomes an array of its own, so it has to be something an array can hold
+		if(isSoa && (currType.type == VarType::Type::VOID || currType.type == VarType::Type::STRUCT)){
+			Log::Error(*this, "Members of soa struct '", structName.Name(), "' have to be scalars or vectors");
+		}
 		
 		while(true){
+			if(currTok.type == Token::Type::ERR){
+				ReportInvalidToken();
+			}
 			Token name = NextToken();
 			auto delimiter = NextToken();
 
-			members.emplace_back(&currType, name.val, offset);
+			members.emplace_back(&currType, name.Name(), offset);
 			offset += currType.typeSz;
 			
 			if(delimiter.type == Token::Type::SEMICOLON) break;
 		}
 	}
 
-	currScope->types.push_back(VarType(VarType::Type::STRUCT, structName.val, offset, nullptr, members, false, false, 0));
+	currScope->types.push_back(VarType(VarType::Type::STRUCT, structName.Name(), offset, nullptr, members, false, false, 0));
+	currScope->types.back().isSoa = isSoa;
+}
+void Parser::DeclareSoaMembers(const Token &name, const VarType &array){
+	for(auto &member: array.members){
+		Token memberName = SoaMember(name, member);
+		CheckSymbol(memberName);
+		currScope->identifiers.emplace_back(memberName, ArrayOf(*rootNode->myScope, *member.type, array.arrSize), nullptr);
+	}
+}
+Token Parser::ParseSoaMember(const Token &name){
+	auto &array = FindIdent(name).type;
+	if(currTok.type != Token::Type::DOT){
+		Log::Error(*this, "Elements of soa array '", name.Name(), "' can only be accessed through a member");
+	}
+	NextToken();
+
+	auto &tok = currTok;
+	auto member = std::find_if(array.members.begin(), array.members.end(),
+		[&tok](const Member &memb){
+			return memb.name == tok.Name();
+		}
+	);
+	if(currTok.type != Token::Type::IDENT || member == array.members.end()){
+		Log::Error(*this, "Member '", currTok.Name(), "' not found");
+	}
+	NextToken();
+
+	Token memberName = SoaMember(name, *member);
+	CheckSymbol(memberName);
+	return memberName;
 }
 std::shared_ptr<Node> Parser::ParseStmt(){
 	std::shared_ptr<Node> ret = std::make_shared<Node>();
 
 	if(FindType(currTok).type != VarType::Type::ERR){
 		ret = ParseVarDecl();
-		NextToken();
+		if(ret->type != NodeType::FUNCDECL)
+			Expect(Token::Type::SEMICOLON, "';'");
 		return ret;
 	}
 	else if(currTok.type == Token::Type::TYPE_STRUCT){
 		ParseStructdecl();
-		NextToken();	//Semicolon
+		Expect(Token::Type::SEMICOLON, "';'");
+		return ret;
+	}
+	else if(currTok.type == Token::Type::SOA){
+		NextToken();
+		if(currTok.type != Token::Type::TYPE_STRUCT){
+			Log::Error(*this, "Expected struct after soa");
+		}
+		ParseStructdecl(true);
+		Expect(Token::Type::SEMICOLON, "';'");
+		return ret;
+	}
+	else if(currTok.type == Token::Type::EXPORT){
+		NextToken();
+		ret = ParseStmt();
+		if(ret->type != NodeType::FUNCDECL){
+			Log::Error(*this, "Only functions can be exported");
+		}
+		std::static_pointer_cast<FuncDeclNode>(ret)->isExported = true;
+
+		return ret;
+	}
+	else if(currTok.type == Token::Type::INLINE){
+		NextToken();
+		ret = ParseStmt();
+		if(ret->type != NodeType::FUNCDECL){
+			Log::Error(*this, "Only functions can be inline");
+		}
+		std::static_pointer_cast<FuncDeclNode>(ret)->isInline = true;
+
+		return ret;
 	}
 	else if(currTok.type == Token::Type::IF){
 		return ParseIf();
 	}
+	else if(currTok.type == Token::Type::SWITCH){
+		return ParseSwitch();
+	}
 	else if(currTok.type == Token::Type::RETURN){
 		NextToken();
-		ret = std::make_shared<ReturnNode>(ParseExpr());
-		NextToken();	//Semicolon
+		bool isTailCall = currTok.type == Token::Type::TAILCALL;
+		if(isTailCall) NextToken();
+
+		auto expr = ParseExpr();
+		if(returnType && expr->type != NodeType::ERR)
+			CheckConversion(*expr, *returnType);
+		if(isTailCall) CheckTailCall(*expr);
+		auto node = std::make_shared<ReturnNode>(expr);
+		node->isTailCall = isTailCall;
+		ret = node;
+		Expect(Token::Type::SEMICOLON, "';'");
 
 		return ret;
 	}
@@ -301,7 +550,13 @@ std::shared_ptr<Node> Parser::ParseStmt(){
 
 		NextToken();
 		auto cond = ParseExpr();
-		NextToken();
+		if(cond->type == NodeType::ERR) {
+			Log::Error(*this, "Invalid expression");
+		}
+		if(VectorTypeOf(*cond)){
+			Log::Error(*this, "Condition can't be a vector");
+		}
+		Expect(Token::Type::CLOSED_PARENTH, "')'");
 
 		std::shared_ptr<Node> then = std::make_shared<Node>();
 		if(currTok.type != Token::Type::OPEN_BRACKET){
@@ -320,19 +575,66 @@ std::shared_ptr<Node> Parser::ParseStmt(){
 		return std::make_shared<WhileNode>(cond, then);
 	}
 	else if(currTok.type == Token::Type::IDENT){
+		if(FindIdent(currTok).type.type == VarType::Type::ERR){
+			Log::Error(*this, "Variable '", currTok.Name(), "' not found");
+		}
 		auto varName = NextToken();
+		if(currTok.type == Token::Type::OPEN_PARENTH){
+			auto call = ParseCall(varName);
+			Expect(Token::Type::SEMICOLON, "';'");
+			return call;
+		}
+
+		auto target = FindIdent(varName).type;
+		std::shared_ptr<Node> index = std::make_shared<Node>();
+		if(currTok.type == Token::Type::OPEN_SQUARE || (currTok.type == Token::Type::DOT && target.IsVector())){
+			if(currTok.type == Token::Type::OPEN_SQUARE)
+				index = std::static_pointer_cast<IndexNode>(ParseIndex(varName))->index;
+			else
+				index = ParseLane(varName);
+			//Stores to a member of a soa array's element go to the member's array
+			if(target.isSoa){
+				varName = ParseSoaMember(varName);
+				target = FindIdent(varName).type;
+			}
+			if(currTok.type != Token::Type::ASSIGN){
+				Log::Error(*this, "Expected '=' after subscript of '", varName.Name(), "'");
+			}
+		}
+		else if(target.isArray){
+			Log::Error(*this, "Cannot assign to array '", varName.Name(), "'");
+		}
+
 		auto expr = std::make_shared<Node>();
 		if(currTok.type == Token::Type::ASSIGN){
 			NextToken();
 			expr = ParseExpr();
+			if(expr->type == NodeType::ERR){
+				Log::Error(*this, "Expected expression");
+			}
+
+			//A subscript stores one element, the lane of a vector or the vector of an array of them
+			const VarType *stored = &target;
+			if(index->type != NodeType::ERR && target.IsVector()) stored = target.baseType;
+			else if(target.isArray && target.type == VarType::Type::VECTOR) stored = &VarType::Vector(*target.baseType, target.lanes);
+			CheckConversion(*expr, *stored);
 		}
-		NextToken();
+		Expect(Token::Type::SEMICOLON, "';'");
 
-		return std::make_shared<VarAssignNode>(varName, expr);
+		return std::make_shared<VarAssignNode>(varName, expr, index);
 	}
-	
-	NextToken();
-	return ret;
+	else if(currTok.type == Token::Type::SEMICOLON){
+		NextToken();
+		return ret;
+	}
+	else if(currTok.type == Token::Type::TEOF){
+		Log::Error(*this, "Unexpected end of file");
+	}
+	else if(currTok.type == Token::Type::ERR){
+		ReportInvalidToken();
+	}
+
+	Log::Error(*this, "Unexpected token");
 }
 std::shared_ptr<Node> Parser::ParseFuncDecl(const VarType &funcType, const Token &name){
 	if(currTok.type != Token::Type::OPEN_PARENTH || funcType.type == VarType::Type::ERR || name.type == Token::Type::ERR) return std::make_shared<Node>();
@@ -348,10 +650,51 @@ std::shared_ptr<Node> Parser::ParseFuncDecl(const VarType &funcType, const Token
 		auto param = ParseParam();
 		if(param->type != NodeType::VARDECL) break;
 
-		params.push_back(std::dynamic_pointer_cast<VarDeclNode>(param));
+		params.push_back(std::static_pointer_cast<VarDeclNode>(param));
 		NextToken();
 	}
 	if(!params.size()) NextToken(); //For case when ) is left
+	//Member arrays of soa parameters go after all of them, the first paramCount identifiers are the parameters
+	for(auto &param: params){
+		if(param->varType->isSoa) DeclareSoaMembers(param->ident, *param->varType);
+	}
+
+	//Declared before the parameters were parsed, so it is still the last one in the enclosing scope
+	auto &self = currScope->parent->identifiers.back();
+	self.isFunction = true;
+	self.paramCount = params.size();
+	self.paramScope = currScope;
+
+	if(currTok.type == Token::Type::SEMICOLON){
+		NextToken();
+		currScope = currScope->parent;
+		return std::make_shared<FuncDeclNode>(&funcType, name, params, std::make_shared<Node>());
+	}
+
+	//Only top-level bodies are deferred, a body without its closing brace is left to the serial path
+	if(deferBodies && currScope->parent == rootNode->myScope && currTok.type == Token::Type::OPEN_BRACKET){
+		const Token *begin = tokenCursor - 1, *end = begin;
+		for(size_t depth = 0; end != tokenEnd; ++end){
+			if(end->type == Token::Type::OPEN_BRACKET) depth++;
+			else if(end->type == Token::Type::CLOSED_BRACKET && !--depth) break;
+		}
+
+		if(end != tokenEnd && ++end != tokenEnd){
+			auto func = std::make_shared<FuncDeclNode>(&funcType, name, params, nullptr);
+			auto &globals = *rootNode->myScope;
+			deferredBodies.push_back({ func, currScope, begin, end, globals.identifiers.size(), globals.types.size() });
+
+			prevEnd = end[-1].End();
+			currTok = *end;
+			tokenCursor = end + 1;
+			currScope = currScope->parent;
+			return func;
+		}
+	}
+	returnType = &funcType;
+	functionScope = currScope;
+	paramCount = params.size();
+	paramIdents = currScope->identifiers.size();
 	block = ParseBlock();
 	currScope = currScope->parent;
 
@@ -366,9 +709,25 @@ std::shared_ptr<Node> Parser::ParseParam(){
 
 	if(found.type != VarType::Type::ERR){
 		NextToken();
+		if(currTok.type == Token::Type::ERR){
+			ReportInvalidToken();
+		}
 		Token varName = NextToken();
 		currScope->identifiers.emplace_back(varName, found, nullptr);
 
+		if(currTok.type == Token::Type::OPEN_SQUARE){
+			bool isRestrict = false;
+			auto &arrayType = ParseArrayType(found, true, isRestrict);
+			currScope->identifiers.back().type = arrayType;
+
+			auto param = std::make_shared<VarDeclNode>(&arrayType, varName, std::make_shared<Node>());
+			param->isRestrict = isRestrict;
+			return param;
+		}
+		if(found.isSoa){
+			Log::Error(*this, "Soa struct '", found.name, "' can only be the element of an array");
+		}
+
 		if(currTok.type == Token::Type::COMMA || currTok.type == Token::Type::CLOSED_PARENTH)
 			return std::make_shared<VarDeclNode>(&found, varName, std::make_shared<Node>());
 		
@@ -380,6 +739,191 @@ std::shared_ptr<Node> Parser::ParseParam(){
 
 	return std::make_shared<Node>();
 }
+std::shared_ptr<Node> Parser::ParseCall(const Token &name){
+	auto &callee = FindIdent(name);
+	if(callee.type.type == VarType::Type::ERR && FindVectorBuiltin(name) != VectorBuiltin::NONE){
+		return ParseVectorBuiltin(name, FindVectorBuiltin(name));
+	}
+	if(!callee.isFunction){
+		Log::Error(*this, "'", name.Name(), "' is not a function");
+	}
+	NextToken();
+
+	std::vector<std::shared_ptr<Node>> args;
+	while(currTok.type != Token::Type::CLOSED_PARENTH){
+		size_t at = args.size();
+		auto param = callee.paramScope && at < callee.paramCount ? &callee.paramScope->identifiers[at].type : nullptr;
+
+		//Arrays are passed by name and have to match the parameter's element type. A parameter
+		//with a size promises the callee that many elements
+		if(param && param->isArray){
+			auto &arg = currTok.type == Token::Type::IDENT ? FindIdent(currTok).type : VarType::ERROR;
+			if(!arg.isArray){
+				Log::Error(*this, "Argument ", at + 1, " of '", name.Name(), "' has to be an array");
+			}
+			if(arg.type != param->type || arg.name != param->name){
+				Log::Error(*this, "Array '", currTok.Name(), "' doesn't match the element type of parameter ", at + 1, " of '", name.Name(), "'");
+			}
+			if(param->arrSize && (!arg.arrSize || arg.arrSize < param->arrSize)){
+				Log::Error(*this, "Array '", currTok.Name(), "' is smaller than parameter ", at + 1, " of '", name.Name(), "', which takes ", param->arrSize, " elements");
+			}
+			args.push_back(std::make_shared<ValNode>(NextToken()));
+
+			if(currTok.type != Token::Type::COMMA) break;
+			NextToken();
+			continue;
+		}
+
+		//Parsed above the comma operator so each argument stops at the next ','
+		auto arg = ParseExpr(Precedence(Token(Token::Type::COMMA)));
+		if(arg->type == NodeType::ERR){
+			Log::Error(*this, "Expected expression");
+		}
+		if(param) CheckConversion(*arg, *param);
+		args.push_back(arg);
+
+		if(currTok.type != Token::Type::COMMA) break;
+		NextToken();
+	}
+	Expect(Token::Type::CLOSED_PARENTH, "')'");
+
+	if(args.size() != callee.paramCount){
+		Log::Error(*this, "'", name.Name(), "' takes ", callee.paramCount, " argument", callee.paramCount == 1 ? "" : "s", ", ", args.size(), " given");
+	}
+
+	return std::make_shared<FuncCallNode>(name, args);
+}
+std::shared_ptr<Node> Parser::ParseVectorBuiltin(const Token &name, VectorBuiltin builtin){
+	Expect(Token::Type::OPEN_PARENTH, "'('");
+
+	std::vector<std::shared_ptr<Node>> args;
+	while(currTok.type != Token::Type::CLOSED_PARENTH){
+		auto arg = ParseExpr(Precedence(Token(Token::Type::COMMA)));
+		if(arg->type == NodeType::ERR){
+			Log::Error(*this, "Expected expression");
+		}
+		args.push_back(arg);
+
+		if(currTok.type != Token::Type::COMMA) break;
+		NextToken();
+	}
+	Expect(Token::Type::CLOSED_PARENTH, "')'");
+
+	auto call = std::make_shared<FuncCallNode>(name, args);
+	auto vector = args.size() ? VectorTypeOf(*args[0]) : nullptr;
+	switch(builtin){
+		case VectorBuiltin::CONSTRUCT:{
+			//Either every lane is given or one value for all of them
+			size_t lanes = VectorTypeOf(*call)->lanes;
+			if(args.size() != 1 && args.size() != lanes){
+				Log::Error(*this, "'", name.Name(), "' takes 1 or ", lanes, " values, ", args.size(), " given");
+			}
+			for(auto &arg: args){
+				if(VectorTypeOf(*arg)){
+					Log::Error(*this, "Lanes of '", name.Name(), "' have to be scalars");
+				}
+			}
+			break;
+		}
+		case VectorBuiltin::SHUFFLE:{
+			//shuffle(a, lanes...) picks lanes of a, shuffle(a, b, lanes...) of a followed by b
+			if(!vector){
+				Log::Error(*this, "'shuffle' takes a vector and the lanes to pick");
+			}
+			size_t first = 1;
+			if(args.size() > 1 && VectorTypeOf(*args[1])){
+				if(VectorTypeOf(*args[1]) != vector){
+					Log::Error(*this, "Vectors given to 'shuffle' have to be of the same type");
+				}
+				first = 2;
+			}
+
+			size_t picked = args.size() - first, sourceLanes = vector->lanes * first;
+			if(VarType::Vector(*vector->baseType, picked).type == VarType::Type::ERR){
+				Log::Error(*this, "'shuffle' picks 2, 4, 8 or 16 lanes, ", picked, " given");
+			}
+			for(size_t i = first; i < args.size(); ++i){
+				auto lane = args[i]->type == NodeType::VAL ? static_cast<ValNode&>(*args[i]).val : Token();
+				if(lane.type != Token::Type::INTEGER_NUMBER || lane.intVal < 0 || (size_t)lane.intVal >= sourceLanes){
+					Log::Error(*this, "Lanes picked by 'shuffle' have to be constants below ", sourceLanes);
+				}
+			}
+			break;
+		}
+		default:
+			if(args.size() != 1 || !vector){
+				Log::Error(*this, "'", name.Name(), "' takes one vector");
+			}
+	}
+
+	return call;
+}
+std::shared_ptr<Node> Parser::ParseIndex(const Token &name){
+	auto &array = FindIdent(name).type;
+	if(!array.isArray && !array.IsVector()){
+		Log::Error(*this, "'", name.Name(), "' is not an array or a vector");
+	}
+	NextToken();
+
+	auto index = ParseExpr();
+	if(index->type == NodeType::ERR){
+		Log::Error(*this, "Expected expression");
+	}
+	Expect(Token::Type::CLOSED_SQUARE, "']'");
+
+	//Constant subscripts are checked here, they never need a check at run time
+	if(index->type == NodeType::VAL){
+		auto &val = static_cast<ValNode&>(*index).val;
+		size_t size = array.isArray ? array.arrSize : array.lanes;
+		if(val.type == Token::Type::INTEGER_NUMBER && (val.intVal < 0 || (size && (size_t)val.intVal >= size))){
+			Log::Error(*this, "Index ", val.intVal, " is out of bounds of '", name.Name(), "'");
+		}
+	}
+
+	return std::make_shared<IndexNode>(name, index);
+}
+std::shared_ptr<Node> Parser::ParseLane(const Token &name){
+	static const std::string laneNames = "xyzw";
+	auto &vector = FindIdent(name).type;
+	NextToken();
+
+	auto &lane = currTok.type == Token::Type::IDENT ? currTok.Name() : Symbols::Name(0);
+	auto at = lane.size() == 1 ? laneNames.find(lane[0]) : std::string::npos;
+	if(at == std::string::npos || at >= vector.lanes){
+		Log::Error(*this, "Vector '", name.Name(), "' has no lane '", lane, "'");
+	}
+
+	Token index(Token::Type::INTEGER_NUMBER, currTok.offset, currTok.length);
+	index.intVal = at;
+	NextToken();
+	return std::make_shared<ValNode>(index);
+}
+const VarType &Parser::ParseArrayType(const VarType &elem, bool isParam, bool &isRestrict){
+	NextToken();
+	if(elem.type == VarType::Type::VOID){
+		Log::Error(*this, "Array of void");
+	}
+
+	isRestrict = false;
+	if(isParam && currTok.type == Token::Type::RESTRICT){
+		isRestrict = true;
+		NextToken();
+	}
+
+	size_t size = 0;
+	if(currTok.type == Token::Type::INTEGER_NUMBER){
+		if(currTok.intVal <= 0){
+			Log::Error(*this, "Array size has to be positive");
+		}
+		size = NextToken().intVal;
+	}
+	else if(!isParam){
+		Log::Error(*this, "Expected array size");
+	}
+	Expect(Token::Type::CLOSED_SQUARE, "']'");
+
+	return ArrayOf(*rootNode->myScope, elem, size);
+}
 std::shared_ptr<Node> Parser::ParseIf(){
 	std::shared_ptr<Node> ret = std::make_shared<Node>();
 	if(currTok.type == Token::Type::IF){
@@ -394,8 +938,11 @@ std::shared_ptr<Node> Parser::ParseIf(){
 		if(cond->type == NodeType::ERR) {
 			Log::Error(*this, "Invalid expression");
 		}
+		if(VectorTypeOf(*cond)){
+			Log::Error(*this, "Condition can't be a vector");
+		}
 
-		NextToken();
+		Expect(Token::Type::CLOSED_PARENTH, "')'");
 	
 		currScope->scopes.push_back(std::make_shared<Scope>());
 		currScope->scopes.back()->parent = currScope;
@@ -427,35 +974,171 @@ std::shared_ptr<Node> Parser::ParseIf(){
 
 	return ret;
 }
+//Types a tail call's caller and callee have to agree on, an array is passed as a pointer whatever its size
+static bool SameLowered(const VarType &a, const VarType &b){
+	return a.type == b.type && a.name == b.name && a.isArray == b.isArray && a.isSoa == b.isSoa;
+}
+void Parser::CheckTailCall(const Node &expr){
+	auto callee = expr.type == NodeType::FUNCTIONCALL ? &FindIdent(static_cast<const FuncCallNode&>(expr).funcName) : nullptr;
+	if(!callee || !callee->isFunction || !returnType || !functionScope){
+		Log::Error(*this, "tailcall needs a call to a function");
+	}
+	auto &call = static_cast<const FuncCallNode&>(expr);
+	auto &name = call.funcName.Name();
+
+	//The callee returns straight to the caller's caller and takes over its frame
+	if(!SameLowered(callee->type, *returnType)){
+		Log::Error(*this, "Can't tail call '", name, "', it doesn't return the caller's type");
+	}
+	bool sameParams = callee->paramScope && callee->paramCount == paramCount;
+	for(size_t i = 0; sameParams && i < paramCount; ++i)
+		sameParams = SameLowered(callee->paramScope->identifiers[i].type, functionScope->identifiers[i].type);
+	if(!sameParams){
+		Log::Error(*this, "Can't tail call '", name, "', its parameters differ from the caller's");
+	}
+
+	//Arrays are passed by address, the caller's own are gone with its frame
+	auto &globals = rootNode->myScope->identifiers;
+	auto params = functionScope->identifiers.data();
+	for(auto &arg: call.params){
+		if(arg->type != NodeType::VAL || static_cast<const ValNode&>(*arg).val.type != Token::Type::IDENT) continue;
+
+		auto &array = static_cast<const ValNode&>(*arg).val;
+		auto &var = FindIdent(array);
+		bool isGlobal = &var >= globals.data() && &var < globals.data() + globals.size();
+		bool isParam = &var >= params && &var < params + paramIdents;
+		if(var.type.isArray && !isGlobal && !isParam){
+			Log::Error(*this, "Can't tail call '", name, "' with local array '", array.Name(), "'");
+		}
+	}
+}
+std::shared_ptr<Node> Parser::ParseSwitch(){
+	NextToken();
+	if(currTok.type != Token::Type::OPEN_PARENTH){
+		Log::Error(*this, "Missing (");
+	}
+	NextToken();
+
+	auto value = ParseExpr();
+	if(value->type == NodeType::ERR){
+		Log::Error(*this, "Invalid expression");
+	}
+	if(VectorTypeOf(*value)){
+		Log::Error(*this, "Switch value can't be a vector");
+	}
+	Expect(Token::Type::CLOSED_PARENTH, "')'");
+	if(currTok.type != Token::Type::OPEN_BRACKET){
+		Log::Error(*this, "Missing {");
+	}
+	NextToken();
+
+	std::vector<std::shared_ptr<CaseNode>> cases;
+	std::unordered_set<std::int64_t> seen;
+	bool hasDefault = false;
+	while(currTok.type != Token::Type::CLOSED_BRACKET){
+		std::vector<std::shared_ptr<ValNode>> labels;
+		bool isDefault = false;
+		while(currTok.type == Token::Type::CASE || currTok.type == Token::Type::DEFAULT){
+			if(NextToken().type == Token::Type::DEFAULT){
+				if(hasDefault){
+					Log::Error(*this, "Switch already has a default");
+				}
+				hasDefault = isDefault = true;
+			}
+			else{
+				if(currTok.type != Token::Type::INTEGER_NUMBER && currTok.type != Token::Type::CHAR_LITERAL){
+					Log::Error(*this, "Case label has to be an integer or character constant");
+				}
+				if(!seen.insert(currTok.intVal).second){
+					Log::Error(*this, "Duplicate case label");
+				}
+				labels.push_back(std::make_shared<ValNode>(NextToken()));
+			}
+			Expect(Token::Type::COLON, "':'");
+		}
+		if(labels.empty() && !isDefault){
+			Log::Error(*this, currTok.type == Token::Type::TEOF ? "Missing }" : "Expected case or default");
+		}
+
+		//The statements up to the next label, each arm gets a scope of its own
+		currScope->scopes.push_back(std::make_shared<Scope>());
+		currScope->scopes.back()->parent = currScope;
+		currScope = currScope->scopes.back();
+		auto body = std::make_shared<BlockNode>(std::vector<std::shared_ptr<Node>>(), currScope);
+		while(currTok.type != Token::Type::CASE && currTok.type != Token::Type::DEFAULT && currTok.type != Token::Type::CLOSED_BRACKET){
+			if(currTok.type == Token::Type::TEOF){
+				currScope = currScope->parent;
+				Log::Error(*this, "Missing }");
+			}
+
+			auto stmt = ParseStmtOrRecover(false);
+			if(stmt->type != NodeType::ERR)
+				body->AddStmt(stmt);
+		}
+		currScope = currScope->parent;
+
+		cases.push_back(std::make_shared<CaseNode>(labels, body, isDefault));
+	}
+	NextToken();
+
+	return std::make_shared<SwitchNode>(value, cases);
+}
 std::shared_ptr<Node> Parser::ParseVarDecl(){
 	Token typeName = currTok;
 	auto &found = FindType(typeName);
 
 	if(found.type != VarType::Type::ERR){
 		NextToken();
+		if(currTok.type == Token::Type::ERR){
+			ReportInvalidToken();
+		}
 
 		Token varName = NextToken();
 		currScope->identifiers.emplace_back(varName, found, nullptr);
 
+		if(currTok.type == Token::Type::OPEN_SQUARE){
+			bool isRestrict = false;
+			auto &arrayType = ParseArrayType(found, false, isRestrict);
+			currScope->identifiers.back().type = arrayType;
+			if(arrayType.isSoa) DeclareSoaMembers(varName, arrayType);
+			if(currTok.type == Token::Type::ASSIGN){
+				Log::Error(*this, "Arrays can't have an initializer");
+			}
+			if(currTok.type != Token::Type::SEMICOLON){
+				Log::Error(*this, "Expected ';' after declaration of '", varName.Name(), "'");
+			}
+			return std::make_shared<VarDeclNode>(&arrayType, varName, std::make_shared<Node>());
+		}
+		if(found.isSoa){
+			Log::Error(*this, "Soa struct '", found.name, "' can only be the element of an array");
+		}
+
 		if(currTok.type == Token::Type::SEMICOLON)
 			return std::make_shared<VarDeclNode>(&found, varName, std::make_shared<Node>());
 		
 		if(currTok.type == Token::Type::ASSIGN){
 			NextToken();
-			return std::make_shared<VarDeclNode>(&found, varName, ParseExpr());
+			auto init = ParseExpr();
+			if(init->type == NodeType::ERR){
+				Log::Error(*this, "Expected expression");
+			}
+			CheckConversion(*init, found);
+			return std::make_shared<VarDeclNode>(&found, varName, init);
 		}
 
 		if(currTok.type == Token::Type::OPEN_PARENTH){
 			return ParseFuncDecl(found, varName);
 		}
+
+		Log::Error(*this, "Expected ';' after declaration of '", varName.Name(), "'");
 	}
 
-	Log::Error(*this, "Type ", currTok.val, " not found");
-	return std::make_shared<Node>();
+	Log::Error(*this, "Type ", currTok.Name(), " not found");
 }
 
 std::shared_ptr<Node> Parser::ParseExpr(int parentPrecedence){
 	auto left = ParsePrimary();
+	auto leftVector = VectorTypeOf(*left);
 
 	while(true){
 		auto precedence = Precedence(currTok);
@@ -465,21 +1148,124 @@ std::shared_ptr<Node> Parser::ParseExpr(int parentPrecedence){
 		Token operand = NextToken();
 		auto right = ParseExpr(precedence);
 		left = std::make_shared<BinaryNode>(left, operand, right);
+
+		//Vectors are worked on lane by lane, a scalar operand goes to every lane
+		auto rightVector = VectorTypeOf(*right);
+		if(!leftVector && !rightVector) continue;
+		if(operand.type != Token::Type::PLUS && operand.type != Token::Type::MINUS && operand.type != Token::Type::STAR && operand.type != Token::Type::SLASH){
+			Log::Error(*this, "Vectors only support +, -, * and /");
+		}
+		if(leftVector && rightVector && leftVector != rightVector){
+			Log::Error(*this, "Operands of types ", leftVector->name, " and ", rightVector->name, " don't match");
+		}
+		if(!leftVector) leftVector = rightVector;
 	}
 
 	return left;
 }
+const VarType *Parser::VectorTypeOf(const Node &expr) const{
+	auto vectorOf = [](const VarType &type){
+		return type.type == VarType::Type::VECTOR ? &VarType::Vector(*type.baseType, type.lanes) : nullptr;
+	};
+
+	switch(expr.type){
+		case NodeType::VAL:{
+			auto &val = static_cast<const ValNode&>(expr).val;
+			if(val.type != Token::Type::IDENT) return nullptr;
+			auto &type = FindIdent(val).type;
+			return type.isArray ? nullptr : vectorOf(type);
+		}
+		case NodeType::INDEX:{
+			//An array of vectors gives a vector, a vector one of its lanes
+			auto &type = FindIdent(static_cast<const IndexNode&>(expr).array).type;
+			return type.isArray ? vectorOf(type) : nullptr;
+		}
+		case NodeType::FUNCTIONCALL:{
+			auto &call = static_cast<const FuncCallNode&>(expr);
+			auto &callee = FindIdent(call.funcName);
+			if(callee.isFunction) return vectorOf(callee.type);
+
+			switch(FindVectorBuiltin(call.funcName)){
+				case VectorBuiltin::CONSTRUCT:
+					return &VarType::Vector(call.funcName.Name());
+				case VectorBuiltin::SHUFFLE:{
+					auto source = call.params.size() ? VectorTypeOf(*call.params[0]) : nullptr;
+					if(!source) return nullptr;
+					size_t first = call.params.size() > 1 && VectorTypeOf(*call.params[1]) ? 2 : 1;
+					auto &picked = VarType::Vector(*source->baseType, call.params.size() - first);
+					return picked.type == VarType::Type::ERR ? nullptr : &picked;
+				}
+				default:
+					return nullptr;
+			}
+		}
+		case NodeType::BINARY:{
+			auto &binary = static_cast<const BinaryNode&>(expr);
+			auto lhs = VectorTypeOf(*binary.lhs);
+			return lhs ? lhs : VectorTypeOf(*binary.rhs);
+		}
+		default:
+			return nullptr;
+	}
+}
+void Parser::CheckConversion(const Node &expr, const VarType &type){
+	//A scalar goes to every lane of a vector, vectors convert lane by lane
+	auto vector = VectorTypeOf(expr);
+	if(!vector) return;
+
+	if(!type.IsVector()){
+		Log::Error(*this, "Vector of type ", vector->name, " can't be converted to a scalar");
+	}
+	if(vector->lanes != type.lanes){
+		Log::Error(*this, "Vector of type ", vector->name, " can't be converted to ", type.name);
+	}
+}
+void Parser::CheckInputSize(){
+	if(!tokenizer.TooLarge()) return;
+	try{
+		Log::ErrorAt(*this, Token(Token::Type::TEOF, Tokenizer::NO_LIMIT), "Input is larger than 4 GiB, the rest of it was not read");
+	}
+	catch(const Diagnostics::LimitReached&){}
+}
+void Parser::ReportInvalidToken(){
+	if(currTok.length == Token::MAX_LENGTH){
+		Log::Error(*this, "Token is longer than ", Token::MAX_LENGTH, " characters");
+	}
+	CheckSymbol(currTok);
+	Log::Error(*this, "Invalid token");
+}
+void Parser::CheckSymbol(const Token &name){
+	if(name.symbol == Symbols::FULL){
+		Log::Error(*this, "Too many distinct names and strings, the symbol table is full");
+	}
+}
 std::shared_ptr<Node> Parser::ParsePrimary(){
 	std::shared_ptr<Node> ret = std::make_shared<Node>();
+	if(currTok.type == Token::Type::ERR && (currTok.length == Token::MAX_LENGTH || currTok.symbol == Symbols::FULL)){
+		ReportInvalidToken();
+	}
 	if((int)currTok.type >= (int)Token::Type::VALUES_BEGIN && (int)currTok.type <= (int)Token::Type::VALUES_END) {
 		ret = std::make_shared<ValNode>(NextToken());
 	}
 	else if(currTok.type == Token::Type::IDENT){
 		auto tmpName = NextToken();
+		if(currTok.type == Token::Type::OPEN_PARENTH)
+			return ParseCall(tmpName);
+		if(currTok.type == Token::Type::OPEN_SQUARE){
+			auto element = ParseIndex(tmpName);
+			if(!FindIdent(tmpName).type.isSoa) return element;
+			return std::make_shared<IndexNode>(ParseSoaMember(tmpName), std::static_pointer_cast<IndexNode>(element)->index);
+		}
+
 		auto type = FindIdent(tmpName).type;
 		if(type.type == VarType::Type::ERR){
-			Log::Error(*this, "Variable '", tmpName.val, "' not found\n");
+			Log::Error(*this, "Variable '", tmpName.Name(), "' not found\n");
 		}
+		if(type.isArray){
+			Log::Error(*this, "Array '", tmpName.Name(), "' can only be subscripted or passed to a function");
+		}
+		if(type.IsVector() && currTok.type == Token::Type::DOT)
+			return std::make_shared<IndexNode>(tmpName, ParseLane(tmpName));
 
 		while(true){
 			if(currTok.type != Token::Type::DOT && currTok.type != Token::Type::DEREFERENCE) break;
@@ -492,11 +1278,11 @@ std::shared_ptr<Node> Parser::ParsePrimary(){
 
 			auto member = std::find_if(type.members.begin(), type.members.end(), 
 				[&tok](const Member &memb){
-					return memb.name == tok.val;
+					return memb.name == tok.Name();
 				}
 			);
 			if(member == type.members.end()){
-				Log::Error(*this, "Member '", currTok.val, "' not found\n");
+				Log::Error(*this, "Member '", currTok.Name(), "' not found\n");
 			}
 
 			NextToken();
@@ -508,6 +1294,14 @@ std::shared_ptr<Node> Parser::ParsePrimary(){
 
 		return std::make_shared<ValNode>(tmpName);
 	}
+	else if(currTok.type == Token::Type::TYPE_VECTOR){
+		//Constructors are calls named after their type
+		Token type = NextToken();
+		Token name(Token::Type::IDENT, type.offset, type.length);
+		name.symbol = Symbols::Intern(FindType(type).name);
+		CheckSymbol(name);
+		return ParseVectorBuiltin(name, VectorBuiltin::CONSTRUCT);
+	}
 	else if(currTok.type == Token::Type::OPEN_PARENTH){
 		NextToken();
 		ret = ParseExpr();
@@ -515,7 +1309,7 @@ std::shared_ptr<Node> Parser::ParsePrimary(){
 	return ret;
 }
 
-Parser::Parser(Tokenizer &tok, const std::string &fileName_): tokenizer(tok), fileName(fileName_) {
+Parser::Parser(Tokenizer &tok, const std::string &fileName_, Diagnostics &diag_): tokenizer(tok), fileName(fileName_), diag(diag_) {
 	primitives[Token::Type::TYPE_VOID] = VarType(VarType::Type::VOID, std::string(), 0, nullptr, std::vector<Member>(), false, false, 0);
 	primitives[Token::Type::TYPE_CHAR] = VarType(VarType::Type::CHAR, std::string(), 1, nullptr, std::vector<Member>(), false, false, 0);
 	primitives[Token::Type::TYPE_SHORT] = VarType(VarType::Type::SHORT, std::string(), 2, nullptr, std::vector<Member>(), false, false, 0);
@@ -524,9 +1318,26 @@ Parser::Parser(Tokenizer &tok, const std::string &fileName_): tokenizer(tok), fi
 	primitives[Token::Type::TYPE_FLOAT] = VarType(VarType::Type::FLOAT, std::string(), 4, nullptr, std::vector<Member>(), false, false, 0);
 	primitives[Token::Type::TYPE_DOUBLE] = VarType(VarType::Type::DOUBLE, std::string(), 8, nullptr, std::vector<Member>(), false, false, 0);
 
-	currTok = tokenizer.NextToken();
-	currScope = std::make_shared<Scope>();
-	rootNode = std::make_shared<BlockNode>(std::vector<std::shared_ptr<Node>>(), currScope);
+	Reset();
+}
+Parser::Parser(const Parser &parent, Diagnostics &diag_, const DeferredBody &body)
+	: rootNode(parent.rootNode), tokenizer(parent.tokenizer), currScope(body.scope), fileName(parent.fileName), diag(diag_) {
+	//The body sees the globals declared before it, same as in a serial parse
+	auto &globals = *rootNode->myScope;
+	hiddenIdentsBegin = body.visibleIdents;
+	hiddenIdentsEnd = globals.identifiers.size();
+	hiddenTypesBegin = body.visibleTypes;
+	hiddenTypesEnd = globals.types.size();
+
+	returnType = body.func->funcType;
+	functionScope = body.scope;
+	paramCount = body.func->params.size();
+	paramIdents = body.scope->identifiers.size();
+	fixedWindow = true;
+	endToken = *body.end;
+	currTok = *body.begin;
+	tokenCursor = body.begin + 1;
+	tokenEnd = body.end;
 }
 
 VarType::VarType(
@@ -544,225 +1355,5 @@ VarType::VarType(
 VarType::VarType(const VarType &other)
 		:type(other.type), name(other.name), typeSz(other.typeSz), 
 		baseType(other.baseType), members(other.members), isUnsigned(other.isUnsigned), 
-		isArray(other.isArray), arrSize(other.arrSize){}
-
-llvm::Type *VarType::Codegen() const {
-	if(type == Type::PTR){
-		switch(type){
-			case Type::VOID:
-				return llvm::Type::getInt64Ty(*context);
-			case Type::CHAR:
-				return llvm::Type::getInt8PtrTy(*context);
-			case Type::SHORT:
-				return llvm::Type::getInt16PtrTy(*context);
-			case Type::INT:
-				return llvm::Type::getInt32PtrTy(*context);
-			case Type::LONG:
-				return llvm::Type::getInt64PtrTy(*context);
-			case Type::FLOAT:
-				return llvm::Type::getFloatPtrTy(*context);
-			case Type::DOUBLE:
-				return llvm::Type::getDoublePtrTy(*context);
-		}
-	}
-	else {
-		switch(type){
-			case Type::VOID:
-				return llvm::Type::getVoidTy(*context);
-			case Type::CHAR:
-				return llvm::Type::getInt8Ty(*context);
-			case Type::SHORT:
-				return llvm::Type::getInt16Ty(*context);
-			case Type::INT:
-				return llvm::Type::getInt32Ty(*context);
-			case Type::LONG:
-				return llvm::Type::getInt64Ty(*context);
-			case Type::FLOAT:
-				return llvm::Type::getFloatTy(*context);
-			case Type::DOUBLE:
-				return llvm::Type::getDoubleTy(*context);
-		}
-	}
-
-	std::cerr << "Type not found\n";
-	return nullptr;
-}
-llvm::Value *ValNode::Codegen() {
-	if((int)val.type >= (int)Token::Type::VALUES_BEGIN && (int)val.type <= (int)Token::Type::VALUES_END){
-		switch(val.type){
-			case Token::Type::INTEGER_NUMBER:
-				return llvm::ConstantInt::get(llvm::Type::getInt32Ty(*context), val.val, 10);
-			case Token::Type::FLOATING_NUMBER:
-				return llvm::ConstantFP::get(*context, llvm::APFloat(std::stod(val.val)));
-			default:
-				return nullptr;
-		}
-	}
-
-	auto ident = currParser->FindIdent(val);
-	if(ident.type.type == VarType::Type::ERR) 
-		std::cerr << "Invalid variable referenced\n";
-	return ident.val;
-}
-llvm::Value *BinaryNode::Codegen() {
-	auto l = lhs->Codegen();
-	auto r = rhs->Codegen();
-
-	if(!l || !r) return nullptr;
-
-	switch(operand.type){
-		case Token::Type::PLUS:
-			return builder->CreateFAdd(l, r, "addtmp");
-		case Token::Type::MINUS:
-			return builder->CreateFSub(l, r, "subtemp");
-		case Token::Type::STAR:
-			return builder->CreateFMul(l, r, "multemp");
-		case Token::Type::SLASH:
-			return builder->CreateFDiv(l, r, "divtemp");
-		case Token::Type::GREATER:
-		case Token::Type::GEQ:
-		case Token::Type::LESS:
-		case Token::Type::LEQ:
-			return builder->CreateUIToFP(l, llvm::Type::getDoubleTy(*context), "booltmp");
-		default:
-			std::cerr << "Invalid operantor\n";
-			return nullptr;
-	}
-}
-llvm::Value *VarDeclNode::Codegen() {
-	auto &ident = currParser->FindIdent(this->ident);
-	llvm::Value *toRet = nullptr;
-	if(varType->isArray){
-		toRet = builder->CreateAlloca(
-			varType->Codegen(),
-			0, 
-			llvm::ConstantInt::get(*context, llvm::APInt(64, varType->arrSize, false)),
-			this->ident.val
-		);
-
-		if(initial){ builder->CreateStore(toRet, initial->Codegen(), false); }
-		ident.val = toRet;
-
-		return toRet;
-	}
-
-	toRet = builder->CreateAlloca(varType->Codegen(), 0, nullptr, this->ident.val);
-	
-	if(initial->type != NodeType::ERR){ builder->CreateStore(toRet, initial->Codegen(), false); }
-	ident.val = toRet;
+		isArray(other.isArray), arrSize(other.arrSize), lanes(other.lanes), isSoa(other.isSoa){}
 
-	return toRet;
-}
-llvm::Value *BlockNode::Codegen() {
-	auto parentScope = currParser->GetScope();
-	currParser->SetScope(myScope);
-
-	for(auto &node: stmts){
-		llvm::Value *ret = node->Codegen();
-		if(false){
-			std::cerr << "Node: ";
-			ret->print(llvm::errs());
-			std::cerr << "\n";
-		}
-
-		std::string error_str;
-  		llvm::raw_string_ostream ostream{error_str};
-		if(llvm::verifyModule(*module, &ostream)){
-			std::cout << "Error in IR: " << GetIR() << "\nERROR: " << error_str << "\n\n";
-		}
-	}
-
-	currParser->SetScope(parentScope);
-
-	return nullptr;
-}
-llvm::Value *MemberNode::Codegen() {
-	return nullptr;
-}
-llvm::Value *FuncDeclNode::Codegen() {
-	auto func = llvm::Function::Create(
-		llvm::FunctionType::get(funcType->Codegen(), false), 
-		llvm::Function::ExternalLinkage, 
-		ident.val, 
-		*module
-	);
-
-	auto body = llvm::BasicBlock::Create(*context, "entry", func);
-	builder->SetInsertPoint(body);
-	auto lastScope = currentScope;
-
-	currentScope = body;
-	currFunc = func;
-	if(block){
-		block->Codegen();
-	}
-	currFunc = nullptr;
-	currentScope = lastScope;
-
-	//llvm::verifyFunction(*func);
-
-	return func;
-}
-llvm::Value *VarAssignNode::Codegen() {
-	const auto &varFind = currParser->FindIdent(varName);
-	if(varFind.type.type != VarType::Type::ERR){
-		return builder->CreateStore(varFind.val, expression->Codegen(), false);
-	}
-
-	std::cerr << "Invalid type of variable " << varFind.ident.val << "\n";
-	return nullptr;
-}
-llvm::Value *WhileNode::Codegen() {
-	return nullptr;
-}
-llvm::Value *IfNode::Codegen() {
-	auto condVal = cond->Codegen();
-	condVal = builder->CreateFCmpONE(condVal, llvm::ConstantFP::get(*context, llvm::APFloat(0.0f)), "ifcond");
-	auto func = builder->GetInsertBlock()->getParent();
-
-	auto thenBB = llvm::BasicBlock::Create(*context, "then", func);
-	auto elseBB = llvm::BasicBlock::Create(*context, "else");
-	auto mergeBB = llvm::BasicBlock::Create(*context, "ifcond");
-
-	builder->CreateCondBr(condVal, thenBB, elseBB);
-
-	builder->SetInsertPoint(thenBB);
-	auto thenVal = then->Codegen();
-	if(!thenVal) return nullptr;
-
-	builder->CreateBr(mergeBB);
-
-	thenBB = builder->GetInsertBlock();
-
-	llvm::Value *elseVal = nullptr;
-
-	func->getBasicBlockList().push_back(elseBB);
-	builder->SetInsertPoint(elseBB);
-
-	if(elseBody){
-		elseVal = elseBody->Codegen();
-
-		if(!elseVal) return nullptr;
-	}
-	builder->CreateBr(mergeBB);
-
-	elseBB = builder->GetInsertBlock();
-
-	func->getBasicBlockList().push_back(mergeBB);
-	builder->SetInsertPoint(mergeBB);
-	auto pn = builder->CreatePHI(llvm::Type::getDoubleTy(*context), (bool)then + (bool)elseBody, "iftmp");
-
-	pn->addIncoming(thenVal, thenBB);
-	if(elseBody){
-		pn->addIncoming(elseVal, elseBB);
-	}
-
-	return pn;
-}
-llvm::Value *ReturnNode::Codegen() {
-	llvm::Value *ret = nullptr;
-	if(expr->type == NodeType::ERR){ ret = builder->CreateRetVoid(); }
-	else { ret = builder->CreateRet(expr->Codegen()); }
-
-	return ret;
-}
\ No newline at end of file
@@ -1,8 +1,11 @@
 #pragma once
 
+#include <map>
 #include <memory>
 #include <vector>
+#include <thread>
 #include <utility>
+#include <algorithm>
 #include <iostream>
 #include <functional>
 #include <unordered_map>
@@ -10,8 +13,12 @@
 #include <llvm/IR/Value.h>
 
 #include "tokenizer/tokenizer.hpp"
+#include "tokenizer/lexerthread.hpp"
+#include "util/diagnostics.hpp"
 
 struct VarType;
+class Profile;
+class Target;
 struct Member{
 	const VarType *type = nullptr;
 	std::string name = "";
@@ -33,6 +40,7 @@ struct VarType{
 		FLOAT,
 		DOUBLE,
 		STRUCT,
+		VECTOR,
 
 		PTR
 	};
@@ -41,7 +49,7 @@ struct VarType{
 	std::string name;
 	size_t typeSz;
 
-	//For pointers
+	//For pointers, the element of a vector
 	VarType *baseType;
 
 	//For objects
@@ -49,12 +57,21 @@ struct VarType{
 
 	bool isUnsigned, isArray;
 	size_t arrSize;
+	//Elements of a vector
+	size_t lanes = 0;
+	//Arrays of a soa struct hold one array per member instead of whole structs
+	bool isSoa = false;
 
 	explicit VarType(): type(Type::ERR), name(), baseType(), members(), isUnsigned(false), isArray(false), arrSize(0), typeSz(0) {}
 	VarType(Type type_, std::string name_, size_t typeSz_, VarType *baseType_, const std::vector<Member> &members_, bool isUnsigned_, bool isArray_, size_t arrSize_);
 	VarType(const VarType &other);
 
 	static const VarType ERROR;
+	//The vector of lanes scalar elements, ERROR if there is no such type
+	static const VarType &Vector(const VarType &element, size_t lanes);
+	//The vector type spelled name, like float4
+	static const VarType &Vector(std::string_view name);
+	bool IsVector() const { return type == Type::VECTOR && !isArray; }
 
 	llvm::Type *Codegen() const;
 };
@@ -64,17 +81,28 @@ struct Scope{
 		Token ident;
 		VarType type;
 		llvm::Value *val = nullptr;
+		//For functions type is the return type, calls are checked against the parameter count
+		bool isFunction = false;
+		size_t paramCount = 0;
+		//The function's own scope, its first paramCount identifiers are the parameters
+		std::shared_ptr<Scope> paramScope;
 
 		explicit Variable() = default;
 		Variable(Token ident_, VarType type_, llvm::Value *val_): ident(ident_), type(type_), val(val_) {}
-		Variable(const Variable &other): ident(other.ident), type(other.type), val(other.val) {}
+		Variable(const Variable &other): ident(other.ident), type(other.type), val(other.val), isFunction(other.isFunction), paramCount(other.paramCount), paramScope(other.paramScope) {}
+		Variable &operator=(const Variable &other) = default;
 	};
 	
 	std::vector<VarType> types;
 	std::vector<Variable> identifiers;
 	std::vector<std::shared_ptr<Scope>> scopes;
 	std::shared_ptr<Scope> parent;
+	//Array types of the tree by element and size, only the outermost scope has any
+	std::map<std::pair<const VarType*, size_t>, VarType> arrayTypes;
 	Scope() = default;
+
+	//Walks outwards from scope, isGlobal is set when the name was found in the outermost scope
+	static Variable &Lookup(std::shared_ptr<Scope> scope, const Token &name, bool *isGlobal = nullptr);
 };
 
 enum class NodeType{
@@ -87,25 +115,24 @@ enum class NodeType{
 	FUNCDECL,
 	IF,
 	WHILE,
+	SWITCH,
+	CASE,
 	RETURN,
 	FUNCTIONCALL,
 	VARASSIGN,
-	MEMBER
+	MEMBER,
+	INDEX
 };
 struct Node{
 	NodeType type;
 
 	explicit Node(NodeType type = NodeType::ERR): type(type) {}
 	virtual ~Node() = default;
-	
-	virtual llvm::Value *Codegen() { return nullptr; }
 };
 struct ValNode: public Node{
 	Token val;
 
 	ValNode(const Token &tok): val(tok), Node(NodeType::VAL) {}
-
-	llvm::Value *Codegen() override;
 };
 struct BinaryNode: public Node{
 	std::shared_ptr<Node> lhs, rhs;
@@ -113,17 +140,15 @@ struct BinaryNode: public Node{
 
 	BinaryNode(std::shared_ptr<Node> lhs_, const Token &operand_, std::shared_ptr<Node> rhs_)
 		: lhs(lhs_), operand(operand_), rhs(rhs_), Node(NodeType::BINARY) {}
-
-	llvm::Value *Codegen() override;
 };
 struct VarDeclNode: public Node{
 	const VarType *varType;
 	Token ident;
 	std::shared_ptr<Node> initial;
+	//Array parameters declared restrict, nothing else the function reaches aliases them
+	bool isRestrict = false;
 
 	VarDeclNode(const VarType *varType_, Token ident_, std::shared_ptr<Node> init): varType(varType_), ident(ident_), initial(init), Node(NodeType::VARDECL) {}
-
-	llvm::Value *Codegen() override;
 };
 struct BlockNode: public Node{
 	std::vector<std::shared_ptr<Node>> stmts;
@@ -134,25 +159,30 @@ struct BlockNode: public Node{
 	BlockNode(const BlockNode &other): stmts(other.stmts), myScope(other.myScope), Node(NodeType::BLOCK) {}
 
 	void AddStmt(std::shared_ptr<Node> stmt){ stmts.push_back(stmt); }
-	llvm::Value *Codegen() override;
 };
 struct FuncDeclNode: public Node{
 	const VarType *funcType;
 	Token ident;
 	std::vector<std::shared_ptr<VarDeclNode>> params;
 	std::shared_ptr<Node> block;
+	bool isExported = false;
+	//Declared inline, the inliner takes it at a much larger size
+	bool isInline = false;
+	//Cleared by the call graph pass when nothing can reach the function
+	bool isReachable = true;
 
 	FuncDeclNode(const VarType *funcType_, const Token &ident_, const std::vector<std::shared_ptr<VarDeclNode>> &params_, std::shared_ptr<Node> block_)
 		:funcType(funcType_), ident(ident_), params(params_), block(block_), Node(NodeType::FUNCDECL) {}
 
-	llvm::Value *Codegen() override;
+	//Declared with ';' instead of a body, defined in another file
+	bool IsPrototype() const { return block && block->type == NodeType::ERR; }
 };
 struct ReturnNode: public Node{
 	std::shared_ptr<Node> expr;
+	//Written as return tailcall f(...), the call has to reuse the caller's frame
+	bool isTailCall = false;
 
 	ReturnNode(std::shared_ptr<Node> expr_): expr(expr_), Node(NodeType::RETURN) {}
-
-	llvm::Value *Codegen() override;
 };
 struct IfNode: public Node{
 	std::shared_ptr<Node> cond;
@@ -162,25 +192,38 @@ struct IfNode: public Node{
 	explicit IfNode(): Node(NodeType::IF) {}
 	IfNode(std::shared_ptr<Node> cond_, std::shared_ptr<Node> then_, std::shared_ptr<Node> elseBody_)
 		:cond(cond_), then(then_), elseBody(elseBody_), Node(NodeType::IF) {}
-
-	llvm::Value *Codegen() override;
 };
 struct WhileNode: public Node{
 	std::shared_ptr<Node> cond, then;
 
 	WhileNode(std::shared_ptr<Node> cond_, std::shared_ptr<Node> then_)
 		:cond(cond_), then(then_), Node(NodeType::WHILE) {}
+};
+//One arm of a switch, taken for any of its labels. There's no fallthrough, labels written one
+//after the other share the arm instead
+struct CaseNode: public Node{
+	std::vector<std::shared_ptr<ValNode>> labels;
+	std::shared_ptr<Node> body;
+	bool isDefault;
+
+	CaseNode(const std::vector<std::shared_ptr<ValNode>> &labels_, std::shared_ptr<Node> body_, bool isDefault_)
+		:labels(labels_), body(body_), isDefault(isDefault_), Node(NodeType::CASE) {}
+};
+struct SwitchNode: public Node{
+	std::shared_ptr<Node> value;
+	std::vector<std::shared_ptr<CaseNode>> cases;
 
-	llvm::Value *Codegen() override;
+	SwitchNode(std::shared_ptr<Node> value_, const std::vector<std::shared_ptr<CaseNode>> &cases_)
+		:value(value_), cases(cases_), Node(NodeType::SWITCH) {}
 };
 struct VarAssignNode: public Node{
 	Token varName;
 	std::shared_ptr<Node> expression;
+	//Element assigned to for an array, empty otherwise
+	std::shared_ptr<Node> index;
 
-	VarAssignNode(const Token &varName_, std::shared_ptr<Node> expression_)
-		:varName(varName_), expression(expression_), Node(NodeType::VARASSIGN) {}
-
-	llvm::Value *Codegen() override;
+	VarAssignNode(const Token &varName_, std::shared_ptr<Node> expression_, std::shared_ptr<Node> index_ = std::make_shared<Node>())
+		:varName(varName_), expression(expression_), index(index_), Node(NodeType::VARASSIGN) {}
 };
 struct FuncCallNode: public Node{
 	Token funcName;
@@ -188,15 +231,32 @@ struct FuncCallNode: public Node{
 
 	FuncCallNode(const Token &funcName_, const std::vector<std::shared_ptr<Node>> &params_)
 		:funcName(funcName_), params(params_), Node(NodeType::FUNCTIONCALL) {}
-
-	llvm::Value *Codegen() override;
 };
 struct MemberNode: public Node{
 	Member member;
 	MemberNode(Member member_):member(member_), Node(NodeType::MEMBER) {}
+};
+struct IndexNode: public Node{
+	Token array;
+	std::shared_ptr<Node> index;
+
+	IndexNode(const Token &array_, std::shared_ptr<Node> index_): array(array_), index(index_), Node(NodeType::INDEX) {}
+};
 
-	llvm::Value *Codegen() override;
+//Functions on vectors the language provides. Calls to them are FuncCallNodes named after the
+//built-in, or after the vector type for a constructor like float4(x, y, z, w)
+enum class VectorBuiltin{
+	NONE,
+	CONSTRUCT,
+	SHUFFLE,
+	REDUCE_ADD,
+	REDUCE_MUL,
+	REDUCE_MIN,
+	REDUCE_MAX
 };
+VectorBuiltin FindVectorBuiltin(const Token &name);
+//A member of a soa array is an array of its own, declared as array.member
+Token SoaMember(const Token &array, const Member &member);
 
 class Parser{
 	public:
@@ -206,32 +266,177 @@ class Parser{
 
 	Tokenizer &tokenizer;
 	Token currTok;
+	//End offset of the last consumed token
+	std::uint32_t prevEnd = 0;
 	std::shared_ptr<Scope> currScope;
+	bool lazyCodegen = true;
+	bool verbose = false;
+	bool inlining = true;
+	bool boundsChecks = false;
+	bool constEval = true;
+	unsigned codegenThreads = 1;
+	bool pipelinedLexer = false;
+	unsigned parseThreads = 1;
+	std::string profileGeneratePath;
+	const Profile *profile = nullptr;
+	const Target *target = nullptr;
+	//Only alive during Parse(), owns the tokenizer while it is
+	std::unique_ptr<LexerThread> lexerThread;
+
+	//Tokens are consumed from a window that Refill() tops up from the lexer thread or the
+	//tokenizer. A fixed window is a slice of pre-lexed tokens and ends in endToken
+	Token tokenBuffer[LexerThread::BATCH];
+	const Token *tokenCursor = nullptr, *tokenEnd = nullptr;
+	bool fixedWindow = false, sourceEnded = false;
+	Token endToken;
+
+	//A top-level function body left for a worker thread, along with what it may see
+	struct DeferredBody{
+		std::shared_ptr<FuncDeclNode> func;
+		std::shared_ptr<Scope> scope;
+		const Token *begin, *end;
+		size_t visibleIdents, visibleTypes;
+	};
+	bool deferBodies = false;
+	std::vector<DeferredBody> deferredBodies;
+	//Return type of the function whose body is being parsed
+	const VarType *returnType = nullptr;
+	//Scope of that function, its first paramIdents identifiers are the parameters and the
+	//member arrays of soa ones
+	std::shared_ptr<Scope> functionScope;
+	size_t paramCount = 0, paramIdents = 0;
+
+	//Where a top-level statement came from and what it added to the global scope,
+	//so an edit can re-parse just the statements it touched
+	struct TopLevelDecl{
+		std::shared_ptr<Node> node;
+		std::uint32_t begin, end;
+		size_t identsBegin, identCount;
+		size_t typesBegin, typeCount;
+		size_t scopesBegin, scopeCount;
+		//Index in the root block, struct declarations don't add a statement
+		size_t stmtIndex;
+		//How many of pendingShifts its offsets already include
+		size_t shifted;
+	};
+	std::vector<TopLevelDecl> topLevelDecls;
+	bool haveSpans = false;
+	//Offset and size change of each edit whose shift hasn't been applied to the statements after
+	//it yet. Until the tree is read again, an edit only touches what it re-parses
+	std::vector<std::pair<std::uint32_t, std::uint32_t>> pendingShifts;
+	static constexpr size_t MAX_PENDING_SHIFTS = 256;
+	//While re-parsing, globals from the edited statements onwards are out of scope
+	size_t hiddenIdentsBegin = 0, hiddenIdentsEnd = 0;
+	size_t hiddenTypesBegin = 0, hiddenTypesEnd = 0;
 
 	Token NextToken(){
 		Token ret = currTok;
-		currTok = tokenizer.NextToken();
+		prevEnd = ret.End();
+		currTok = tokenCursor != tokenEnd ? *tokenCursor++ : Refill();
 		return ret;
 	}
+	Token Refill();
+	//Drops whatever was read ahead and continues lexing at offset
+	void StartAt(std::uint32_t offset);
 
 	std::shared_ptr<Node> ParseIf();
+	std::shared_ptr<Node> ParseSwitch();
+	//Reports a tailcall that can't reuse the caller's frame
+	void CheckTailCall(const Node &expr);
 	std::shared_ptr<Node> ParseBlock();
 	std::shared_ptr<Node> ParsePrimary();
 	std::shared_ptr<Node> ParseFuncDecl(const VarType &type, const Token &name);
 	std::shared_ptr<Node> ParseParam();
+	std::shared_ptr<Node> ParseCall(const Token &name);
+	std::shared_ptr<Node> ParseIndex(const Token &name);
+	//The lane of a vector named by .x, .y, .z or .w, as a constant index
+	std::shared_ptr<Node> ParseLane(const Token &name);
+	std::shared_ptr<Node> ParseVectorBuiltin(const Token &name, VectorBuiltin builtin);
+	//The vector type an expression evaluates to, nullptr for scalars
+	const VarType *VectorTypeOf(const Node &expr) const;
+	//Reports an expression whose value can't be converted to type
+	void CheckConversion(const Node &expr, const VarType &type);
+	//The [size] after a declared name, parameters may leave the size out and be restrict
+	const VarType &ParseArrayType(const VarType &elem, bool isParam, bool &isRestrict);
 	std::shared_ptr<Node> ParseVarDecl();
 	std::shared_ptr<Node> ParseExpr(int parentPrecedence = 0);
 	std::shared_ptr<Node> ParseStmt();
+	std::shared_ptr<Node> ParseStmtOrRecover(bool topLevel);
+
+	void Expect(Token::Type type, const char *what);
+	//Tells a token that was too long or didn't fit in the symbol table apart from one that didn't lex
+	[[noreturn]] void ReportInvalidToken();
+	//Names made up while parsing, like soa members, can fill the symbol table as well
+	void CheckSymbol(const Token &name);
+	//Token offsets are 32-bit, the tokenizer stops short of input that would wrap them
+	void CheckInputSize();
+	//Skips tokens until the end of the broken statement (';' or the closing '}')
+	void Synchronize(bool topLevel);
 
 	std::string fileName;
-
-	void ParseStructdecl();
+	Diagnostics &diag;
+
+	void ParseStructdecl(bool isSoa = false);
+	//Declares the member arrays of a soa array, accesses to its elements are rewritten to them
+	void DeclareSoaMembers(const Token &name, const VarType &array);
+	//The member array .member after a subscript of a soa array refers to
+	Token ParseSoaMember(const Token &name);
+	std::vector<TopLevelDecl> ParseTopLevel();
+	void Reset();
+	//Where an offset of decl is now, with the shifts it doesn't include yet
+	std::uint32_t Shifted(const TopLevelDecl &decl, std::uint32_t offset) const;
+	//Applies the pending shifts to the tokens in the tree
+	void SettleOffsets();
+	//Builds the module on this thread
+	void Lower();
+
+	void ParseParallel();
+	//Returns false if any body had an error
+	bool ParseDeferredBodies();
+	//Worker for one deferred body, shares the parent's tree and reports into its own diagnostics
+	Parser(const Parser &parent, Diagnostics &diag_, const DeferredBody &body);
 	public:
-	Parser(Tokenizer &tok, const std::string &fileName_);
-
-	void Parse();
-	std::string GenerateCode() const;
-	const Node *GetRoot() { return rootNode.get(); }
+	Parser(Tokenizer &tok, const std::string &fileName_, Diagnostics &diag_);
+
+	//Front end only, returns false if any error was reported
+	bool Parse();
+	//Applies an edit to the tokenizer's buffer and patches the tree in place, re-lexing and
+	//re-parsing only the top-level statements it touches. Falls back to a full parse when the
+	//edit changes what the rest of the file can see, returns true if the patch was incremental
+	bool Reparse(const TextEdit &edit);
+	void Codegen();
+	//Parses, lowers and prints one top-level statement at a time in place of Parse() and Codegen().
+	//A function's body and IR are dropped once it is printed, the tree keeps its declaration.
+	//Nothing that needs the whole file runs: inlining, const evaluation and internal linkage.
+	//Returns false if any error was reported
+	bool CodegenStreaming();
+	//Lowers to bitcode for -flto, inlining is left to the link
+	std::string CodegenBitcode();
+	void SetLazyCodegen(bool lazy) { lazyCodegen = lazy; }
+	//Says what codegen left out on stderr, where the IR goes as well
+	void SetVerbose(bool verbose_) { verbose = verbose_; }
+	//Inline small internal functions and the ones declared inline into their callers
+	void SetInlining(bool inline_) { inlining = inline_; }
+	//Calls to pure functions with constant arguments are evaluated while compiling
+	void SetConstEval(bool eval) { constEval = eval; }
+	//Array subscripts that can't be proven in range trap at run time when out of it
+	void SetBoundsChecks(bool checks) { boundsChecks = checks; }
+	//Lex on a separate thread during Parse() so it overlaps with parsing
+	void SetPipelinedLexer(bool pipelined) { pipelinedLexer = pipelined; }
+	//Function bodies are parsed on this many threads, 0 picks one per hardware thread
+	void SetParseThreads(unsigned threads) { parseThreads = threads ? threads : std::max(1u, std::thread::hardware_concurrency()); }
+	//Instruments functions, ifs and loops with counters the program writes to path when it exits
+	void SetProfileGenerate(const std::string &path) { profileGeneratePath = path; }
+	//Attaches entry counts and branch weights from a profile written by an instrumented build
+	void SetProfileUse(const Profile *profile_) { profile = profile_; }
+	//CPU and features from -march/-mtune, without one the module is left target independent
+	void SetTarget(const Target *target_) { target = target_; }
+	//0 picks one thread per hardware thread
+	void SetCodegenThreads(unsigned threads) { codegenThreads = threads ? threads : std::max(1u, std::thread::hardware_concurrency()); }
+	const Node *GetRoot() { SettleOffsets(); return rootNode.get(); }
+	std::shared_ptr<BlockNode> GetRootBlock() { SettleOffsets(); return rootNode; }
+	//Replaces the parsed tree, e.g. with one reloaded from an AST cache
+	void SetRoot(std::shared_ptr<BlockNode> root);
 	
 	Scope::Variable &FindIdent(const Token &name) const;
 	const VarType &FindType(const Token &name) const;
@@ -0,0 +1,129 @@
+#pragma once
+
+#include <type_traits>
+#include "parser/parser.hpp"
+
+//Statically dispatched AST visitor. A pass derives from it (CRTP) and defines the Visit*
+//handlers it cares about, anything it leaves out falls back to VisitNode. Dispatch is a
+//switch on Node::type plus a static_cast, so handlers can be inlined into the traversal.
+template<typename Derived, typename Ret = void, bool IsConst = false>
+class AstVisitor{
+	public:
+	template<typename T>
+	using Ref = std::conditional_t<IsConst, const T&, T&>;
+
+	Ret Visit(Ref<Node> node){
+		switch(node.type){
+			case NodeType::VAL:
+				return Self().VisitVal(static_cast<Ref<ValNode>>(node));
+			case NodeType::BINARY:
+				return Self().VisitBinary(static_cast<Ref<BinaryNode>>(node));
+			case NodeType::VARDECL:
+				return Self().VisitVarDecl(static_cast<Ref<VarDeclNode>>(node));
+			case NodeType::BLOCK:
+				return Self().VisitBlock(static_cast<Ref<BlockNode>>(node));
+			case NodeType::FUNCDECL:
+				return Self().VisitFuncDecl(static_cast<Ref<FuncDeclNode>>(node));
+			case NodeType::IF:
+				return Self().VisitIf(static_cast<Ref<IfNode>>(node));
+			case NodeType::WHILE:
+				return Self().VisitWhile(static_cast<Ref<WhileNode>>(node));
+			case NodeType::SWITCH:
+				return Self().VisitSwitch(static_cast<Ref<SwitchNode>>(node));
+			case NodeType::CASE:
+				return Self().VisitCase(static_cast<Ref<CaseNode>>(node));
+			case NodeType::RETURN:
+				return Self().VisitReturn(static_cast<Ref<ReturnNode>>(node));
+			case NodeType::FUNCTIONCALL:
+				return Self().VisitFuncCall(static_cast<Ref<FuncCallNode>>(node));
+			case NodeType::VARASSIGN:
+				return Self().VisitVarAssign(static_cast<Ref<VarAssignNode>>(node));
+			case NodeType::MEMBER:
+				return Self().VisitMember(static_cast<Ref<MemberNode>>(node));
+			case NodeType::INDEX:
+				return Self().VisitIndex(static_cast<Ref<IndexNode>>(node));
+		}
+
+		return Self().VisitErr(node);
+	}
+
+	protected:
+	Derived &Self() { return *static_cast<Derived*>(this); }
+
+	//Visits every direct child in source order, the default for passes that only look for something
+	void VisitChildren(Ref<Node> node){
+		switch(node.type){
+			case NodeType::BINARY:
+				Self().Visit(*static_cast<Ref<BinaryNode>>(node).lhs);
+				Self().Visit(*static_cast<Ref<BinaryNode>>(node).rhs);
+				break;
+			case NodeType::VARDECL:
+				Self().Visit(*static_cast<Ref<VarDeclNode>>(node).initial);
+				break;
+			case NodeType::BLOCK:
+				for(auto &stmt: static_cast<Ref<BlockNode>>(node).stmts)
+					Self().Visit(*stmt);
+				break;
+			case NodeType::FUNCDECL:
+				for(auto &param: static_cast<Ref<FuncDeclNode>>(node).params)
+					Self().Visit(*param);
+				Self().Visit(*static_cast<Ref<FuncDeclNode>>(node).block);
+				break;
+			case NodeType::IF:
+				Self().Visit(*static_cast<Ref<IfNode>>(node).cond);
+				Self().Visit(*static_cast<Ref<IfNode>>(node).then);
+				Self().Visit(*static_cast<Ref<IfNode>>(node).elseBody);
+				break;
+			case NodeType::WHILE:
+				Self().Visit(*static_cast<Ref<WhileNode>>(node).cond);
+				Self().Visit(*static_cast<Ref<WhileNode>>(node).then);
+				break;
+			case NodeType::SWITCH:
+				Self().Visit(*static_cast<Ref<SwitchNode>>(node).value);
+				for(auto &arm: static_cast<Ref<SwitchNode>>(node).cases)
+					Self().Visit(*arm);
+				break;
+			case NodeType::CASE:
+				for(auto &label: static_cast<Ref<CaseNode>>(node).labels)
+					Self().Visit(*label);
+				Self().Visit(*static_cast<Ref<CaseNode>>(node).body);
+				break;
+			case NodeType::RETURN:
+				Self().Visit(*static_cast<Ref<ReturnNode>>(node).expr);
+				break;
+			case NodeType::FUNCTIONCALL:
+				for(auto &param: static_cast<Ref<FuncCallNode>>(node).params)
+					Self().Visit(*param);
+				break;
+			case NodeType::VARASSIGN:
+				Self().Visit(*static_cast<Ref<VarAssignNode>>(node).index);
+				Self().Visit(*static_cast<Ref<VarAssignNode>>(node).expression);
+				break;
+			case NodeType::INDEX:
+				Self().Visit(*static_cast<Ref<IndexNode>>(node).index);
+				break;
+		}
+	}
+
+	Ret VisitNode(Ref<Node>) {
+		if constexpr(!std::is_void_v<Ret>) return Ret{};
+	}
+	Ret VisitErr(Ref<Node> node) { return Self().VisitNode(node); }
+	Ret VisitVal(Ref<ValNode> node) { return Self().VisitNode(node); }
+	Ret VisitBinary(Ref<BinaryNode> node) { return Self().VisitNode(node); }
+	Ret VisitVarDecl(Ref<VarDeclNode> node) { return Self().VisitNode(node); }
+	Ret VisitBlock(Ref<BlockNode> node) { return Self().VisitNode(node); }
+	Ret VisitFuncDecl(Ref<FuncDeclNode> node) { return Self().VisitNode(node); }
+	Ret VisitIf(Ref<IfNode> node) { return Self().VisitNode(node); }
+	Ret VisitWhile(Ref<WhileNode> node) { return Self().VisitNode(node); }
+	Ret VisitSwitch(Ref<SwitchNode> node) { return Self().VisitNode(node); }
+	Ret VisitCase(Ref<CaseNode> node) { return Self().VisitNode(node); }
+	Ret VisitReturn(Ref<ReturnNode> node) { return Self().VisitNode(node); }
+	Ret VisitFuncCall(Ref<FuncCallNode> node) { return Self().VisitNode(node); }
+	Ret VisitVarAssign(Ref<VarAssignNode> node) { return Self().VisitNode(node); }
+	Ret VisitMember(Ref<MemberNode> node) { return Self().VisitNode(node); }
+	Ret VisitIndex(Ref<IndexNode> node) { return Self().VisitNode(node); }
+};
+
+template<typename Derived, typename Ret = void>
+using ConstAstVisitor = AstVisitor<Derived, Ret, true>;
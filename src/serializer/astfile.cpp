@@ -0,0 +1,593 @@
+#include "astfile.hpp"
+#include "parser/visitor.hpp"
+#include <vector>
+#include <cstring>
+#include <fstream>
+#include <unordered_map>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+using namespace AstFormat;
+
+std::uint64_t AstFile::Hash(std::string_view data, std::uint64_t seed){
+	for(unsigned char c: data){
+		seed ^= c;
+		seed *= 0x100000001b3ull;
+	}
+
+	return seed;
+}
+
+class AstWriter: public ConstAstVisitor<AstWriter, std::uint32_t>{
+	private:
+	std::vector<NodeRecord> nodes;
+	std::vector<std::uint32_t> lists;
+	std::vector<TypeRecord> types;
+	std::vector<MemberRecord> members;
+	std::vector<ScopeRecord> scopes;
+	std::vector<VarRecord> vars;
+	std::string strings{ '\0' };
+
+	std::unordered_map<const VarType*, std::uint32_t> typeIds;
+	std::unordered_map<const Scope*, std::uint32_t> scopeIds;
+	std::unordered_map<std::string, std::uint32_t> stringIds;
+
+	std::uint32_t String(const std::string &str){
+		if(!str.length()) return 0;
+
+		auto found = stringIds.find(str);
+		if(found != stringIds.end()) return found->second;
+
+		std::uint32_t offset = strings.size();
+		strings += str;
+		strings += '\0';
+		stringIds[str] = offset;
+
+		return offset;
+	}
+	TokenRecord Tok(const Token &tok){
+		TokenRecord rec{ (std::uint32_t)(int)tok.type, tok.offset, tok.length, String(tok.Name()), 0 };
+		std::memcpy(&rec.value, &tok.intVal, sizeof(rec.value));
+		return rec;
+	}
+
+	//Struct types are registered by address when their scope is written, everything else
+	//(primitives and by-value copies) is matched structurally
+	std::uint32_t Type(const VarType *type){
+		if(!type) return NONE;
+
+		auto found = typeIds.find(type);
+		if(found != typeIds.end()) return found->second;
+
+		std::uint32_t baseType = Type(type->baseType);
+		for(std::uint32_t i = 0; i < types.size(); ++i){
+			auto &rec = types[i];
+			if(rec.kind == (std::uint32_t)type->type && strings.c_str() + rec.name == type->name && rec.size == type->typeSz &&
+				rec.baseType == baseType && rec.isUnsigned == type->isUnsigned && rec.isArray == type->isArray && rec.arrSize == type->arrSize && rec.lanes == type->lanes &&
+				rec.isSoa == type->isSoa)
+				return i;
+		}
+
+		return AddType(*type, NONE, NONE);
+	}
+	std::uint32_t AddType(const VarType &type, std::uint32_t ownerScope, std::uint32_t ownerIndex){
+		std::uint32_t id = types.size();
+		types.push_back(TypeRecord{});
+		typeIds[&type] = id;
+
+		TypeRecord rec{};
+		rec.kind = (std::uint32_t)type.type;
+		rec.name = String(type.name);
+		rec.size = type.typeSz;
+		rec.baseType = Type(type.baseType);
+		rec.isUnsigned = type.isUnsigned;
+		rec.isArray = type.isArray;
+		rec.arrSize = type.arrSize;
+		rec.lanes = type.lanes;
+		rec.isSoa = type.isSoa;
+		rec.ownerScope = ownerScope;
+		rec.ownerIndex = ownerIndex;
+
+		std::vector<MemberRecord> typeMembers;
+		for(auto &member: type.members)
+			typeMembers.push_back(MemberRecord{ Type(member.type), String(member.name), member.offset });
+		rec.membersBegin = members.size();
+		rec.membersCount = typeMembers.size();
+		members.insert(members.end(), typeMembers.begin(), typeMembers.end());
+
+		types[id] = rec;
+		return id;
+	}
+
+	std::uint32_t WriteScope(const Scope &scope, std::uint32_t parent){
+		std::uint32_t id = scopes.size();
+		scopes.push_back(ScopeRecord{});
+		scopeIds[&scope] = id;
+
+		ScopeRecord rec{};
+		rec.parent = parent;
+
+		//Types first, the variables and children below may refer to them
+		std::vector<std::uint32_t> typeList;
+		for(std::uint32_t i = 0; i < scope.types.size(); ++i)
+			typeList.push_back(AddType(scope.types[i], id, i));
+		rec.typesBegin = lists.size();
+		rec.typesCount = typeList.size();
+		lists.insert(lists.end(), typeList.begin(), typeList.end());
+
+		rec.varsBegin = vars.size();
+		rec.varsCount = scope.identifiers.size();
+		for(auto &var: scope.identifiers)
+			vars.push_back(VarRecord{ Tok(var.ident), 0 });
+		for(std::uint32_t i = 0; i < scope.identifiers.size(); ++i)
+			vars[rec.varsBegin + i].type = Type(&scope.identifiers[i].type);
+
+		std::vector<std::uint32_t> children;
+		for(auto &child: scope.scopes)
+			children.push_back(WriteScope(*child, id));
+		rec.childrenBegin = lists.size();
+		rec.childrenCount = children.size();
+		lists.insert(lists.end(), children.begin(), children.end());
+
+		scopes[id] = rec;
+		return id;
+	}
+
+	std::uint32_t List(const std::vector<std::uint32_t> &ids, NodeRecord &rec){
+		rec.listBegin = lists.size();
+		rec.listCount = ids.size();
+		lists.insert(lists.end(), ids.begin(), ids.end());
+
+		return rec.listBegin;
+	}
+
+	std::uint32_t Add(const NodeRecord &rec){
+		nodes.push_back(rec);
+		return nodes.size() - 1;
+	}
+	static NodeRecord Record(const Node &node){
+		return NodeRecord{ (std::uint32_t)node.type, 0, {}, { NONE, NONE, NONE }, 0, 0, NONE };
+	}
+
+	public:
+	AstWriter(){
+		//Node 0 is shared by every empty (ERR) child
+		nodes.push_back(NodeRecord{ (std::uint32_t)NodeType::ERR, 0, {}, { NONE, NONE, NONE }, 0, 0, NONE });
+	}
+
+	std::uint32_t VisitErr(const Node&) { return 0; }
+	std::uint32_t VisitVal(const ValNode &node){
+		auto rec = Record(node);
+		rec.tok = Tok(node.val);
+		return Add(rec);
+	}
+	std::uint32_t VisitBinary(const BinaryNode &node){
+		auto rec = Record(node);
+		rec.tok = Tok(node.operand);
+		rec.child[0] = Visit(*node.lhs);
+		rec.child[1] = Visit(*node.rhs);
+		return Add(rec);
+	}
+	std::uint32_t VisitVarDecl(const VarDeclNode &node){
+		auto rec = Record(node);
+		rec.tok = Tok(node.ident);
+		rec.ref = Type(node.varType);
+		rec.flags = node.isRestrict ? (std::uint32_t)RESTRICT : 0u;
+		rec.child[0] = Visit(*node.initial);
+		return Add(rec);
+	}
+	std::uint32_t VisitBlock(const BlockNode &node){
+		auto rec = Record(node);
+		std::vector<std::uint32_t> stmts;
+		for(auto &stmt: node.stmts)
+			stmts.push_back(Visit(*stmt));
+		List(stmts, rec);
+
+		auto &scope = node.myScope;
+		rec.ref = scope && scopeIds.contains(scope.get()) ? scopeIds.at(scope.get()) : NONE;
+		return Add(rec);
+	}
+	std::uint32_t VisitFuncDecl(const FuncDeclNode &node){
+		auto rec = Record(node);
+		rec.tok = Tok(node.ident);
+		rec.ref = Type(node.funcType);
+		rec.flags = (node.isExported ? (std::uint32_t)EXPORTED : 0u) | (node.isReachable ? (std::uint32_t)REACHABLE : 0u) | (node.isInline ? (std::uint32_t)INLINE : 0u);
+
+		std::vector<std::uint32_t> params;
+		for(auto &param: node.params)
+			params.push_back(Visit(*param));
+		List(params, rec);
+		rec.child[0] = Visit(*node.block);
+		return Add(rec);
+	}
+	std::uint32_t VisitIf(const IfNode &node){
+		auto rec = Record(node);
+		rec.child[0] = Visit(*node.cond);
+		rec.child[1] = Visit(*node.then);
+		rec.child[2] = Visit(*node.elseBody);
+		return Add(rec);
+	}
+	std::uint32_t VisitWhile(const WhileNode &node){
+		auto rec = Record(node);
+		rec.child[0] = Visit(*node.cond);
+		rec.child[1] = Visit(*node.then);
+		return Add(rec);
+	}
+	std::uint32_t VisitSwitch(const SwitchNode &node){
+		auto rec = Record(node);
+		rec.child[0] = Visit(*node.value);
+
+		std::vector<std::uint32_t> cases;
+		for(auto &arm: node.cases)
+			cases.push_back(Visit(*arm));
+		List(cases, rec);
+		return Add(rec);
+	}
+	std::uint32_t VisitCase(const CaseNode &node){
+		auto rec = Record(node);
+		rec.flags = node.isDefault ? (std::uint32_t)DEFAULT : 0u;
+
+		std::vector<std::uint32_t> labels;
+		for(auto &label: node.labels)
+			labels.push_back(Visit(*label));
+		List(labels, rec);
+		rec.child[0] = Visit(*node.body);
+		return Add(rec);
+	}
+	std::uint32_t VisitReturn(const ReturnNode &node){
+		auto rec = Record(node);
+		rec.flags = node.isTailCall ? (std::uint32_t)TAILCALL : 0u;
+		rec.child[0] = Visit(*node.expr);
+		return Add(rec);
+	}
+	std::uint32_t VisitVarAssign(const VarAssignNode &node){
+		auto rec = Record(node);
+		rec.tok = Tok(node.varName);
+		rec.child[0] = Visit(*node.expression);
+		rec.child[1] = Visit(*node.index);
+		return Add(rec);
+	}
+	std::uint32_t VisitFuncCall(const FuncCallNode &node){
+		auto rec = Record(node);
+		rec.tok = Tok(node.funcName);
+
+		std::vector<std::uint32_t> params;
+		for(auto &param: node.params)
+			params.push_back(Visit(*param));
+		List(params, rec);
+		return Add(rec);
+	}
+	std::uint32_t VisitMember(const MemberNode &node){
+		auto rec = Record(node);
+		rec.tok.str = String(node.member.name);
+		rec.ref = Type(node.member.type);
+		rec.child[0] = (std::uint32_t)node.member.offset;
+		return Add(rec);
+	}
+	std::uint32_t VisitIndex(const IndexNode &node){
+		auto rec = Record(node);
+		rec.tok = Tok(node.array);
+		rec.child[0] = Visit(*node.index);
+		return Add(rec);
+	}
+
+	bool Write(const std::string &path, const BlockNode &root, std::uint64_t key){
+		Header header{};
+		std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+		header.version = VERSION;
+		header.key = key;
+		header.rootScope = root.myScope ? WriteScope(*root.myScope, NONE) : NONE;
+		header.root = Visit(root);
+
+		std::string image(sizeof(Header), '\0');
+		auto append = [&image](Section &section, const void *src, std::size_t elemSize, std::size_t count){
+			image.resize((image.size() + 7) & ~std::size_t(7), '\0');
+			section.offset = image.size();
+			section.count = count;
+			image.append(static_cast<const char*>(src), elemSize * count);
+		};
+		append(header.nodes, nodes.data(), sizeof(NodeRecord), nodes.size());
+		append(header.lists, lists.data(), sizeof(std::uint32_t), lists.size());
+		append(header.types, types.data(), sizeof(TypeRecord), types.size());
+		append(header.members, members.data(), sizeof(MemberRecord), members.size());
+		append(header.scopes, scopes.data(), sizeof(ScopeRecord), scopes.size());
+		append(header.vars, vars.data(), sizeof(VarRecord), vars.size());
+		append(header.strings, strings.data(), 1, strings.size());
+		std::memcpy(image.data(), &header, sizeof(Header));
+
+		std::ofstream out(path, std::ios::binary | std::ios::trunc);
+		out.write(image.data(), image.size());
+		return (bool)out;
+	}
+};
+
+bool AstFile::Write(const std::string &path, const BlockNode &root, std::uint64_t key){
+	return AstWriter().Write(path, root, key);
+}
+
+AstView::~AstView(){
+	if(data) munmap(const_cast<char*>(data), size);
+}
+bool AstView::Open(const std::string &path){
+	int fd = open(path.c_str(), O_RDONLY);
+	if(fd < 0) return false;
+
+	struct stat info{};
+	if(fstat(fd, &info) || (std::size_t)info.st_size < sizeof(AstFormat::Header)){
+		close(fd);
+		return false;
+	}
+
+	void *mapped = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if(mapped == MAP_FAILED) return false;
+
+	data = static_cast<const char*>(mapped);
+	size = info.st_size;
+
+	auto &header = Header();
+	bool valid = !std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) && header.version == VERSION;
+	auto inBounds = [this](const AstFormat::Section &section, std::size_t elemSize){
+		return section.offset % 4 == 0 && section.offset <= size && section.count <= (size - section.offset) / elemSize;
+	};
+	valid = valid && inBounds(header.nodes, sizeof(NodeRecord)) && inBounds(header.lists, sizeof(std::uint32_t)) &&
+		inBounds(header.types, sizeof(TypeRecord)) && inBounds(header.members, sizeof(MemberRecord)) &&
+		inBounds(header.scopes, sizeof(ScopeRecord)) && inBounds(header.vars, sizeof(VarRecord)) &&
+		inBounds(header.strings, 1) && header.strings.count && data[header.strings.offset + header.strings.count - 1] == '\0' &&
+		header.root < header.nodes.count;
+
+	if(!valid){
+		munmap(mapped, size);
+		data = nullptr;
+		size = 0;
+	}
+	return valid;
+}
+
+class AstLoader{
+	private:
+	const AstView &view;
+	Parser &parser;
+	std::vector<std::shared_ptr<Scope>> scopes;
+	std::vector<const VarType*> types;
+
+	struct Invalid{};
+
+	void Check(bool cond) const { if(!cond) throw Invalid{}; }
+	std::string Str(std::uint32_t offset) const {
+		Check(offset < view.Header().strings.count);
+		return std::string(view.String(offset));
+	}
+	Token Tok(const TokenRecord &rec) const {
+		Check(rec.length <= Token::MAX_LENGTH);
+		Token tok((Token::Type)(int)rec.type, rec.offset, rec.length);
+		if(tok.type == Token::Type::IDENT || tok.type == Token::Type::STRING_LITERAL){
+			tok.symbol = Symbols::Intern(Str(rec.str));
+			//Parsing the source instead reports it
+			Check(tok.symbol != Symbols::FULL);
+		}
+		else
+			std::memcpy(&tok.intVal, &rec.value, sizeof(rec.value));
+		return tok;
+	}
+	std::uint32_t ListAt(std::uint32_t idx) const {
+		Check(idx < view.Header().lists.count);
+		return view.List(idx);
+	}
+
+	static Token::Type PrimitiveToken(VarType::Type type){
+		switch(type){
+			case VarType::Type::VOID: return Token::Type::TYPE_VOID;
+			case VarType::Type::CHAR: return Token::Type::TYPE_CHAR;
+			case VarType::Type::SHORT: return Token::Type::TYPE_SHORT;
+			case VarType::Type::INT: return Token::Type::TYPE_INT;
+			case VarType::Type::LONG: return Token::Type::TYPE_LONG;
+			case VarType::Type::FLOAT: return Token::Type::TYPE_FLOAT;
+			case VarType::Type::DOUBLE: return Token::Type::TYPE_DOUBLE;
+			default: return Token::Type::ERR;
+		}
+	}
+
+	const VarType *Type(std::uint32_t idx){
+		if(idx == NONE) return nullptr;
+		Check(idx < types.size());
+		if(types[idx]) return types[idx];
+
+		auto &rec = view.Type(idx);
+		auto primitive = PrimitiveToken((VarType::Type)rec.kind);
+		if(primitive != Token::Type::ERR && rec.ownerScope == NONE && !rec.isArray){
+			types[idx] = &parser.FindType(Token(primitive));
+			return types[idx];
+		}
+		//Vector types are shared like the primitives
+		if(rec.kind == (std::uint32_t)VarType::Type::VECTOR && rec.ownerScope == NONE && !rec.isArray){
+			auto elem = Type(rec.baseType);
+			Check(elem);
+			types[idx] = &VarType::Vector(*elem, rec.lanes);
+			Check(types[idx]->type == VarType::Type::VECTOR);
+			return types[idx];
+		}
+
+		VarType *type = nullptr;
+		if(rec.ownerScope != NONE){
+			Check(rec.ownerScope < scopes.size() && rec.ownerIndex < scopes[rec.ownerScope]->types.size());
+			type = &scopes[rec.ownerScope]->types[rec.ownerIndex];
+		}
+		else{
+			//Array types are kept by the outermost scope like the parser does, so they go with the tree.
+			//The element they were made from isn't in the image, the record index stands in for it
+			Check(view.Header().rootScope < scopes.size());
+			type = &scopes[view.Header().rootScope]->arrayTypes.try_emplace({ nullptr, idx }).first->second;
+		}
+		types[idx] = type;
+		FillType(*type, rec);
+
+		return type;
+	}
+	void FillType(VarType &type, const TypeRecord &rec){
+		Check(rec.membersBegin <= view.Header().members.count && rec.membersCount <= view.Header().members.count - rec.membersBegin);
+
+		std::vector<::Member> members;
+		for(std::uint32_t i = 0; i < rec.membersCount; ++i){
+			auto &member = view.Member(rec.membersBegin + i);
+			members.emplace_back(Type(member.type), Str(member.name), member.offset);
+		}
+
+		type = VarType((VarType::Type)rec.kind, Str(rec.name), rec.size, const_cast<VarType*>(Type(rec.baseType)), members, rec.isUnsigned, rec.isArray, rec.arrSize);
+		type.lanes = rec.lanes;
+		type.isSoa = rec.isSoa;
+		Check(type.type != VarType::Type::VECTOR || (type.baseType && VarType::Vector(*type.baseType, type.lanes).type == VarType::Type::VECTOR));
+	}
+
+	void LoadScopes(){
+		auto &header = view.Header();
+		scopes.resize(header.scopes.count);
+		for(auto &scope: scopes)
+			scope = std::make_shared<Scope>();
+
+		//Size the type tables before resolving anything so pointers into them stay put
+		for(std::uint32_t i = 0; i < scopes.size(); ++i)
+			scopes[i]->types.resize(view.Scope(i).typesCount);
+
+		for(std::uint32_t i = 0; i < scopes.size(); ++i){
+			auto &rec = view.Scope(i);
+			auto &scope = scopes[i];
+
+			if(rec.parent != NONE){
+				Check(rec.parent < scopes.size());
+				scope->parent = scopes[rec.parent];
+			}
+			for(std::uint32_t t = 0; t < rec.typesCount; ++t)
+				Type(ListAt(rec.typesBegin + t));
+			for(std::uint32_t c = 0; c < rec.childrenCount; ++c){
+				auto child = ListAt(rec.childrenBegin + c);
+				Check(child < scopes.size());
+				scope->scopes.push_back(scopes[child]);
+			}
+		}
+
+		for(std::uint32_t i = 0; i < scopes.size(); ++i){
+			auto &rec = view.Scope(i);
+			Check(rec.varsBegin <= header.vars.count && rec.varsCount <= header.vars.count - rec.varsBegin);
+
+			for(std::uint32_t v = 0; v < rec.varsCount; ++v){
+				auto &var = view.Var(rec.varsBegin + v);
+				auto type = Type(var.type);
+				scopes[i]->identifiers.emplace_back(Tok(var.ident), type ? *type : VarType::ERROR, nullptr);
+			}
+		}
+	}
+
+	std::shared_ptr<Node> LoadNode(std::uint32_t idx, std::uint32_t depth = 0){
+		Check(idx < view.Header().nodes.count && depth < 10000);
+		auto &rec = view.Node(idx);
+
+		auto child = [&](int i) { return LoadNode(rec.child[i], depth + 1); };
+		auto list = [&](){
+			std::vector<std::shared_ptr<Node>> ret;
+			for(std::uint32_t i = 0; i < rec.listCount; ++i)
+				ret.push_back(LoadNode(ListAt(rec.listBegin + i), depth + 1));
+			return ret;
+		};
+
+		switch((NodeType)rec.kind){
+			case NodeType::VAL:
+				return std::make_shared<ValNode>(Tok(rec.tok));
+			case NodeType::BINARY:
+				return std::make_shared<BinaryNode>(child(0), Tok(rec.tok), child(1));
+			case NodeType::VARDECL:{
+				auto type = Type(rec.ref);
+				Check(type != nullptr);
+				auto decl = std::make_shared<VarDeclNode>(type, Tok(rec.tok), child(0));
+				decl->isRestrict = rec.flags & RESTRICT;
+				return decl;
+			}
+			case NodeType::BLOCK:{
+				std::shared_ptr<Scope> scope;
+				if(rec.ref != NONE){
+					Check(rec.ref < scopes.size());
+					scope = scopes[rec.ref];
+				}
+				return std::make_shared<BlockNode>(list(), scope);
+			}
+			case NodeType::FUNCDECL:{
+				auto type = Type(rec.ref);
+				Check(type != nullptr);
+
+				std::vector<std::shared_ptr<VarDeclNode>> params;
+				for(auto &param: list()){
+					Check(param->type == NodeType::VARDECL);
+					params.push_back(std::static_pointer_cast<VarDeclNode>(param));
+				}
+
+				auto func = std::make_shared<FuncDeclNode>(type, Tok(rec.tok), params, child(0));
+				func->isExported = rec.flags & EXPORTED;
+				func->isReachable = rec.flags & REACHABLE;
+				func->isInline = rec.flags & INLINE;
+				return func;
+			}
+			case NodeType::IF:
+				return std::make_shared<IfNode>(child(0), child(1), child(2));
+			case NodeType::WHILE:
+				return std::make_shared<WhileNode>(child(0), child(1));
+			case NodeType::SWITCH:{
+				std::vector<std::shared_ptr<CaseNode>> cases;
+				for(auto &arm: list()){
+					Check(arm->type == NodeType::CASE);
+					cases.push_back(std::static_pointer_cast<CaseNode>(arm));
+				}
+				return std::make_shared<SwitchNode>(child(0), cases);
+			}
+			case NodeType::CASE:{
+				std::vector<std::shared_ptr<ValNode>> labels;
+				for(auto &label: list()){
+					Check(label->type == NodeType::VAL);
+					labels.push_back(std::static_pointer_cast<ValNode>(label));
+				}
+				return std::make_shared<CaseNode>(labels, child(0), rec.flags & DEFAULT);
+			}
+			case NodeType::RETURN:{
+				auto ret = std::make_shared<ReturnNode>(child(0));
+				ret->isTailCall = rec.flags & TAILCALL;
+				return ret;
+			}
+			case NodeType::VARASSIGN:
+				return std::make_shared<VarAssignNode>(Tok(rec.tok), child(0), child(1));
+			case NodeType::FUNCTIONCALL:
+				return std::make_shared<FuncCallNode>(Tok(rec.tok), list());
+			case NodeType::MEMBER:
+				return std::make_shared<MemberNode>(::Member(Type(rec.ref), Str(rec.tok.str), rec.child[0]));
+			case NodeType::INDEX:
+				return std::make_shared<IndexNode>(Tok(rec.tok), child(0));
+		}
+
+		return std::make_shared<Node>();
+	}
+
+	public:
+	AstLoader(const AstView &view_, Parser &parser_): view(view_), parser(parser_), types(view_.Header().types.count, nullptr) {}
+
+	bool Load(){
+		try{
+			LoadScopes();
+
+			auto root = LoadNode(view.Header().root);
+			Check(root->type == NodeType::BLOCK);
+			parser.SetRoot(std::static_pointer_cast<BlockNode>(root));
+		}
+		catch(const Invalid&){
+			return false;
+		}
+
+		return true;
+	}
+};
+
+bool AstFile::Load(const AstView &view, Parser &parser){
+	if(!view.IsOpen()) return false;
+
+	return AstLoader(view, parser).Load();
+}
@@ -0,0 +1,130 @@
+#pragma once
+
+#include <string>
+#include <memory>
+#include <cstdint>
+#include <string_view>
+
+#include "parser/parser.hpp"
+
+//Binary image of a parsed translation unit: the BlockNode tree plus its Scope/VarType tables.
+//Every reference is an index or an offset from the start of the file, so the image is position
+//independent. The compiler doesn't run on it in place: AstFile::Load rebuilds the tree, which
+//saves lexing, parsing and name lookup but not a pass over every record
+namespace AstFormat{
+	constexpr char MAGIC[4] = { 'C', 'A', 'S', 'T' };
+	constexpr std::uint32_t VERSION = 9;
+	constexpr std::uint32_t NONE = 0xFFFFFFFF;
+
+	enum Flags: std::uint32_t{
+		EXPORTED = 1 << 0,
+		REACHABLE = 1 << 1,
+		INLINE = 1 << 2,
+		RESTRICT = 1 << 3,
+		DEFAULT = 1 << 4,
+		TAILCALL = 1 << 5
+	};
+
+	struct Section{
+		std::uint32_t offset, count;
+	};
+	struct Header{
+		char magic[4];
+		std::uint32_t version;
+		//Hash of the source and the settings it was parsed with, see AstFile::Hash
+		std::uint64_t key;
+
+		Section nodes, lists, types, members, scopes, vars, strings;
+		std::uint32_t root, rootScope;
+	};
+
+	struct TokenRecord{
+		std::uint32_t type;
+		std::uint32_t offset, length;
+		//Offset into the string section for identifiers and strings, 0 is the empty string.
+		//Symbol ids are per run, so names are stored as text and interned again on load
+		std::uint32_t str;
+		//Raw bits of the parsed literal
+		std::uint64_t value;
+	};
+	//child/list/ref meaning depends on the kind, see AstFile::Write
+	struct NodeRecord{
+		std::uint32_t kind;
+		std::uint32_t flags;
+		TokenRecord tok;
+		std::uint32_t child[3];
+		std::uint32_t listBegin, listCount;
+		std::uint32_t ref;
+	};
+	struct TypeRecord{
+		std::uint32_t kind;
+		std::uint32_t name;
+		std::uint64_t size;
+		std::uint32_t baseType;
+		std::uint32_t membersBegin, membersCount;
+		std::uint32_t isUnsigned, isArray;
+		std::uint32_t lanes, isSoa;
+		std::uint64_t arrSize;
+		//Struct types live in a scope, pointers to them must resolve to that slot
+		std::uint32_t ownerScope, ownerIndex;
+	};
+	struct MemberRecord{
+		std::uint32_t type;
+		std::uint32_t name;
+		std::uint64_t offset;
+	};
+	struct VarRecord{
+		TokenRecord ident;
+		std::uint32_t type;
+	};
+	struct ScopeRecord{
+		std::uint32_t parent;
+		std::uint32_t typesBegin, typesCount;
+		std::uint32_t varsBegin, varsCount;
+		//Child scopes, stored in the list section
+		std::uint32_t childrenBegin, childrenCount;
+	};
+
+	static_assert(sizeof(TokenRecord) == 24 && sizeof(NodeRecord) == 56 && sizeof(TypeRecord) == 64 && sizeof(Header) == 80);
+}
+
+//Read-only view over a mmapped AST image
+class AstView{
+	private:
+	const char *data = nullptr;
+	std::size_t size = 0;
+
+	template<typename T>
+	const T *Section(const AstFormat::Section &section) const { return reinterpret_cast<const T*>(data + section.offset); }
+
+	public:
+	AstView() = default;
+	AstView(const AstView&) = delete;
+	AstView &operator=(const AstView&) = delete;
+	~AstView();
+
+	//Maps the file and validates header and section bounds
+	bool Open(const std::string &path);
+	bool IsOpen() const { return data != nullptr; }
+
+	const AstFormat::Header &Header() const { return *reinterpret_cast<const AstFormat::Header*>(data); }
+	std::uint64_t Key() const { return Header().key; }
+
+	const AstFormat::NodeRecord &Node(std::uint32_t idx) const { return Section<AstFormat::NodeRecord>(Header().nodes)[idx]; }
+	const AstFormat::TypeRecord &Type(std::uint32_t idx) const { return Section<AstFormat::TypeRecord>(Header().types)[idx]; }
+	const AstFormat::MemberRecord &Member(std::uint32_t idx) const { return Section<AstFormat::MemberRecord>(Header().members)[idx]; }
+	const AstFormat::ScopeRecord &Scope(std::uint32_t idx) const { return Section<AstFormat::ScopeRecord>(Header().scopes)[idx]; }
+	const AstFormat::VarRecord &Var(std::uint32_t idx) const { return Section<AstFormat::VarRecord>(Header().vars)[idx]; }
+	std::uint32_t List(std::uint32_t idx) const { return Section<std::uint32_t>(Header().lists)[idx]; }
+	std::string_view String(std::uint32_t offset) const { return std::string_view(data + Header().strings.offset + offset); }
+};
+
+class AstFile{
+	public:
+	//FNV-1a, call repeatedly to hash a source read in pieces
+	static std::uint64_t Hash(std::string_view data, std::uint64_t seed = 0xcbf29ce484222325ull);
+
+	static bool Write(const std::string &path, const BlockNode &root, std::uint64_t key);
+	//Rebuilds the tree and scopes from the image and hands them to the parser, no lexing or parsing involved
+	static bool Load(const AstView &view, Parser &parser);
+};
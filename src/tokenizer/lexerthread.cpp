@@ -0,0 +1,40 @@
+#include "lexerthread.hpp"
+
+LexerThread::LexerThread(Tokenizer &tokenizer_): tokenizer(tokenizer_) {
+	worker = std::thread(&LexerThread::Run, this);
+}
+LexerThread::~LexerThread(){
+	stop.store(true, std::memory_order_relaxed);
+	worker.join();
+}
+
+void LexerThread::Run(){
+	Token local[BATCH];
+
+	while(true){
+		size_t n = 0;
+		bool done = false;
+		while(n < BATCH && !done){
+			local[n] = tokenizer.NextToken();
+			done = local[n++].type == Token::Type::TEOF;
+		}
+
+		//The parser may stop early (error limit), so never wait on a ring nobody drains
+		size_t pushed = 0;
+		while(pushed < n){
+			pushed += ring.TryPush(local + pushed, n - pushed);
+			if(pushed < n){
+				if(stop.load(std::memory_order_relaxed)) return;
+				std::this_thread::yield();
+			}
+		}
+		if(done) return;
+	}
+}
+size_t LexerThread::Read(Token *out, size_t max){
+	size_t count;
+	while(!(count = ring.TryPop(out, max)))
+		std::this_thread::yield();
+
+	return count;
+}
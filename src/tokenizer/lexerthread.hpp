@@ -0,0 +1,32 @@
+#pragma once
+
+#include <atomic>
+#include <thread>
+#include "tokenizer/tokenizer.hpp"
+#include "util/spscring.hpp"
+
+//Runs a Tokenizer on its own thread so lexing overlaps with parsing. Tokens travel in batches
+//through a bounded ring, the lexer blocks when the parser falls behind and vice versa.
+//The tokenizer must not be advanced by anyone else until this is destroyed.
+class LexerThread{
+	public:
+	static constexpr size_t BATCH = 256;
+	static constexpr size_t CAPACITY = 8192;
+
+	explicit LexerThread(Tokenizer &tokenizer);
+	~LexerThread();
+
+	LexerThread(const LexerThread&) = delete;
+	LexerThread &operator=(const LexerThread&) = delete;
+
+	//Blocks until at least one token is available, never call it again after the TEOF
+	size_t Read(Token *out, size_t max);
+
+	private:
+	Tokenizer &tokenizer;
+	SpscRing<Token, CAPACITY> ring;
+	std::atomic<bool> stop{false};
+	std::thread worker;
+
+	void Run();
+};
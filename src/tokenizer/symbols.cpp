@@ -0,0 +1,52 @@
+#include "symbols.hpp"
+#include <mutex>
+#include <atomic>
+#include <unordered_map>
+
+//Names live in fixed-size chunks that never move, so Name() can read without the lock: any id a
+//thread holds was handed over (through a token) after its string was written
+static constexpr std::uint32_t CHUNK_BITS = 12;
+static constexpr std::uint32_t CHUNK_SIZE = 1u << CHUNK_BITS;
+static constexpr std::uint32_t MAX_CHUNKS = 1u << 14;
+
+static std::mutex symbolsMutex;
+static std::atomic<std::string*> chunks[MAX_CHUNKS];
+static std::uint32_t count = 0;
+static std::unordered_map<std::string_view, std::uint32_t> ids;
+static const std::string empty;
+
+std::uint32_t Symbols::Intern(std::string_view str){
+	if(str.empty()) return 0;
+
+	std::lock_guard<std::mutex> lock(symbolsMutex);
+
+	auto found = ids.find(str);
+	if(found != ids.end()) return found->second;
+
+	//Id 0 stays the empty string
+	if(count + 1 >= MAX_CHUNKS * CHUNK_SIZE) return FULL;
+	std::uint32_t id = ++count;
+	auto &chunk = chunks[id >> CHUNK_BITS];
+	if(!chunk.load(std::memory_order_relaxed))
+		chunk.store(new std::string[CHUNK_SIZE], std::memory_order_release);
+
+	std::string &name = chunk.load(std::memory_order_relaxed)[id & (CHUNK_SIZE - 1)];
+	name = str;
+	ids.emplace(name, id);
+
+	return id;
+}
+const std::string &Symbols::Name(std::uint32_t id){
+	if(!id || (id >> CHUNK_BITS) >= MAX_CHUNKS) return empty;
+
+	auto chunk = chunks[id >> CHUNK_BITS].load(std::memory_order_acquire);
+	return chunk ? chunk[id & (CHUNK_SIZE - 1)] : empty;
+}
+void Symbols::Clear(){
+	std::lock_guard<std::mutex> lock(symbolsMutex);
+
+	for(auto &chunk: chunks)
+		delete[] chunk.exchange(nullptr, std::memory_order_relaxed);
+	ids = {};
+	count = 0;
+}
@@ -0,0 +1,19 @@
+#pragma once
+
+#include <string>
+#include <cstdint>
+#include <string_view>
+
+//Interned spellings of identifiers and string literals. Ids are dense and valid until Clear(),
+//so a token carries 32 bits instead of the text and names compare as integers.
+//Id 0 is the empty string.
+class Symbols{
+	public:
+	//Returned by Intern() once the table is full, its name is empty
+	static constexpr std::uint32_t FULL = UINT32_MAX;
+
+	static std::uint32_t Intern(std::string_view str);
+	static const std::string &Name(std::uint32_t id);
+	//Frees every name. No id from before may be used afterwards, so nothing else can be running
+	static void Clear();
+};
@@ -1,37 +1,67 @@
 #include "tokenizer.hpp"
 #include <ctype.h>
-#include <unordered_map>
+#include <charconv>
 #include <algorithm>
+#include <string_view>
+#include <unordered_map>
 
 const Token Token::ERROR = Token();
 
-	static const std::unordered_map<std::string, Token::Type> keywords{
-		{ "void", Token::Type::TYPE_VOID },
-		{ "char", Token::Type::TYPE_CHAR },
-		{ "short", Token::Type::TYPE_SHORT },
-		{ "int", Token::Type::TYPE_INT },
-		{ "long", Token::Type::TYPE_LONG },
-		{ "float", Token::Type::TYPE_FLOAT },
-		{ "double", Token::Type::TYPE_DOUBLE },
-		{ "enum", Token::Type::TYPE_ENUM },
-		{ "struct", Token::Type::TYPE_STRUCT },
-		{ "if", Token::Type::IF },
-		{ "else", Token::Type::ELSE },
-		{ "while", Token::Type::WHILE },
-		{ "return", Token::Type::RETURN },
-	};
+static const std::unordered_map<std::string_view, Token::Type> keywords{
+	{ "void", Token::Type::TYPE_VOID },
+	{ "char", Token::Type::TYPE_CHAR },
+	{ "short", Token::Type::TYPE_SHORT },
+	{ "int", Token::Type::TYPE_INT },
+	{ "long", Token::Type::TYPE_LONG },
+	{ "float", Token::Type::TYPE_FLOAT },
+	{ "double", Token::Type::TYPE_DOUBLE },
+	{ "enum", Token::Type::TYPE_ENUM },
+	{ "struct", Token::Type::TYPE_STRUCT },
+	{ "if", Token::Type::IF },
+	{ "else", Token::Type::ELSE },
+	{ "while", Token::Type::WHILE },
+	{ "switch", Token::Type::SWITCH },
+	{ "case", Token::Type::CASE },
+	{ "default", Token::Type::DEFAULT },
+	{ "return", Token::Type::RETURN },
+	{ "export", Token::Type::EXPORT },
+	{ "inline", Token::Type::INLINE },
+	{ "restrict", Token::Type::RESTRICT },
+	{ "soa", Token::Type::SOA },
+	{ "tailcall", Token::Type::TAILCALL },
+};
+
+bool Tokenizer::VectorKeyword(std::string_view word, Token &tok){
+	auto digits = word.find_first_of("0123456789");
+	if(digits == std::string_view::npos) return false;
+
+	auto lanes = word.substr(digits);
+	if(lanes != "2" && lanes != "4" && lanes != "8" && lanes != "16") return false;
+	auto elem = keywords.find(word.substr(0, digits));
+	if(elem == keywords.end() || elem->second < Token::Type::TYPE_CHAR || elem->second > Token::Type::TYPE_DOUBLE) return false;
+
+	tok.intVal = (std::int64_t)elem->second << 8 | (lanes == "16" ? 16 : lanes[0] - '0');
+	return true;
+}
+
+const std::string &Token::Name() const{
+	return Symbols::Name(type == Type::IDENT || type == Type::STRING_LITERAL ? symbol : 0);
+}
 
 void Tokenizer::AddLine(std::string line){
+	lineStarts.clear();
+	startShifts.clear();
 	while (line.find("\r\n") != std::string::npos){
     	line.erase(line.find("\r\n"), 2);
 	}
 	if(!line.length()){
-		lines.push_back("");
+		if(Fits(0)) lines.push_back("");
 		return;
 	}
 
 	while(line.length()){
 		auto pos = line.find_first_of('\n');
+		if(!Fits(pos == std::string::npos ? line.length() : pos)) return;
 
 		if(pos == std::string::npos){
 			lines.push_back(line);
@@ -43,140 +73,369 @@ void Tokenizer::AddLine(std::string line){
 		}
 	}
 }
-Token Tokenizer::NextToken(){
-	if(currLine >= lines.size()) return Token(Token::Type::TEOF);
+void Tokenizer::SetStream(std::istream &in){
+	stream = &in;
+	lines.clear();
+	lineStarts.clear();
+	startShifts.clear();
+	pending.clear();
+	pendingPos = droppedLines = releasedLines = 0;
+	inputSize = 0;
+	tooLarge = false;
+	currLine = currChar = lineOffset = 0;
+}
+bool Tokenizer::PullLine(){
+	if(!stream) return false;
 
-	while(currChar >= lines[currLine].size()){
-		currLine++;
-		currChar = 0;
+	size_t newline;
+	while((newline = pending.find('\n', pendingPos)) == std::string::npos){
+		//Move the partial line to the front before reading behind it
+		pending.erase(0, pendingPos);
+		pendingPos = 0;
 
-		if(currLine >= lines.size()) return Token(Token::Type::TEOF);
+		size_t size = pending.size();
+		pending.resize(size + CHUNK_SIZE);
+		stream->read(pending.data() + size, CHUNK_SIZE);
+		pending.resize(size + stream->gcount());
+		if(!stream->gcount()) break;
 	}
+	if(pendingPos == pending.size()) return false;
 
-	while(std::isspace(lines[currLine][currChar])){
-		currChar++;
+	size_t end = newline == std::string::npos ? pending.size() : newline;
+	size_t length = end - pendingPos;
+	if(length && pending[end - 1] == '\r') length--;
 
-		if(currChar >= lines[currLine].size()){
-			currChar = 0;
-			currLine++;
+	std::uint32_t start = inputSize;
+	if(!Fits(length)) return false;
+	lines.emplace_back(pending, pendingPos, length);
+	pendingPos = newline == std::string::npos ? pending.size() : newline + 1;
 
-			if(currLine >= lines.size()) return Token(Token::Type::TEOF);
-		}
+	lineStarts.push_back(start);
+	return true;
+}
+bool Tokenizer::Fits(size_t length){
+	//The newline counts too, and NO_LIMIT itself is never a valid offset
+	if(tooLarge || length >= NO_LIMIT - 1 - inputSize){
+		tooLarge = true;
+		return false;
+	}
+	inputSize += length + 1;
+	return true;
+}
+void Tokenizer::Release(std::uint32_t offset){
+	if(!stream || lineStarts.empty()) return;
+
+	//Lines still held for lexing keep their start
+	size_t line = std::upper_bound(lineStarts.begin(), lineStarts.end(), offset) - lineStarts.begin();
+	size_t count = std::min(line ? line - 1 : 0, droppedLines - releasedLines);
+	lineStarts.erase(lineStarts.begin(), lineStarts.begin() + count);
+	releasedLines += count;
+}
+long Tokenizer::ApplyEdit(const TextEdit &edit){
+	if(!lines.size()) lines.push_back("");
+	LineStarts();
+
+	size_t first = std::clamp<size_t>(edit.startLine, 1, lines.size()) - 1;
+	size_t last = std::clamp<size_t>(edit.endLine, first + 1, lines.size()) - 1;
+
+	std::string text = lines[first].substr(0, std::min(edit.startCol ? edit.startCol - 1 : 0, lines[first].size()));
+	text += edit.text;
+	if(edit.endCol && edit.endCol - 1 < lines[last].size())
+		text += lines[last].substr(edit.endCol - 1);
+
+	while(text.find('\r') != std::string::npos){
+		text.erase(text.find('\r'), 1);
 	}
 
-	line = currLine + 1;
-	chr = currChar + 1;
-	if(std::isalpha(lines[currLine][currChar])){
-		std::string val{};
-		while(std::isalnum(lines[currLine][currChar]) && currChar < lines[currLine].size()){
-			val += lines[currLine][currChar++];
+	std::vector<std::string> replaced;
+	size_t pos = 0;
+	while(true){
+		auto newline = text.find('\n', pos);
+		if(newline == std::string::npos){
+			replaced.push_back(text.substr(pos));
+			break;
 		}
+		replaced.push_back(text.substr(pos, newline - pos));
+		pos = newline + 1;
+	}
 
-		if(keywords.contains(val)) return Token(keywords.at(val), "", line);
+	long delta = 0;
+	for(size_t i = first; i <= last; ++i)
+		delta -= (long)lines[i].size() + 1;
+	for(auto &newLine: replaced)
+		delta += (long)newLine.size() + 1;
+	inputSize += delta;
+
+	//Shifts starting past the replaced lines move with them, the ones inside now start right after
+	//the first. The replaced lines are written below so that their shifts add up to the right start
+	std::uint32_t start = LineStart(first);
+	for(auto &shift: startShifts){
+		if(shift.first > last) shift.first = shift.first - (last - first + 1) + replaced.size();
+		else if(shift.first > first) shift.first = first + 1;
+	}
+
+	//Overwrite in place and only shift the tail when the line count changed
+	size_t common = std::min(replaced.size(), last - first + 1);
+	for(size_t i = 0; i < common; ++i)
+		lines[first + i] = std::move(replaced[i]);
+	if(replaced.size() > common){
+		lines.insert(lines.begin() + first + common, std::make_move_iterator(replaced.begin() + common), std::make_move_iterator(replaced.end()));
+		lineStarts.insert(lineStarts.begin() + first + common, replaced.size() - common, 0);
+	}
+	else{
+		lines.erase(lines.begin() + first + common, lines.begin() + last + 1);
+		lineStarts.erase(lineStarts.begin() + first + common, lineStarts.begin() + last + 1);
+	}
 
-		return Token(Token::Type::IDENT, val, line);
+	size_t next = first + replaced.size();
+	if(delta && next < lineStarts.size()) startShifts.emplace_back(next, (std::uint32_t)delta);
+	for(size_t i = first; i < next; ++i){
+		lineStarts[i] = start - (LineStart(i) - lineStarts[i]);
+		start += lines[i].size() + 1;
 	}
-	if(std::isdigit(lines[currLine][currChar])){
-		std::string val;
-		while((std::isdigit(lines[currLine][currChar]) || lines[currLine][currChar] == '.') && currChar < lines[currLine].size()){
-			val += lines[currLine][currChar++];
+	if(startShifts.size() > MAX_START_SHIFTS) FoldShifts();
+
+	return delta;
+}
+const std::vector<std::uint32_t> &Tokenizer::LineStarts() const{
+	if(lineStarts.empty() && !lines.empty() && !stream){
+		lineStarts.reserve(lines.size());
+
+		std::uint32_t offset = 0;
+		for(auto &line: lines){
+			lineStarts.push_back(offset);
+			offset += line.size() + 1;
 		}
+	}
 
-		if(std::count(val.begin(), val.end(), '.') > 1) return Token();
+	return lineStarts;
+}
+std::uint32_t Tokenizer::LineStart(size_t index) const{
+	//Offsets wrap around like the shifts do, only the sum has to come out right
+	std::uint32_t start = lineStarts[index];
+	for(auto &shift: startShifts)
+		if(shift.first <= index) start += shift.second;
+	return start;
+}
+size_t Tokenizer::LineIndex(std::uint32_t offset) const{
+	size_t low = 0, high = lineStarts.size();
+	while(high - low > 1){
+		size_t mid = low + (high - low) / 2;
+		if(LineStart(mid) <= offset) low = mid;
+		else high = mid;
+	}
+	return low;
+}
+void Tokenizer::FoldShifts(){
+	std::sort(startShifts.begin(), startShifts.end());
 
-		if(std::count(val.begin(), val.end(), '.') == 1) return Token(Token::Type::FLOATING_NUMBER, val, line);
-		return Token(Token::Type::INTEGER_NUMBER, val, line);
+	std::uint32_t shift = 0;
+	auto next = startShifts.begin();
+	for(size_t i = 0; i < lineStarts.size(); ++i){
+		for(; next != startShifts.end() && next->first <= i; ++next)
+			shift += next->second;
+		lineStarts[i] += shift;
 	}
-	if(lines[currLine][currChar] == '\''){
-		try{
-			std::string val{lines[currLine][++currChar], 0};
-			char lookahead = lines[currLine].at(currChar + 1);
-			if(lookahead != '\'') return Token();
-			currChar++;
+	startShifts.clear();
+}
+size_t Tokenizer::LineLength(size_t line) const{
+	if(line >= droppedLines) return lines[line - droppedLines].size();
+
+	size_t index = line - releasedLines;
+	std::uint32_t end = index + 1 < lineStarts.size() ? lineStarts[index + 1] : inputSize;
+	return end - lineStarts[index] - 1;
+}
+void Tokenizer::Seek(std::uint32_t offset){
+	//Streamed input only ever moves forward
+	if(stream) return;
+
+	auto &starts = LineStarts();
+	if(starts.empty()){
+		currLine = currChar = lineOffset = 0;
+		return;
+	}
+
+	currLine = LineIndex(offset);
+	lineOffset = LineStart(currLine);
+	currChar = offset - lineOffset;
+}
+SourceLocation Tokenizer::Locate(std::uint32_t offset) const{
+	auto &starts = LineStarts();
+	if(starts.empty()) return SourceLocation{ 1, 1 };
+	//Released lines can't be told apart anymore, the last of them stands in for all
+	if(offset < LineStart(0)) return SourceLocation{ releasedLines, 1 };
 
-			return Token(Token::Type::CHAR_LITERAL, val, line);
+	size_t index = LineIndex(offset);
+	size_t line = index + releasedLines;
+	size_t col = std::min<size_t>(offset - LineStart(index), LineLength(line)) + 1;
+
+	return SourceLocation{ line + 1, col };
+}
+std::string_view Tokenizer::Text(const Token &tok) const{
+	auto loc = Locate(tok.offset);
+	if(loc.line <= droppedLines || loc.line > LineCount()) return std::string_view();
+	return std::string_view(lines[loc.line - 1 - droppedLines]).substr(loc.col - 1, tok.length);
+}
+std::uint32_t Tokenizer::Offset(size_t line, size_t col) const{
+	auto &starts = LineStarts();
+	if(starts.empty()) return 0;
+	if(line > lines.size()) return inputSize;
+
+	line = std::max<size_t>(line, 1) - 1;
+	return LineStart(line) + std::min(std::max<size_t>(col, 1) - 1, lines[line].size());
+}
+Token Tokenizer::Make(Token::Type type, size_t begin){
+	if(currChar - begin > Token::MAX_LENGTH) return Token(Token::Type::ERR, lineOffset + begin, Token::MAX_LENGTH);
+	return Token(type, lineOffset + begin, currChar - begin);
+}
+Token Tokenizer::NextToken(){
+	//Skip blank lines and whitespace, keeping lineOffset in step with currLine
+	while(true){
+		if(currLine >= lines.size() && !PullLine()) return Token(Token::Type::TEOF, lineOffset ? lineOffset - 1 : 0);
+
+		if(currChar >= lines[currLine].size()){
+			lineOffset += lines[currLine].size() + 1;
+			currChar = 0;
+			if(stream){
+				lines.erase(lines.begin());
+				droppedLines++;
+			}
+			else{
+				currLine++;
+			}
+			continue;
 		}
-		catch(...){
-			return Token(Token::Type::ERR, "", line);
+		if(!std::isspace((unsigned char)lines[currLine][currChar])) break;
+		currChar++;
+	}
+
+	const std::string &src = lines[currLine];
+	size_t begin = currChar;
+	if(lineOffset + begin >= limit) return Token(Token::Type::TEOF, limit);
+
+	if(std::isalpha((unsigned char)src[begin])){
+		while(currChar < src.size() && std::isalnum((unsigned char)src[currChar])){
+			currChar++;
 		}
+		std::string_view word(src.data() + begin, currChar - begin);
+
+		auto keyword = keywords.find(word);
+		if(keyword != keywords.end()) return Make(keyword->second, begin);
+
+		Token vector = Make(Token::Type::TYPE_VECTOR, begin);
+		if(VectorKeyword(word, vector)) return vector;
+
+		Token ident = Make(Token::Type::IDENT, begin);
+		ident.symbol = Symbols::Intern(word);
+		//Lexes as ERR like an overlong token, the parser reports which it was
+		if(ident.symbol == Symbols::FULL) ident.type = Token::Type::ERR;
+		return ident;
 	}
-	if(lines[currLine][currChar] == '"'){
-		currChar++;
-		std::string val = "";
+	if(std::isdigit((unsigned char)src[begin])){
+		size_t dots = 0;
+		while(currChar < src.size() && (std::isdigit((unsigned char)src[currChar]) || src[currChar] == '.')){
+			dots += src[currChar++] == '.';
+		}
+		if(dots > 1) return Make(Token::Type::ERR, begin);
 
-		while(lines[currLine][currChar] != '"'){
-			val += lines[currLine][currChar++];
+		const char *first = src.data() + begin, *last = src.data() + currChar;
+		Token number = Make(dots ? Token::Type::FLOATING_NUMBER : Token::Type::INTEGER_NUMBER, begin);
+		auto result = dots ? std::from_chars(first, last, number.floatVal) : std::from_chars(first, last, number.intVal);
+		if(result.ec != std::errc() || result.ptr != last) return Make(Token::Type::ERR, begin);
 
-			if(currChar >= lines[currLine].size()) return Token(Token::Type::ERR, "", line);
+		return number;
+	}
+	if(src[begin] == '\''){
+		currChar++;
+		if(begin + 2 >= src.size() || src[begin + 2] != '\'') return Make(Token::Type::ERR, begin);
+		currChar = begin + 3;
+
+		Token literal = Make(Token::Type::CHAR_LITERAL, begin);
+		literal.intVal = (unsigned char)src[begin + 1];
+		return literal;
+	}
+	if(src[begin] == '"'){
+		auto close = src.find('"', begin + 1);
+		if(close == std::string::npos){
+			currChar = src.size();
+			return Make(Token::Type::ERR, begin);
 		}
+		currChar = close + 1;
 
+		Token literal = Make(Token::Type::STRING_LITERAL, begin);
+		literal.symbol = Symbols::Intern(std::string_view(src.data() + begin + 1, close - begin - 1));
+		if(literal.symbol == Symbols::FULL) literal.type = Token::Type::ERR;
+		return literal;
 	}
 
-	char lookahead = (currChar + 1 >= lines[currLine].size() ? '\0' : lines[currLine][currChar + 1]);
-	switch(lines[currLine][currChar++]){
+	char lookahead = (currChar + 1 >= src.size() ? '\0' : src[currChar + 1]);
+	switch(src[currChar++]){
 		case '+': 
 			if(lookahead == '='){
 				currChar++;
-				return Token(Token::Type::ADDASSIGN, "", line);
+				return Make(Token::Type::ADDASSIGN, begin);
 			}
-			return Token(Token::Type::PLUS, "", line);
+			return Make(Token::Type::PLUS, begin);
 		case '-': 
 			if(lookahead == '='){
 				currChar++;
-				return Token(Token::Type::SUBASSIGN, "", line);
+				return Make(Token::Type::SUBASSIGN, begin);
 			}
 			else if(lookahead == '>'){
 				currChar++;
-				return Token(Token::Type::DEREFERENCE, "", line);
+				return Make(Token::Type::DEREFERENCE, begin);
 			}
-			return Token(Token::Type::MINUS, "", line);
+			return Make(Token::Type::MINUS, begin);
 		case '*': 
 			if(lookahead == '='){
 				currChar++;
-				return Token(Token::Type::MULTASSIGN, "", line);
+				return Make(Token::Type::MULTASSIGN, begin);
 			}
-			return Token(Token::Type::STAR, "", line);
+			return Make(Token::Type::STAR, begin);
 		case '/': 
 			if(lookahead == '='){
 				currChar++;
-				return Token(Token::Type::DIVASSIGN, "", line);
+				return Make(Token::Type::DIVASSIGN, begin);
 			}
-			return Token(Token::Type::SLASH, "", line);
+			return Make(Token::Type::SLASH, begin);
 
 		case '=': 
 			if(lookahead == '='){
 				currChar++;
-				return Token(Token::Type::EQ, "", line);
+				return Make(Token::Type::EQ, begin);
 			}
-			return Token(Token::Type::ASSIGN, "", line);
+			return Make(Token::Type::ASSIGN, begin);
 		case '!':
 			if(lookahead == '='){
 				currChar++;
-				return Token(Token::Type::NEQ, "", line);
+				return Make(Token::Type::NEQ, begin);
 			}
-			return Token(Token::Type::NOT, "", line);
+			return Make(Token::Type::NOT, begin);
 		case '>': 
 			if(lookahead == '='){
 				currChar++;
-				return Token(Token::Type::GEQ, "", line);
+				return Make(Token::Type::GEQ, begin);
 			}
-			return Token(Token::Type::GREATER, "", line);
+			return Make(Token::Type::GREATER, begin);
 		case '<': 
 			if(lookahead == '='){
 				currChar++;
-				return Token(Token::Type::LEQ, "", line);
+				return Make(Token::Type::LEQ, begin);
 			}
-			return Token(Token::Type::LESS, "", line);
+			return Make(Token::Type::LESS, begin);
 
-		case ';': return Token(Token::Type::SEMICOLON, "", line);
-		case ',': return Token(Token::Type::COMMA, "", line);
-		case '.': return Token(Token::Type::DOT, "", line);
+		case ';': return Make(Token::Type::SEMICOLON, begin);
+		case ',': return Make(Token::Type::COMMA, begin);
+		case '.': return Make(Token::Type::DOT, begin);
+		case ':': return Make(Token::Type::COLON, begin);
 
-		case '(': return Token(Token::Type::OPEN_PARENTH, "", line);
-		case ')': return Token(Token::Type::CLOSED_PARENTH, "", line);
-		case '{': return Token(Token::Type::OPEN_BRACKET, "", line);
-		case '}': return Token(Token::Type::CLOSED_BRACKET, "", line);
+		case '(': return Make(Token::Type::OPEN_PARENTH, begin);
+		case ')': return Make(Token::Type::CLOSED_PARENTH, begin);
+		case '{': return Make(Token::Type::OPEN_BRACKET, begin);
+		case '}': return Make(Token::Type::CLOSED_BRACKET, begin);
+		case '[': return Make(Token::Type::OPEN_SQUARE, begin);
+		case ']': return Make(Token::Type::CLOSED_SQUARE, begin);
 	}
 
-	return Token();
+	return Make(Token::Type::ERR, begin);
 }
\ No newline at end of file
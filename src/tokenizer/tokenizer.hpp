@@ -2,9 +2,15 @@
 
 #include <string>
 #include <vector>
+#include <utility>
+#include <cstdint>
+#include <istream>
+#include <string_view>
+#include <type_traits>
+#include "tokenizer/symbols.hpp"
 
 struct Token{
-	enum class Type: int {
+	enum class Type: std::int8_t {
 		ERR = -2,
 		TEOF = -1,
 
@@ -24,6 +30,7 @@ struct Token{
 		TYPE_LONG,
 		TYPE_FLOAT,
 		TYPE_DOUBLE,
+		TYPE_VECTOR,
 		TYPE_ENUM,
 		TYPE_STRUCT,
 		TYPES_END = TYPE_STRUCT,
@@ -54,49 +61,138 @@ struct Token{
 		COMMA,
 		DOT,
 		DEREFERENCE,
+		COLON,
 
 		IF,
 		ELSE,
 		WHILE,
+		SWITCH,
+		CASE,
+		DEFAULT,
 
 		RETURN,
+		EXPORT,
+		INLINE,
+		RESTRICT,
+		SOA,
+		TAILCALL,
 		
 		OPEN_PARENTH,
 		CLOSED_PARENTH,
 		OPEN_BRACKET,
 		CLOSED_BRACKET,
+		OPEN_SQUARE,
+		CLOSED_SQUARE,
 	};
 	
-	Type type;
-	std::string val;
-	size_t line;
+	Type type = Type::ERR;
+	std::uint16_t length = 0;
+	//Byte offset into the source, Tokenizer::Locate turns it into a line and column
+	std::uint32_t offset = 0;
+	//Literals are parsed once by the tokenizer, identifiers and strings are interned
+	union{
+		std::int64_t intVal = 0;
+		double floatVal;
+		std::uint32_t symbol;
+	};
 
-	explicit Token(): type(Type::ERR), val(""), line(0) {}
-	Token(Type type_, const std::string &val_ = "", size_t line_ = 0): type(type_), val(val_), line(line_) {}
-	Token(const Token &tok):type(tok.type), val(tok.val), line(tok.line) {}
-	Token(const Token &&tok):type(tok.type), val(std::move(tok.val)), line(tok.line) {}
+	//Longer spellings lex as ERR instead of being cut off
+	static constexpr std::size_t MAX_LENGTH = UINT16_MAX;
 
-	Token &operator=(const Token &other){
-		type = other.type;
-		val = other.val;
-		line = other.line;
+	Token() = default;
+	Token(Type type_, std::uint32_t offset_ = 0, std::uint16_t length_ = 0): type(type_), length(length_), offset(offset_) {}
 
-		return *this;
-	}
+	//Spelling of an identifier or string literal, empty for everything else
+	const std::string &Name() const;
+	std::uint32_t End() const { return offset + length; }
+	//Vector type keywords like float4 keep the element's keyword and the lane count in intVal
+	Type VectorElement() const { return (Type)(intVal >> 8); }
+	std::size_t VectorLanes() const { return intVal & 0xFF; }
 
 	static const Token ERROR;
 };
+static_assert(sizeof(Token) == 16 && std::is_trivially_copyable_v<Token>);
+
+struct SourceLocation{
+	size_t line, col;
+};
+
+//A text change as an editor reports it. Positions are 1-based like diagnostics, the end is exclusive
+struct TextEdit{
+	size_t startLine, startCol;
+	size_t endLine, endCol;
+	std::string text;
+};
 
 class Tokenizer{
 	private:
 	std::vector<std::string> lines {};
-	size_t line = 1, chr = 1;
 	size_t currLine = 0, currChar = 0;
+	//Offset of lines[currLine], kept up to date while lexing forward
+	std::uint32_t lineOffset = 0;
+	//Tokens starting at or after this offset read as TEOF
+	std::uint32_t limit = NO_LIMIT;
+	//Start offset of every line, built on first use and patched by edits. For streamed input it
+	//grows as lines are read and starts at the first line not released
+	mutable std::vector<std::uint32_t> lineStarts {};
+	//An edit moves every line after it. Rather than rewrite their starts each time, the first line
+	//moved and by how much is kept here and added on lookup, until there are too many to go through
+	std::vector<std::pair<size_t, std::uint32_t>> startShifts {};
+	//Bytes taken so far. Offsets are 32-bit, input that would wrap them is cut off
+	std::uint32_t inputSize = 0;
+	bool tooLarge = false;
+
+	//Streamed input is read a chunk at a time as the lexer gets to it. Only the line being
+	//lexed is kept, lines before it are dropped
+	std::istream *stream = nullptr;
+	std::string pending;
+	size_t pendingPos = 0;
+	size_t droppedLines = 0, releasedLines = 0;
+
+	static constexpr size_t CHUNK_SIZE = 1 << 16;
+	static constexpr size_t MAX_START_SHIFTS = 64;
+
+	const std::vector<std::uint32_t> &LineStarts() const;
+	std::uint32_t LineStart(size_t index) const;
+	//Index into lineStarts of the last line starting at or before offset
+	size_t LineIndex(std::uint32_t offset) const;
+	void FoldShifts();
+	size_t LineLength(size_t line) const;
+	bool PullLine();
+	bool Fits(size_t length);
+	Token Make(Token::Type type, size_t begin);
 
 	public:
+	static constexpr std::uint32_t NO_LIMIT = UINT32_MAX;
+
 	Tokenizer() = default;
 
 	void AddLine(std::string line);
+	//Reads the source from in while lexing instead of up front, so memory doesn't grow with
+	//the input. Streamed input is read once, it can't be edited or sought back into
+	void SetStream(std::istream &in);
+	bool IsStreamed() const { return stream; }
+	//Whether the input ran past 4 GiB and the rest of it was not read
+	bool TooLarge() const { return tooLarge; }
+	//Forgets where the streamed lines before offset start, once nothing will be located there again
+	void Release(std::uint32_t offset);
+	//Splices the edit into the buffer and returns how many bytes it added (or removed, if negative)
+	long ApplyEdit(const TextEdit &edit);
+
+	//Restarts lexing at an offset, nothing before it is looked at
+	void Seek(std::uint32_t offset);
+	void SetLimit(std::uint32_t offset = NO_LIMIT) { limit = offset; }
+
+	SourceLocation Locate(std::uint32_t offset) const;
+	//Source text a token was lexed from
+	std::string_view Text(const Token &tok) const;
+	//Offset of a 1-based position, clamped to the buffer
+	std::uint32_t Offset(size_t line, size_t col) const;
+	size_t LineCount() const { return droppedLines + lines.size(); }
 
 	Token NextToken();
+
+	//Whether word names a vector type like float4, a scalar keyword and a lane count. tok gets
+	//the element and lanes if it does
+	static bool VectorKeyword(std::string_view word, Token &tok);
 };
\ No newline at end of file
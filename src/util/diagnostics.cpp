@@ -0,0 +1,68 @@
+#include "diagnostics.hpp"
+#include <algorithm>
+#include <unordered_map>
+
+static const char *SeverityName(Diagnostics::Severity severity){
+	switch(severity){
+		case Diagnostics::Severity::NOTE:
+			return "note";
+		case Diagnostics::Severity::WARNING:
+			return "warning";
+		case Diagnostics::Severity::ERROR:
+			return "error";
+	}
+
+	return "";
+}
+
+void Diagnostics::Report(Severity severity, const std::string &file, size_t line, size_t col, const std::string &message){
+	std::string msg = message;
+	while(msg.length() && msg.back() == '\n') msg.pop_back();
+
+	diagnostics.push_back(Diagnostic{ severity, file, line, col, msg });
+	if(severity != Severity::ERROR) return;
+
+	errorCount++;
+	if(errorLimit && errorCount >= errorLimit){
+		if(!limitNote) limitNote = Diagnostic{ Severity::NOTE, file, line, col, "too many errors emitted, stopping now" };
+		throw LimitReached{};
+	}
+}
+
+void Diagnostics::Flush(std::ostream &out){
+	if(!diagnostics.size() && !limitNote) return;
+
+	//Files come in the order they were given in, which is the order they were first reported in
+	std::unordered_map<std::string, size_t> fileOrder;
+	for(auto &diag: diagnostics)
+		fileOrder.try_emplace(diag.file, fileOrder.size());
+	std::stable_sort(diagnostics.begin(), diagnostics.end(),
+		[&fileOrder](const Diagnostic &a, const Diagnostic &b){
+			if(a.file != b.file) return fileOrder.at(a.file) < fileOrder.at(b.file);
+			if(a.line != b.line) return a.line < b.line;
+			return a.col < b.col;
+		}
+	);
+	//Whatever was sorted in front of it, the limit note ends the list
+	if(limitNote) diagnostics.push_back(*limitNote);
+
+	std::string buffer;
+	for(auto &diag: diagnostics){
+		buffer += diag.file + ":" + std::to_string(diag.line) + ":" + std::to_string(diag.col) + ": ";
+		buffer += SeverityName(diag.severity);
+		buffer += ": " + diag.message + "\n";
+	}
+	if(errorCount){
+		buffer += std::to_string(errorCount) + (errorCount == 1 ? " error" : " errors") + " generated.\n";
+	}
+
+	out.write(buffer.data(), buffer.size());
+	out.flush();
+	diagnostics.clear();
+	limitNote.reset();
+}
+void Diagnostics::Clear(){
+	diagnostics.clear();
+	limitNote.reset();
+	errorCount = 0;
+}
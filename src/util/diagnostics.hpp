@@ -0,0 +1,51 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <optional>
+#include <iostream>
+
+//Collects every diagnostic of a run and writes them out in one go at the end,
+//so a single compile reports all errors instead of stopping at the first one.
+class Diagnostics{
+	public:
+	enum class Severity{
+		NOTE,
+		WARNING,
+		ERROR
+	};
+
+	struct Diagnostic{
+		Severity severity;
+		std::string file;
+		size_t line, col;
+		std::string message;
+	};
+
+	//Thrown by Log::Error so the parser can unwind to the nearest statement and resynchronize
+	struct Recover{};
+	//Thrown once the error limit is hit, parsing stops altogether
+	struct LimitReached{};
+
+	static constexpr size_t DEFAULT_ERROR_LIMIT = 20;
+
+	explicit Diagnostics(size_t errorLimit_ = DEFAULT_ERROR_LIMIT): errorLimit(errorLimit_) {}
+
+	void Report(Severity severity, const std::string &file, size_t line, size_t col, const std::string &message);
+
+	//0 means no limit
+	void SetErrorLimit(size_t limit) { errorLimit = limit; }
+	size_t ErrorCount() const { return errorCount; }
+	bool HasErrors() const { return errorCount > 0; }
+
+	void Flush(std::ostream &out = std::cerr);
+	//Drops everything reported so far, for when the whole input is parsed again
+	void Clear();
+
+	private:
+	std::vector<Diagnostic> diagnostics;
+	//Set once the error limit is hit, printed after everything else
+	std::optional<Diagnostic> limitNote;
+	size_t errorLimit;
+	size_t errorCount = 0;
+};
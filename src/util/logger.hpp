@@ -1,27 +1,45 @@
 #pragma once
 
-#include <iostream>
+#include <sstream>
 #include <utility>
 #include "parser/parser.hpp"
+#include "util/diagnostics.hpp"
 
 class Log{
+	template<typename Arg, typename ...Args>
+	static inline void Report(const Parser &parser, std::uint32_t offset, Diagnostics::Severity severity, Arg&& arg, Args&& ...args){
+		std::ostringstream ss;
+		ss << std::forward<Arg>(arg);
+		((ss << std::forward<Args>(args)), ...);
+
+		auto loc = parser.tokenizer.Locate(offset);
+		parser.diag.Report(severity, parser.fileName, loc.line, loc.col, ss.str());
+	}
+	template<typename Arg, typename ...Args>
+	static inline void Report(const Parser &parser, Diagnostics::Severity severity, Arg&& arg, Args&& ...args){
+		Report(parser, parser.currTok.offset, severity, std::forward<Arg>(arg), std::forward<Args>(args)...);
+	}
+
 	public:
 	template<typename Arg, typename ...Args>
 	static inline void Info(const Parser &parser, Arg&& arg, Args&& ...args){
-		std::cout << "[INFO] Line " << parser.currTok.line << " " << std::forward<Arg>(arg);
-		((std::cout << std::forward<Args>(args)), ...);
+		Report(parser, Diagnostics::Severity::NOTE, std::forward<Arg>(arg), std::forward<Args>(args)...);
 	}
 
 	template<typename Arg, typename ...Args>
 	static inline void Warn(const Parser &parser, Arg&& arg, Args&& ...args){
-		std::cout << "[WARNING] Line " << parser.currTok.line << " " << std::forward<Arg>(arg);
-		((std::cout << std::forward<Args>(args)), ...);
+		Report(parser, Diagnostics::Severity::WARNING, std::forward<Arg>(arg), std::forward<Args>(args)...);
 	}
 
+	//Never returns, unwinds to the statement the parser can resynchronize on
+	template<typename Arg, typename ...Args>
+	[[noreturn]] static inline void Error(const Parser &parser, Arg&& arg, Args&& ...args){
+		Report(parser, Diagnostics::Severity::ERROR, std::forward<Arg>(arg), std::forward<Args>(args)...);
+		throw Diagnostics::Recover{};
+	}
+	//Reports at a token of the tree and returns, for the passes that run once parsing is done
 	template<typename Arg, typename ...Args>
-	static inline void Error(const Parser &parser, Arg&& arg, Args&& ...args){
-		std::cout << "[ERROR] Line " << parser.currTok.line << " " << std::forward<Arg>(arg);
-		((std::cout << std::forward<Args>(args)), ...);
-		exit(1);
+	static inline void ErrorAt(const Parser &parser, const Token &at, Arg&& arg, Args&& ...args){
+		Report(parser, at.offset, Diagnostics::Severity::ERROR, std::forward<Arg>(arg), std::forward<Args>(args)...);
 	}
-};
\ No newline at end of file
+};
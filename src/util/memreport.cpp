@@ -0,0 +1,121 @@
+#include "memreport.hpp"
+#include <new>
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <malloc.h>
+#include <sys/resource.h>
+
+std::atomic<bool> MemReport::enabled{false};
+
+//Kept as plain atomics so the hook below never allocates and stays usable
+//during static initialization and from LLVM worker threads
+static std::atomic<std::uint64_t> totalBytes{0};
+static std::atomic<std::uint64_t> totalAllocs{0};
+static std::atomic<std::int64_t> liveBytes{0};
+
+static MemReport::Phase phases[MemReport::MAX_PHASES];
+static std::size_t phaseCount = 0;
+//Index of the running phase, MAX_PHASES while none is
+static std::size_t currentPhase = MemReport::MAX_PHASES;
+//Phases that came after the table was full, only their number is kept
+static std::size_t droppedPhases = 0;
+static std::uint64_t startBytes = 0, startAllocs = 0;
+
+static inline void *CountedAlloc(std::size_t sz, std::size_t align = 0){
+	if(!sz) sz = 1;
+
+	void *ptr = align ? std::aligned_alloc(align, (sz + align - 1) / align * align) : std::malloc(sz);
+	if(!ptr) throw std::bad_alloc();
+	if(!MemReport::Enabled()) return ptr;
+
+	std::size_t usable = malloc_usable_size(ptr);
+	totalBytes.fetch_add(usable, std::memory_order_relaxed);
+	totalAllocs.fetch_add(1, std::memory_order_relaxed);
+	liveBytes.fetch_add(usable, std::memory_order_relaxed);
+
+	return ptr;
+}
+static inline void CountedFree(void *ptr){
+	if(!ptr) return;
+
+	//Blocks allocated before Enable() are subtracted as well, so live bytes can read a little low
+	if(MemReport::Enabled())
+		liveBytes.fetch_sub(malloc_usable_size(ptr), std::memory_order_relaxed);
+	std::free(ptr);
+}
+
+void *operator new(std::size_t sz) { return CountedAlloc(sz); }
+void *operator new[](std::size_t sz) { return CountedAlloc(sz); }
+void *operator new(std::size_t sz, std::align_val_t al) { return CountedAlloc(sz, (std::size_t)al); }
+void *operator new[](std::size_t sz, std::align_val_t al) { return CountedAlloc(sz, (std::size_t)al); }
+void *operator new(std::size_t sz, const std::nothrow_t&) noexcept {
+	try{ return CountedAlloc(sz); }
+	catch(...){ return nullptr; }
+}
+void *operator new[](std::size_t sz, const std::nothrow_t&) noexcept {
+	try{ return CountedAlloc(sz); }
+	catch(...){ return nullptr; }
+}
+
+void operator delete(void *ptr) noexcept { CountedFree(ptr); }
+void operator delete[](void *ptr) noexcept { CountedFree(ptr); }
+void operator delete(void *ptr, std::size_t) noexcept { CountedFree(ptr); }
+void operator delete[](void *ptr, std::size_t) noexcept { CountedFree(ptr); }
+void operator delete(void *ptr, std::align_val_t) noexcept { CountedFree(ptr); }
+void operator delete[](void *ptr, std::align_val_t) noexcept { CountedFree(ptr); }
+void operator delete(void *ptr, std::size_t, std::align_val_t) noexcept { CountedFree(ptr); }
+void operator delete[](void *ptr, std::size_t, std::align_val_t) noexcept { CountedFree(ptr); }
+
+//A phase started again, like parse for every input file, adds to the record it already has
+void MemReport::BeginPhase(const char *name){
+	EndPhase();
+
+	std::size_t index = 0;
+	while(index < phaseCount && std::strcmp(phases[index].name, name)) ++index;
+	if(index == MAX_PHASES){
+		droppedPhases++;
+		return;
+	}
+	if(index == phaseCount) phases[phaseCount++].name = name;
+
+	currentPhase = index;
+	startBytes = totalBytes.load(std::memory_order_relaxed);
+	startAllocs = totalAllocs.load(std::memory_order_relaxed);
+}
+void MemReport::EndPhase(){
+	if(currentPhase == MAX_PHASES) return;
+
+	auto &phase = phases[currentPhase];
+	phase.bytes += totalBytes.load(std::memory_order_relaxed) - startBytes;
+	phase.allocs += totalAllocs.load(std::memory_order_relaxed) - startAllocs;
+	phase.liveAtEnd = liveBytes.load(std::memory_order_relaxed);
+	currentPhase = MAX_PHASES;
+}
+
+std::size_t MemReport::PeakRSS(){
+	rusage usage{};
+	if(getrusage(RUSAGE_SELF, &usage)) return 0;
+
+	//ru_maxrss is in kilobytes on linux
+	return (std::size_t)usage.ru_maxrss * 1024;
+}
+
+void MemReport::Print(std::ostream &out){
+	EndPhase();
+
+	out << "Memory report:\n";
+	out << std::left << std::setw(12) << "  phase" << std::right
+		<< std::setw(16) << "allocated" << std::setw(12) << "allocs" << std::setw(16) << "live" << "\n";
+	for(std::size_t i = 0; i < phaseCount; ++i){
+		out << "  " << std::left << std::setw(10) << phases[i].name << std::right
+			<< std::setw(16) << phases[i].bytes
+			<< std::setw(12) << phases[i].allocs
+			<< std::setw(16) << phases[i].liveAtEnd << "\n";
+	}
+	if(droppedPhases)
+		out << "  (" << droppedPhases << " more phase" << (droppedPhases == 1 ? "" : "s") << " past the first " << MAX_PHASES << " not recorded)\n";
+	out << "  total     " << std::setw(16) << totalBytes.load() << std::setw(12) << totalAllocs.load() << std::setw(16) << liveBytes.load() << "\n";
+	out << "Peak RSS: " << PeakRSS() / 1024 << " KiB\n";
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+
+//Counts every allocation that goes through the global operator new and attributes it to the
+//compilation phase that was active at the time. That is all of ours and most of LLVM's, what
+//LLVM takes straight from malloc (bump allocators, SmallVector buffers) isn't counted.
+class MemReport{
+	public:
+	struct Phase{
+		const char *name = nullptr;
+		std::uint64_t bytes = 0;
+		std::uint64_t allocs = 0;
+		std::int64_t liveAtEnd = 0;
+	};
+
+	static constexpr std::size_t MAX_PHASES = 16;
+
+	//Allocations are only counted from here on, without it the hooks go straight to malloc
+	static void Enable() { enabled.store(true, std::memory_order_relaxed); }
+	static bool Enabled() { return enabled.load(std::memory_order_relaxed); }
+
+	//Closes the running phase (if any) and starts counting into name's record
+	static void BeginPhase(const char *name);
+	static void EndPhase();
+
+	static std::size_t PeakRSS();
+	static void Print(std::ostream &out = std::cerr);
+
+	private:
+	static std::atomic<bool> enabled;
+};
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <algorithm>
+#include <type_traits>
+
+//Bounded lock-free queue for exactly one producer and one consumer thread. Each side keeps a
+//private copy of the other side's index and only reloads the shared one when it looks full
+//(or empty), so in steady state a batch costs one release store per side.
+template<typename T, std::size_t Capacity>
+class SpscRing{
+	static_assert(std::is_trivially_copyable_v<T>, "Items are copied with plain assignment");
+	static_assert(Capacity && !(Capacity & (Capacity - 1)), "Capacity must be a power of two");
+
+	static constexpr std::size_t MASK = Capacity - 1;
+
+	public:
+	//Producer side, copies as many of the items as fit and returns how many that was
+	std::size_t TryPush(const T *items, std::size_t count){
+		std::size_t pos = tail.load(std::memory_order_relaxed);
+		if(Capacity - (pos - cachedHead) < count)
+			cachedHead = head.load(std::memory_order_acquire);
+
+		std::size_t n = std::min(count, Capacity - (pos - cachedHead));
+		for(std::size_t i = 0; i < n; ++i)
+			buffer[(pos + i) & MASK] = items[i];
+
+		tail.store(pos + n, std::memory_order_release);
+		return n;
+	}
+	//Consumer side, takes up to max items and returns how many were available
+	std::size_t TryPop(T *out, std::size_t max){
+		std::size_t pos = head.load(std::memory_order_relaxed);
+		if(cachedTail - pos < max)
+			cachedTail = tail.load(std::memory_order_acquire);
+
+		std::size_t n = std::min(max, cachedTail - pos);
+		for(std::size_t i = 0; i < n; ++i)
+			out[i] = buffer[(pos + i) & MASK];
+
+		head.store(pos + n, std::memory_order_release);
+		return n;
+	}
+
+	private:
+	//Consumer's line
+	alignas(64) std::atomic<std::size_t> head{0};
+	std::size_t cachedTail = 0;
+	//Producer's line
+	alignas(64) std::atomic<std::size_t> tail{0};
+	std::size_t cachedHead = 0;
+
+	alignas(64) T buffer[Capacity];
+};
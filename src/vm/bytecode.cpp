@@ -0,0 +1,190 @@
+#include "bytecode.hpp"
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+
+using namespace Bytecode;
+
+namespace{
+	struct Header{
+		char magic[4];
+		std::uint32_t version;
+		std::uint32_t functions, code, constants, globals, init, strings;
+	};
+	struct FunctionRecord{
+		std::uint32_t name;
+		std::uint32_t code, codeCount;
+		std::uint16_t params, frameSize;
+		std::uint32_t ret;
+	};
+	static_assert(sizeof(Header) == 32 && sizeof(FunctionRecord) == 20);
+}
+
+std::uint32_t Program::Find(const std::string &name) const {
+	for(std::uint32_t i = 0; i < functions.size(); ++i){
+		if(functions[i].name == name) return i;
+	}
+	return NONE;
+}
+
+bool Program::Verify(std::string &error) const {
+	if(init != NONE && init >= functions.size()){
+		error = "initializer is not a function";
+		return false;
+	}
+
+	for(auto &func: functions){
+		if(!func.codeCount || func.code > code.size() || func.codeCount > code.size() - func.code || func.frameSize < func.params){
+			error = "function " + func.name + " is out of bounds";
+			return false;
+		}
+		//Running off the end would continue into the next function
+		auto last = code[func.code + func.codeCount - 1].op;
+		if(last != Op::JMP && last != Op::TAILCALL && last != Op::RET && last != Op::RETVOID){
+			error = "function " + func.name + " doesn't end in a jump or return";
+			return false;
+		}
+
+		for(std::uint32_t i = 0; i < func.codeCount; ++i){
+			auto &instr = code[func.code + i];
+			if(instr.op >= Op::COUNT){
+				error = "invalid opcode in " + func.name;
+				return false;
+			}
+
+			std::int64_t target = (std::int64_t)i + 1 + (std::int32_t)instr.Wide();
+			bool jumpValid = target >= 0 && target < func.codeCount;
+			auto reg = [&func](std::uint16_t r){ return r < func.frameSize; };
+			bool valid = true;
+			switch(FORMATS[(size_t)instr.op]){
+				case Format::NONE: break;
+				case Format::R: valid = reg(instr.a); break;
+				case Format::RR: valid = reg(instr.a) && reg(instr.b); break;
+				case Format::RRR: valid = reg(instr.a) && reg(instr.b) && reg(instr.c); break;
+				case Format::RK: valid = reg(instr.a) && instr.Wide() < constants.size(); break;
+				case Format::RG: valid = reg(instr.a) && instr.Wide() < globals; break;
+				case Format::J: valid = jumpValid; break;
+				case Format::RJ: valid = reg(instr.a) && jumpValid; break;
+				case Format::BOUND: valid = reg(instr.a); break;
+				case Format::CALL:
+					//The arguments are the callee's first registers, they have to be in the caller's frame
+					valid = instr.Wide() < functions.size() && instr.a + functions[instr.Wide()].params <= func.frameSize;
+					break;
+			}
+			if(!valid){
+				error = "operand out of range in " + func.name + " at " + std::to_string(i);
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+void Program::Disassemble(std::ostream &out) const {
+	for(std::uint32_t f = 0; f < functions.size(); ++f){
+		auto &func = functions[f];
+		out << func.name << ": params " << func.params << ", frame " << func.frameSize << (f == init ? ", initializer" : "") << "\n";
+
+		for(std::uint32_t i = 0; i < func.codeCount; ++i){
+			auto &instr = code[func.code + i];
+			auto target = (std::int64_t)i + 1 + (std::int32_t)instr.Wide();
+			char addr[8];
+			std::snprintf(addr, sizeof(addr), "%04u", i);
+			out << "  " << addr << " " << NAMES[(size_t)instr.op];
+
+			switch(FORMATS[(size_t)instr.op]){
+				case Format::NONE: break;
+				case Format::R: out << " r" << instr.a; break;
+				case Format::RR: out << " r" << instr.a << ", r" << instr.b; break;
+				case Format::RRR: out << " r" << instr.a << ", r" << instr.b << ", r" << instr.c; break;
+				case Format::RK:
+					out << " r" << instr.a << ", k" << instr.Wide();
+					if(instr.Wide() < constants.size()) out << " (" << constants[instr.Wide()].i << ")";
+					break;
+				case Format::RG: out << " r" << instr.a << ", g" << instr.Wide(); break;
+				case Format::J: out << " " << target; break;
+				case Format::RJ: out << " r" << instr.a << ", " << target; break;
+				case Format::BOUND: out << " r" << instr.a << ", " << instr.Wide(); break;
+				case Format::CALL:
+					out << " r" << instr.a << ", ";
+					if(instr.Wide() < functions.size()) out << functions[instr.Wide()].name;
+					else out << "f" << instr.Wide();
+					break;
+			}
+			out << "\n";
+		}
+	}
+}
+
+bool Program::Write(const std::string &path) const {
+	std::string strings{ '\0' };
+	std::vector<FunctionRecord> records;
+	for(auto &func: functions){
+		records.push_back(FunctionRecord{ (std::uint32_t)strings.size(), func.code, func.codeCount, func.params, func.frameSize, (std::uint32_t)func.ret });
+		strings += func.name;
+		strings += '\0';
+	}
+
+	Header header{};
+	std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+	header.version = VERSION;
+	header.functions = functions.size();
+	header.code = code.size();
+	header.constants = constants.size();
+	header.globals = globals;
+	header.init = init;
+	header.strings = strings.size();
+
+	std::ofstream out(path, std::ios::binary | std::ios::trunc);
+	out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	out.write(reinterpret_cast<const char*>(records.data()), records.size() * sizeof(FunctionRecord));
+	out.write(reinterpret_cast<const char*>(code.data()), code.size() * sizeof(Instruction));
+	out.write(reinterpret_cast<const char*>(constants.data()), constants.size() * sizeof(Slot));
+	out.write(strings.data(), strings.size());
+	return (bool)out;
+}
+
+bool Program::Read(const std::string &path){
+	std::ifstream in(path, std::ios::binary);
+	if(!in) return false;
+	std::string data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+	if(data.size() < sizeof(Header)) return false;
+
+	Header header;
+	std::memcpy(&header, data.data(), sizeof(header));
+	if(std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) || header.version != VERSION) return false;
+
+	//Sections follow the header back to back, the sizes have to add up to the file's
+	std::uint64_t size = sizeof(Header) + (std::uint64_t)header.functions * sizeof(FunctionRecord) +
+		(std::uint64_t)header.code * sizeof(Instruction) + (std::uint64_t)header.constants * sizeof(Slot) + header.strings;
+	if(size != data.size() || !header.strings || data.back() != '\0') return false;
+
+	const char *at = data.data() + sizeof(Header);
+	std::vector<FunctionRecord> records(header.functions);
+	std::memcpy(records.data(), at, records.size() * sizeof(FunctionRecord));
+	at += records.size() * sizeof(FunctionRecord);
+	code.resize(header.code);
+	std::memcpy(code.data(), at, code.size() * sizeof(Instruction));
+	at += code.size() * sizeof(Instruction);
+	constants.resize(header.constants);
+	std::memcpy(constants.data(), at, constants.size() * sizeof(Slot));
+	at += constants.size() * sizeof(Slot);
+	const char *strings = at;
+
+	functions.clear();
+	for(auto &rec: records){
+		if(rec.name >= header.strings || rec.ret > (std::uint32_t)Kind::PTR) return false;
+		functions.push_back(Function{ strings + rec.name, rec.code, rec.codeCount, rec.params, rec.frameSize, (Kind)rec.ret });
+	}
+	globals = header.globals;
+	init = header.init;
+	return true;
+}
+
+bool Program::IsBytecode(const std::string &path){
+	char magic[sizeof(MAGIC)] = {};
+	std::ifstream in(path, std::ios::binary);
+	in.read(magic, sizeof(magic));
+	return in && !std::memcmp(magic, MAGIC, sizeof(MAGIC));
+}
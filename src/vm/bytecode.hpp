@@ -0,0 +1,129 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <ostream>
+
+//Register based bytecode for the VM. Every function has a frame of 64-bit registers, the
+//parameters come first. Integers are kept sign extended from their width (an i1 true is -1),
+//floats as doubles rounded to the width they were stored with, so conversions that widen
+//are free and only narrowing ones cost an instruction.
+namespace Bytecode{
+	constexpr char MAGIC[4] = { 'C', 'B', 'Y', 'T' };
+	constexpr std::uint32_t VERSION = 2;
+	constexpr std::uint32_t NONE = 0xFFFFFFFF;
+
+	union Slot{
+		std::int64_t i;
+		double f;
+		Slot *p;
+	};
+	static_assert(sizeof(Slot) == 8);
+
+	//What an opcode's a, b and c mean, W is the 32-bit operand made of b and c
+	enum class Format: std::uint8_t{
+		NONE,
+		//a
+		R,
+		//a, b
+		RR,
+		//a, b, c
+		RRR,
+		//a, constant W
+		RK,
+		//a, global slot W
+		RG,
+		//jump by W
+		J,
+		//a, jump by W
+		RJ,
+		//frame base a, function W
+		CALL,
+		//index a, array size W
+		BOUND
+	};
+
+	#define BYTECODE_OPCODES(X) \
+		X(MOV, RR) X(LOADK, RK) X(GET, RG) X(SET, RG) X(GADDR, RG) X(ADDR, RR) \
+		X(LOAD, RRR) X(STORE, RRR) X(BOUND, BOUND) \
+		X(ADD32, RRR) X(SUB32, RRR) X(MUL32, RRR) X(DIV32, RRR) \
+		X(ADD64, RRR) X(SUB64, RRR) X(MUL64, RRR) X(DIV64, RRR) \
+		X(FADD, RRR) X(FSUB, RRR) X(FMUL, RRR) X(FDIV, RRR) \
+		X(EQ, RRR) X(NE, RRR) X(LT, RRR) X(LE, RRR) X(GT, RRR) X(GE, RRR) \
+		X(FEQ, RRR) X(FNE, RRR) X(FLT, RRR) X(FLE, RRR) X(FGT, RRR) X(FGE, RRR) \
+		X(SEXT1, RR) X(SEXT8, RR) X(SEXT16, RR) X(SEXT32, RR) X(ZEXT1, RR) \
+		X(ITOF, RR) X(ITOF32, RR) X(FTOI, RR) X(FTOF32, RR) \
+		X(JMP, J) X(JZ, RJ) X(JNZ, RJ) \
+		X(CALL, CALL) X(TAILCALL, CALL) X(RET, R) X(RETVOID, NONE)
+
+	enum class Op: std::uint16_t{
+		#define BYTECODE_ENUM(name, format) name,
+		BYTECODE_OPCODES(BYTECODE_ENUM)
+		#undef BYTECODE_ENUM
+		COUNT
+	};
+	constexpr Format FORMATS[] = {
+		#define BYTECODE_FORMAT(name, format) Format::format,
+		BYTECODE_OPCODES(BYTECODE_FORMAT)
+		#undef BYTECODE_FORMAT
+	};
+	constexpr const char *NAMES[] = {
+		#define BYTECODE_NAME(name, format) #name,
+		BYTECODE_OPCODES(BYTECODE_NAME)
+		#undef BYTECODE_NAME
+	};
+
+	struct Instruction{
+		Op op;
+		std::uint16_t a = 0, b = 0, c = 0;
+
+		std::uint32_t Wide() const { return b | (std::uint32_t)c << 16; }
+		void SetWide(std::uint32_t w) { b = w & 0xFFFF; c = w >> 16; }
+	};
+	static_assert(sizeof(Instruction) == 8);
+
+	//What a register holds, decides which instructions work on it
+	enum class Kind: std::uint8_t{
+		VOID,
+		I1,
+		I8,
+		I16,
+		I32,
+		I64,
+		F32,
+		F64,
+		//Address of an array's first element
+		PTR
+	};
+
+	struct Function{
+		std::string name;
+		//Range of the program's code, jumps are relative and stay within it
+		std::uint32_t code = 0, codeCount = 0;
+		std::uint16_t params = 0, frameSize = 0;
+		Kind ret = Kind::VOID;
+	};
+
+	struct Program{
+		std::vector<Function> functions;
+		std::vector<Instruction> code;
+		std::vector<Slot> constants;
+		std::uint32_t globals = 0;
+		//Runs the global initializers before main
+		std::uint32_t init = NONE;
+
+		//Index of the function, NONE if there is none by that name
+		std::uint32_t Find(const std::string &name) const;
+
+		//Checks every operand is in range for its frame, the constant pool, the globals and
+		//the function table, so a damaged file can't send the VM outside of them
+		bool Verify(std::string &error) const;
+		void Disassemble(std::ostream &out) const;
+
+		bool Write(const std::string &path) const;
+		bool Read(const std::string &path);
+		//Tells bytecode apart from source by the magic
+		static bool IsBytecode(const std::string &path);
+	};
+}
@@ -0,0 +1,734 @@
+#include "compiler.hpp"
+#include <cstring>
+#include <iostream>
+#include <unordered_set>
+
+#include "parser/visitor.hpp"
+
+using namespace Bytecode;
+
+namespace{
+	//Where an expression's value ended up. Locals are read in place, so this may be a variable's own register
+	struct Operand{
+		std::uint16_t reg = 0;
+		Kind kind = Kind::VOID;
+	};
+	struct Local{
+		//For arrays, the register holding the address of the first element
+		std::uint16_t reg;
+		Kind kind;
+		bool isArray;
+		size_t size;
+	};
+	struct Unsupported{};
+
+	Kind KindOf(const VarType &type){
+		switch(type.type){
+			case VarType::Type::CHAR: return Kind::I8;
+			case VarType::Type::SHORT: return Kind::I16;
+			case VarType::Type::INT: return Kind::I32;
+			case VarType::Type::LONG: return Kind::I64;
+			case VarType::Type::FLOAT: return Kind::F32;
+			case VarType::Type::DOUBLE: return Kind::F64;
+			default: return Kind::VOID;
+		}
+	}
+	unsigned Bits(Kind kind){
+		switch(kind){
+			case Kind::I1: return 1;
+			case Kind::I8: return 8;
+			case Kind::I16: return 16;
+			case Kind::I32: return 32;
+			default: return 64;
+		}
+	}
+	//A parameter as the callee receives it, a soa array comes as one array per member
+	struct Param{
+		Token ident;
+		Kind kind;
+		bool isArray;
+		size_t size;
+	};
+	std::vector<Param> Params(const FuncDeclNode &node){
+		std::vector<Param> params;
+		for(auto &param: node.params){
+			auto &type = *param->varType;
+			if(!type.isSoa){
+				params.push_back(Param{ param->ident, KindOf(type), type.isArray, type.arrSize });
+				continue;
+			}
+			for(auto &member: type.members)
+				params.push_back(Param{ SoaMember(param->ident, member), KindOf(*member.type), true, type.arrSize });
+		}
+		return params;
+	}
+	bool IsFloat(Kind kind) { return kind == Kind::F32 || kind == Kind::F64; }
+	bool IsInteger(Kind kind) { return kind >= Kind::I1 && kind <= Kind::I64; }
+
+	//Opcodes whose only effect is writing register a, their result can be redirected
+	bool WritesA(Op op){
+		switch(op){
+			case Op::SET: case Op::STORE: case Op::BOUND: case Op::JMP: case Op::JZ: case Op::JNZ:
+			case Op::CALL: case Op::RET: case Op::RETVOID:
+				return false;
+			default:
+				return true;
+		}
+	}
+}
+
+//Lowers one function. Parameters take the first registers, locals are allocated above them
+//for as long as their block lasts and temporaries above the locals for one statement
+class FunctionBuilder: public ConstAstVisitor<FunctionBuilder, Operand>{
+	private:
+	BytecodeCompiler &compiler;
+	std::string name;
+	Kind ret;
+	std::shared_ptr<Scope> scope;
+	std::unordered_map<const Scope::Variable*, Local> locals;
+	std::uint16_t params = 0, localTop = 0, nextReg = 0;
+	std::uint32_t frameSize = 0;
+	std::vector<Instruction> code;
+	//Constants get a register each, loaded once on entry. Until Finish() they are numbered
+	//from CONST_BASE up and everything else stays below it
+	static constexpr std::uint16_t CONST_BASE = 0xC000;
+	std::vector<std::uint32_t> constants;
+	std::unordered_map<std::uint32_t, std::uint16_t> constantRegs;
+	//Furthest a jump lands, a function whose end is a target needs its implicit return
+	size_t jumpedTo = 0;
+
+	[[noreturn]] void Fail(const std::string &what){
+		std::cerr << "Can't compile " << name << " to bytecode: " << what << "\n";
+		throw Unsupported{};
+	}
+
+	std::uint16_t Temp(){
+		if(nextReg == CONST_BASE) Fail("too many registers");
+		frameSize = std::max<std::uint32_t>(frameSize, nextReg + 1);
+		return nextReg++;
+	}
+	Operand Emit(Op op, Kind kind, std::uint16_t b = 0, std::uint16_t c = 0){
+		Operand result{ Temp(), kind };
+		code.push_back(Instruction{ op, result.reg, b, c });
+		return result;
+	}
+	void EmitWide(Op op, std::uint16_t a, std::uint32_t w){
+		Instruction instr{ op, a };
+		instr.SetWide(w);
+		code.push_back(instr);
+	}
+	Operand Const(Slot val, Kind kind){
+		auto [found, added] = constantRegs.try_emplace(compiler.Constant(val), CONST_BASE + constants.size());
+		if(added){
+			if(found->second == 0xFFFF) Fail("too many constants");
+			constants.push_back(found->first);
+		}
+		return Operand{ found->second, kind };
+	}
+
+	//Forward jumps are patched once the target is known, backward ones know it already
+	size_t Jump(Op op, std::uint16_t a = 0){
+		code.push_back(Instruction{ op, a });
+		return code.size() - 1;
+	}
+	void Patch(size_t at){
+		code[at].SetWide(code.size() - at - 1);
+		jumpedTo = std::max(jumpedTo, code.size());
+	}
+	void JumpTo(Op op, std::uint16_t a, size_t target){
+		EmitWide(op, a, (std::uint32_t)((std::int64_t)target - (std::int64_t)code.size() - 1));
+	}
+
+	//A temporary the last instruction just wrote is written straight to dst instead
+	void Move(std::uint16_t dst, const Operand &val){
+		if(val.reg == dst) return;
+		if(val.reg >= localTop && !code.empty() && WritesA(code.back().op) && code.back().a == val.reg && jumpedTo < code.size()){
+			code.back().a = dst;
+			return;
+		}
+		code.push_back(Instruction{ Op::MOV, dst, val.reg });
+	}
+	bool ConstantIn(const Operand &val, std::int64_t &out){
+		if(val.reg < CONST_BASE) return false;
+		out = compiler.program.constants[constants[val.reg - CONST_BASE]].i;
+		return true;
+	}
+
+	//Same conversions as CastTo in codegen. Integers narrow by sign extending the low bits,
+	//widen for free, except an i1 which is zero extended
+	Operand Convert(const Operand &val, Kind to){
+		if(val.kind == to || val.kind == Kind::VOID || val.kind == Kind::PTR || to == Kind::VOID || to == Kind::PTR) return val;
+
+		if(IsInteger(val.kind) && IsInteger(to)){
+			if(val.kind == Kind::I1) return Emit(Op::ZEXT1, to, val.reg);
+			if(Bits(to) >= Bits(val.kind)) return Operand{ val.reg, to };
+			return Truncate(val, to);
+		}
+		if(IsInteger(val.kind)) return Emit(to == Kind::F32 ? Op::ITOF32 : Op::ITOF, to, val.reg);
+		if(IsInteger(to)){
+			auto wide = Emit(Op::FTOI, Kind::I64, val.reg);
+			return Bits(to) < 64 ? Truncate(wide, to) : Operand{ wide.reg, to };
+		}
+		if(to == Kind::F32) return Emit(Op::FTOF32, to, val.reg);
+		return Operand{ val.reg, to };
+	}
+	Operand Truncate(const Operand &val, Kind to){
+		switch(Bits(to)){
+			case 1: return Emit(Op::SEXT1, to, val.reg);
+			case 8: return Emit(Op::SEXT8, to, val.reg);
+			case 16: return Emit(Op::SEXT16, to, val.reg);
+			case 32: return Emit(Op::SEXT32, to, val.reg);
+			default: return Operand{ val.reg, to };
+		}
+	}
+	//Anything a branch can test against zero, floats are compared unordered-false like ToCondition
+	Operand Condition(const Operand &val){
+		if(val.kind == Kind::VOID || val.kind == Kind::PTR) Fail("condition has no value");
+		if(!IsFloat(val.kind)) return val;
+		return Emit(Op::FNE, Kind::I1, val.reg, Const(Slot{ .f = 0.0 }, Kind::F64).reg);
+	}
+	Operand Value(const Node &node){
+		auto val = Visit(node);
+		if(val.kind == Kind::VOID) Fail("expression has no value");
+		return val;
+	}
+
+	//The local or global a name refers to
+	Local Variable(const Token &ident){
+		bool isGlobal = false;
+		auto &var = Scope::Lookup(scope, ident, &isGlobal);
+		if(var.type.type == VarType::Type::ERR) Fail("invalid variable " + ident.Name());
+
+		if(isGlobal){
+			auto global = compiler.globals.find(ident.Name());
+			if(global == compiler.globals.end()) Fail("unknown global " + ident.Name());
+			auto &[slot, kind, isArray, size] = global->second;
+			return Local{ 0xFFFF, kind, isArray, size };
+		}
+
+		auto local = locals.find(&var);
+		if(local == locals.end()) Fail("unknown variable " + ident.Name());
+		return local->second;
+	}
+	bool IsGlobal(const Token &ident){
+		bool isGlobal = false;
+		Scope::Lookup(scope, ident, &isGlobal);
+		return isGlobal;
+	}
+	std::uint32_t GlobalSlot(const Token &ident) { return compiler.globals.at(ident.Name()).slot; }
+	Operand ArrayAddress(const Token &ident){
+		if(!IsGlobal(ident)) return Operand{ Variable(ident).reg, Kind::PTR };
+
+		Operand address{ Temp(), Kind::PTR };
+		EmitWide(Op::GADDR, address.reg, GlobalSlot(ident));
+		return address;
+	}
+	//Element index as an i64, checked against the size with -fbounds-check unless it is a constant in range
+	Operand ElementIndex(const Node &index, const Local &array){
+		auto at = Convert(Value(index), Kind::I64);
+		std::int64_t constant;
+		if(compiler.boundsChecks && array.size && !(ConstantIn(at, constant) && constant >= 0 && (size_t)constant < array.size))
+			EmitWide(Op::BOUND, at.reg, array.size);
+		return at;
+	}
+
+	//Temporaries die with the statement that made them
+	void Statement(const Node &node){
+		Visit(node);
+		nextReg = localTop;
+	}
+	std::uint16_t AllocateLocal(size_t count){
+		if((size_t)localTop + count >= CONST_BASE) Fail("too many registers");
+		std::uint16_t reg = localTop;
+		localTop += count;
+		nextReg = localTop;
+		frameSize = std::max<std::uint32_t>(frameSize, localTop);
+		return reg;
+	}
+	//Elements live in the frame, right below the register with their address
+	void Array(const Token &ident, Kind kind, size_t size){
+		if(kind == Kind::VOID) Fail("unsupported type of " + ident.Name());
+		auto elements = AllocateLocal(size);
+		auto address = AllocateLocal(1);
+		code.push_back(Instruction{ Op::ADDR, address, elements });
+		locals[&Scope::Lookup(scope, ident)] = Local{ address, kind, true, size };
+	}
+
+	public:
+	FunctionBuilder(BytecodeCompiler &compiler_, const std::string &name_, Kind ret_, std::shared_ptr<Scope> scope_)
+		: compiler(compiler_), name(name_), ret(ret_), scope(scope_) {}
+
+	void SetScope(std::shared_ptr<Scope> scope_) { scope = scope_; }
+	bool Empty() const { return code.empty(); }
+
+	//The code with its constants loaded on entry, into the registers right after the parameters
+	std::vector<Instruction> Finish(std::uint16_t &frame){
+		std::uint16_t count = constants.size();
+		if(frameSize + count >= 0xFFFF) Fail("too many registers");
+		frame = frameSize + count;
+
+		auto reg = [this, count](std::uint16_t &r){
+			if(r >= CONST_BASE) r = params + r - CONST_BASE;
+			else if(r >= params) r += count;
+		};
+		std::vector<Instruction> out;
+		for(std::uint16_t i = 0; i < count; ++i){
+			Instruction load{ Op::LOADK, (std::uint16_t)(params + i) };
+			load.SetWide(constants[i]);
+			out.push_back(load);
+		}
+		for(auto instr: code){
+			switch(FORMATS[(size_t)instr.op]){
+				case Format::RRR: reg(instr.c); [[fallthrough]];
+				case Format::RR: reg(instr.b); [[fallthrough]];
+				case Format::R: case Format::RK: case Format::RG: case Format::RJ: case Format::CALL: case Format::BOUND:
+					reg(instr.a);
+					break;
+				default:
+					break;
+			}
+			out.push_back(instr);
+		}
+		return out;
+	}
+
+	//Lowers the body, parameters arrive in the first registers
+	void Function(const FuncDeclNode &node){
+		if(node.block->type == NodeType::BLOCK) scope = static_cast<const BlockNode&>(*node.block).myScope;
+		for(auto &param: Params(node)){
+			if(param.kind == Kind::VOID) Fail("unsupported parameter type");
+			locals[&Scope::Lookup(scope, param.ident)] = Local{ AllocateLocal(1), param.kind, param.isArray, param.size };
+		}
+		params = localTop;
+		Visit(*node.block);
+		Return();
+	}
+	//Top level declarations store their initial value into the global
+	void Initializer(const VarDeclNode &node){
+		auto &global = compiler.globals.at(node.ident.Name());
+		auto val = Convert(Value(*node.initial), global.kind);
+		EmitWide(Op::SET, val.reg, global.slot);
+		nextReg = localTop;
+	}
+	//Falling off the end returns the zero value, same as codegen
+	void Return(){
+		if(!code.empty() && (code.back().op == Op::RET || code.back().op == Op::RETVOID) && jumpedTo < code.size()) return;
+		if(ret == Kind::VOID){
+			code.push_back(Instruction{ Op::RETVOID });
+			return;
+		}
+		code.push_back(Instruction{ Op::RET, Const(Slot{ .i = 0 }, ret).reg });
+		nextReg = localTop;
+	}
+
+	Operand VisitNode(const Node&) { Fail("unsupported statement"); }
+	Operand VisitErr(const Node&) { return Operand{}; }
+	Operand VisitMember(const MemberNode&) { Fail("struct members aren't supported"); }
+	Operand VisitVal(const ValNode &node){
+		auto &val = node.val;
+		switch(val.type){
+			case Token::Type::INTEGER_NUMBER: return Const(Slot{ .i = (std::int32_t)val.intVal }, Kind::I32);
+			case Token::Type::FLOATING_NUMBER: return Const(Slot{ .f = val.floatVal }, Kind::F64);
+			case Token::Type::CHAR_LITERAL: return Const(Slot{ .i = (std::int8_t)val.intVal }, Kind::I8);
+			case Token::Type::IDENT: break;
+			default: Fail("unsupported literal");
+		}
+
+		auto var = Variable(val);
+		//Arrays are only ever passed on, as the address of their first element
+		if(var.isArray) return ArrayAddress(val);
+		if(!IsGlobal(val)) return Operand{ var.reg, var.kind };
+
+		Operand result{ Temp(), var.kind };
+		EmitWide(Op::GET, result.reg, GlobalSlot(val));
+		return result;
+	}
+	Operand VisitBinary(const BinaryNode &node){
+		auto l = Value(*node.lhs);
+		auto r = Value(*node.rhs);
+		if(l.kind == Kind::PTR || r.kind == Kind::PTR) Fail("arrays can't be operands");
+
+		//Mixed operands are promoted to the floating point side's type, two floating point or two
+		//integer operands to the wider of the two. Float arithmetic runs in double and is rounded
+		//after, which gives the same result as doing it in float
+		if(IsFloat(l.kind) || IsFloat(r.kind)){
+			Kind type = l.kind == Kind::F64 || r.kind == Kind::F64 ? Kind::F64 : Kind::F32;
+			l = Convert(Convert(l, type), Kind::F64);
+			r = Convert(Convert(r, type), Kind::F64);
+
+			Op op;
+			Kind kind = Kind::I1;
+			switch(node.operand.type){
+				case Token::Type::PLUS: op = Op::FADD; kind = Kind::F64; break;
+				case Token::Type::MINUS: op = Op::FSUB; kind = Kind::F64; break;
+				case Token::Type::STAR: op = Op::FMUL; kind = Kind::F64; break;
+				case Token::Type::SLASH: op = Op::FDIV; kind = Kind::F64; break;
+				case Token::Type::EQ: op = Op::FEQ; break;
+				case Token::Type::NEQ: op = Op::FNE; break;
+				case Token::Type::GREATER: op = Op::FGT; break;
+				case Token::Type::GEQ: op = Op::FGE; break;
+				case Token::Type::LESS: op = Op::FLT; break;
+				case Token::Type::LEQ: op = Op::FLE; break;
+				default: Fail("invalid operator");
+			}
+			auto result = Emit(op, kind, l.reg, r.reg);
+			return kind == Kind::F64 && type == Kind::F32 ? Convert(result, Kind::F32) : result;
+		}
+
+		if(Bits(l.kind) < Bits(r.kind)) l = Convert(l, r.kind);
+		else r = Convert(r, l.kind);
+		auto kind = l.kind;
+		bool is32 = Bits(kind) == 32;
+
+		//Only i32 and i64 have their own arithmetic, narrower results are truncated after
+		Op op;
+		switch(node.operand.type){
+			case Token::Type::PLUS: op = is32 ? Op::ADD32 : Op::ADD64; break;
+			case Token::Type::MINUS: op = is32 ? Op::SUB32 : Op::SUB64; break;
+			case Token::Type::STAR: op = is32 ? Op::MUL32 : Op::MUL64; break;
+			case Token::Type::SLASH: op = is32 ? Op::DIV32 : Op::DIV64; break;
+			case Token::Type::EQ: return Emit(Op::EQ, Kind::I1, l.reg, r.reg);
+			case Token::Type::NEQ: return Emit(Op::NE, Kind::I1, l.reg, r.reg);
+			case Token::Type::GREATER: return Emit(Op::GT, Kind::I1, l.reg, r.reg);
+			case Token::Type::GEQ: return Emit(Op::GE, Kind::I1, l.reg, r.reg);
+			case Token::Type::LESS: return Emit(Op::LT, Kind::I1, l.reg, r.reg);
+			case Token::Type::LEQ: return Emit(Op::LE, Kind::I1, l.reg, r.reg);
+			default: Fail("invalid operator");
+		}
+		auto result = Emit(op, kind, l.reg, r.reg);
+		return Bits(kind) < 32 ? Truncate(result, kind) : result;
+	}
+	Operand VisitVarDecl(const VarDeclNode &node){
+		if(node.varType->isSoa){
+			for(auto &member: node.varType->members)
+				Array(SoaMember(node.ident, member), KindOf(*member.type), node.varType->arrSize);
+			return Operand{};
+		}
+
+		auto kind = KindOf(*node.varType);
+		if(kind == Kind::VOID) Fail("unsupported type of " + node.ident.Name());
+		auto &var = Scope::Lookup(scope, node.ident);
+
+		if(node.varType->isArray){
+			Array(node.ident, kind, node.varType->arrSize);
+			return Operand{};
+		}
+
+		auto reg = AllocateLocal(1);
+		locals[&var] = Local{ reg, kind, false, 0 };
+		if(node.initial->type != NodeType::ERR)
+			Move(reg, Convert(Value(*node.initial), kind));
+		return Operand{};
+	}
+	Operand VisitBlock(const BlockNode &node){
+		auto parentScope = scope;
+		auto blockTop = localTop;
+		if(node.myScope) scope = node.myScope;
+
+		for(auto &stmt: node.stmts)
+			Statement(*stmt);
+
+		//The block's locals are gone, their registers go to whatever comes next
+		localTop = nextReg = blockTop;
+		scope = parentScope;
+		return Operand{};
+	}
+	Operand VisitIf(const IfNode &node){
+		auto cond = Condition(Value(*node.cond));
+		auto skipThen = Jump(Op::JZ, cond.reg);
+		nextReg = localTop;
+
+		Statement(*node.then);
+		if(node.elseBody->type == NodeType::ERR){
+			Patch(skipThen);
+			return Operand{};
+		}
+		auto skipElse = Jump(Op::JMP);
+		Patch(skipThen);
+		Statement(*node.elseBody);
+		Patch(skipElse);
+		return Operand{};
+	}
+	Operand VisitWhile(const WhileNode &node){
+		//The condition goes after the body, so every iteration takes a single branch
+		auto toCond = Jump(Op::JMP);
+		size_t body = code.size();
+		Statement(*node.then);
+
+		Patch(toCond);
+		auto cond = Condition(Value(*node.cond));
+		JumpTo(Op::JNZ, cond.reg, body);
+		jumpedTo = std::max(jumpedTo, body);
+		return Operand{};
+	}
+	//A chain of compares in source order, each label a single EQ and JNZ
+	Operand VisitSwitch(const SwitchNode &node){
+		auto val = Value(*node.value);
+		if(val.kind == Kind::PTR) Fail("arrays can't be switched on");
+		if(IsFloat(val.kind) || val.kind == Kind::I1) val = Convert(val, Kind::I64);
+
+		std::vector<std::vector<size_t>> toArm(node.cases.size());
+		std::unordered_set<std::int64_t> seen;
+		auto mark = nextReg;
+		for(size_t i = 0; i < node.cases.size(); ++i){
+			for(auto &label: node.cases[i]->labels){
+				//Labels are narrowed to the value's width like codegen does, the first of a collision wins
+				std::int64_t narrowed = label->val.intVal;
+				switch(Bits(val.kind)){
+					case 8: narrowed = (std::int8_t)narrowed; break;
+					case 16: narrowed = (std::int16_t)narrowed; break;
+					case 32: narrowed = (std::int32_t)narrowed; break;
+				}
+				if(!seen.insert(narrowed).second) continue;
+
+				auto equal = Emit(Op::EQ, Kind::I1, val.reg, Const(Slot{ .i = narrowed }, val.kind).reg);
+				toArm[i].push_back(Jump(Op::JNZ, equal.reg));
+				nextReg = mark;
+			}
+		}
+		nextReg = localTop;
+
+		auto toDefault = Jump(Op::JMP);
+		bool hasDefault = false;
+		std::vector<size_t> toEnd;
+		for(size_t i = 0; i < node.cases.size(); ++i){
+			for(auto at: toArm[i])
+				Patch(at);
+			if(node.cases[i]->isDefault){
+				Patch(toDefault);
+				hasDefault = true;
+			}
+			Statement(*node.cases[i]->body);
+			if(i + 1 < node.cases.size())
+				toEnd.push_back(Jump(Op::JMP));
+		}
+
+		if(!hasDefault) Patch(toDefault);
+		for(auto at: toEnd)
+			Patch(at);
+		return Operand{};
+	}
+	Operand VisitReturn(const ReturnNode &node){
+		bool hasValue = node.expr->type != NodeType::ERR;
+		if(hasValue != (ret != Kind::VOID)) Fail(hasValue ? "void function returns a value" : "return without a value");
+
+		if(!hasValue){
+			code.push_back(Instruction{ Op::RETVOID });
+			return Operand{};
+		}
+		//Returning a call's result as is lets the callee take over this frame
+		if(node.expr->type == NodeType::FUNCTIONCALL && CanTailCall(static_cast<const FuncCallNode&>(*node.expr))){
+			Call(static_cast<const FuncCallNode&>(*node.expr), Op::TAILCALL);
+			return Operand{};
+		}
+		auto val = Convert(Value(*node.expr), ret);
+		code.push_back(Instruction{ Op::RET, val.reg });
+		return Operand{};
+	}
+	Operand VisitVarAssign(const VarAssignNode &node){
+		auto var = Variable(node.varName);
+		if(node.index->type != NodeType::ERR){
+			auto array = ArrayAddress(node.varName);
+			auto at = ElementIndex(*node.index, var);
+			auto val = Convert(Value(*node.expression), var.kind);
+			code.push_back(Instruction{ Op::STORE, array.reg, at.reg, val.reg });
+			return Operand{};
+		}
+		if(var.isArray) Fail("arrays can't be assigned");
+
+		auto val = Convert(Value(*node.expression), var.kind);
+		if(IsGlobal(node.varName)) EmitWide(Op::SET, val.reg, GlobalSlot(node.varName));
+		else Move(var.reg, val);
+		return Operand{};
+	}
+	Operand VisitIndex(const IndexNode &node){
+		auto var = Variable(node.array);
+		if(!var.isArray) Fail(node.array.Name() + " isn't an array");
+
+		auto array = ArrayAddress(node.array);
+		auto at = ElementIndex(*node.index, var);
+		return Emit(Op::LOAD, var.kind, array.reg, at.reg);
+	}
+	//A frame's own arrays are gone once a tail call hands the frame over
+	bool InFrame(const Token &ident){
+		auto &var = Scope::Lookup(scope, ident);
+		if(!var.type.isArray || IsGlobal(ident)) return false;
+		if(var.type.isSoa) return InFrame(SoaMember(ident, var.type.members.front()));
+		return Variable(ident).reg >= params;
+	}
+	bool CanTailCall(const FuncCallNode &node){
+		auto decl = compiler.fileFunctions.find(node.funcName.symbol);
+		if(decl == compiler.fileFunctions.end() || KindOf(*decl->second->funcType) != ret) return false;
+
+		for(auto &arg: node.params){
+			if(arg->type == NodeType::VAL && static_cast<const ValNode&>(*arg).val.type == Token::Type::IDENT && InFrame(static_cast<const ValNode&>(*arg).val))
+				return false;
+		}
+		return true;
+	}
+	//Arguments are evaluated right into the registers the callee's frame starts at
+	Operand Call(const FuncCallNode &node, Op op){
+		auto decl = compiler.fileFunctions.find(node.funcName.symbol);
+		if(decl == compiler.fileFunctions.end()) Fail("call to unknown function " + node.funcName.Name());
+		auto &callee = *decl->second;
+		auto id = compiler.FunctionId(callee.ident.Name());
+
+		std::uint16_t base = nextReg;
+		Temp();
+		nextReg = base;
+		for(size_t i = 0; i < node.params.size() && i < callee.params.size(); ++i){
+			auto &param = *callee.params[i];
+			//A soa array is passed by name, as the addresses of its member arrays
+			if(param.varType->isSoa){
+				auto &array = static_cast<const ValNode&>(*node.params[i]).val;
+				for(auto &member: param.varType->members){
+					auto slot = Temp();
+					Move(slot, ArrayAddress(SoaMember(array, member)));
+					nextReg = slot + 1;
+				}
+				continue;
+			}
+			auto slot = Temp();
+			auto val = Value(*node.params[i]);
+			if(param.varType->isArray != (val.kind == Kind::PTR)) Fail("argument " + std::to_string(i + 1) + " of " + callee.ident.Name() + " has the wrong type");
+
+			Move(slot, param.varType->isArray ? val : Convert(val, KindOf(*param.varType)));
+			nextReg = slot + 1;
+		}
+
+		EmitWide(op, base, id);
+		nextReg = base + 1;
+		return Operand{ base, KindOf(*callee.funcType) };
+	}
+	Operand VisitFuncCall(const FuncCallNode &node) { return Call(node, Op::CALL); }
+};
+
+BytecodeCompiler::BytecodeCompiler(bool boundsChecks_): boundsChecks(boundsChecks_) {}
+BytecodeCompiler::~BytecodeCompiler() = default;
+
+std::uint32_t BytecodeCompiler::FunctionId(const std::string &name){
+	auto [found, added] = functionIds.try_emplace(name, program.functions.size());
+	if(added){
+		program.functions.emplace_back();
+		program.functions.back().name = name;
+	}
+	return found->second;
+}
+std::uint32_t BytecodeCompiler::Constant(Slot val){
+	std::uint64_t bits;
+	std::memcpy(&bits, &val, sizeof(bits));
+
+	auto [found, added] = constantIds.try_emplace(bits, program.constants.size());
+	if(added) program.constants.push_back(val);
+	return found->second;
+}
+
+bool BytecodeCompiler::Add(const BlockNode &root){
+	fileFunctions.clear();
+	for(auto &stmt: root.stmts){
+		if(stmt->type != NodeType::FUNCDECL) continue;
+
+		auto func = static_cast<const FuncDeclNode*>(stmt.get());
+		auto [found, added] = fileFunctions.emplace(func->ident.symbol, func);
+		if(!added && found->second->IsPrototype()) found->second = func;
+	}
+
+	if(!init) init = std::make_unique<FunctionBuilder>(*this, "<init>", Kind::VOID, root.myScope);
+	init->SetScope(root.myScope);
+
+	bool ok = true;
+	for(auto &stmt: root.stmts){
+		try{
+			if(stmt->type == NodeType::VARDECL){
+				auto &decl = static_cast<const VarDeclNode&>(*stmt);
+				//Soa arrays are their member arrays
+				if(decl.varType->isSoa){
+					for(auto &member: decl.varType->members){
+						auto name = SoaMember(decl.ident, member).Name();
+						auto kind = KindOf(*member.type);
+						if(kind == Kind::VOID || globals.contains(name)){
+							std::cerr << "Can't compile " << name << " to bytecode: " << (kind == Kind::VOID ? "unsupported type\n" : "multiple definitions\n");
+							ok = false;
+							continue;
+						}
+						globals[name] = Global{ program.globals, kind, true, decl.varType->arrSize };
+						program.globals += decl.varType->arrSize;
+					}
+					continue;
+				}
+				auto kind = KindOf(*decl.varType);
+				auto name = decl.ident.Name();
+				if(kind == Kind::VOID){
+					std::cerr << "Can't compile " << name << " to bytecode: unsupported type\n";
+					ok = false;
+					continue;
+				}
+				if(globals.contains(name)){
+					std::cerr << "Multiple definitions of global " << name << "\n";
+					ok = false;
+					continue;
+				}
+
+				size_t size = decl.varType->isArray ? decl.varType->arrSize : 1;
+				globals[name] = Global{ program.globals, kind, decl.varType->isArray, decl.varType->arrSize };
+				program.globals += size;
+				if(decl.initial->type != NodeType::ERR) init->Initializer(decl);
+				continue;
+			}
+			if(stmt->type != NodeType::FUNCDECL) continue;
+
+			auto &decl = static_cast<const FuncDeclNode&>(*stmt);
+			if(decl.IsPrototype()) continue;
+			auto id = FunctionId(decl.ident.Name());
+			if(program.functions[id].codeCount){
+				std::cerr << "Multiple definitions of function " << decl.ident.Name() << "\n";
+				ok = false;
+				continue;
+			}
+
+			FunctionBuilder builder(*this, decl.ident.Name(), KindOf(*decl.funcType), root.myScope);
+			builder.Function(decl);
+			std::uint16_t frameSize;
+			auto code = builder.Finish(frameSize);
+
+			auto &func = program.functions[id];
+			func.code = program.code.size();
+			func.codeCount = code.size();
+			func.params = Params(decl).size();
+			func.frameSize = frameSize;
+			func.ret = KindOf(*decl.funcType);
+			program.code.insert(program.code.end(), code.begin(), code.end());
+		}
+		catch(const Unsupported&){
+			ok = false;
+		}
+	}
+	return ok;
+}
+
+bool BytecodeCompiler::Finish(Program &out){
+	bool ok = true;
+	for(auto &func: program.functions){
+		if(func.codeCount) continue;
+		std::cerr << "Function " << func.name << " is called but never defined\n";
+		ok = false;
+	}
+
+	if(init && !init->Empty()){
+		try{
+			init->Return();
+			std::uint16_t frameSize;
+			auto code = init->Finish(frameSize);
+			program.init = program.functions.size();
+			program.functions.push_back(Function{ "<init>", (std::uint32_t)program.code.size(), (std::uint32_t)code.size(), 0, frameSize, Kind::VOID });
+			program.code.insert(program.code.end(), code.begin(), code.end());
+		}
+		catch(const Unsupported&){
+			ok = false;
+		}
+	}
+
+	out = std::move(program);
+	program = Program{};
+	return ok;
+}
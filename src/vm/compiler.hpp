@@ -0,0 +1,49 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <unordered_map>
+
+#include "parser/parser.hpp"
+#include "vm/bytecode.hpp"
+
+class FunctionBuilder;
+
+//Lowers parsed files to one bytecode program for the VM. Files are added one at a time while
+//their tree is alive, functions and globals are matched across files by name like the linker
+//would. Anything the VM can't run (struct members, strings) is reported and fails the file.
+class BytecodeCompiler{
+	public:
+	explicit BytecodeCompiler(bool boundsChecks_ = false);
+	~BytecodeCompiler();
+
+	//Returns false if the file couldn't be lowered, the reason goes to std::cerr
+	bool Add(const BlockNode &root);
+	//Checks every function called got a definition and hands the program over
+	bool Finish(Bytecode::Program &out);
+
+	private:
+	friend class FunctionBuilder;
+
+	struct Global{
+		std::uint32_t slot;
+		Bytecode::Kind kind;
+		bool isArray;
+		size_t size;
+	};
+
+	bool boundsChecks;
+	Bytecode::Program program;
+	std::unordered_map<std::string, std::uint32_t> functionIds;
+	std::unordered_map<std::string, Global> globals;
+	std::unordered_map<std::uint64_t, std::uint32_t> constantIds;
+	//Global initializers of every file, run before main
+	std::unique_ptr<FunctionBuilder> init;
+	//Functions of the file being added by name, a definition wins over a prototype
+	std::unordered_map<std::uint32_t, const FuncDeclNode*> fileFunctions;
+
+	std::uint32_t FunctionId(const std::string &name);
+	std::uint32_t Constant(Bytecode::Slot val);
+};
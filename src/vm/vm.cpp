@@ -0,0 +1,200 @@
+#include "vm.hpp"
+
+using namespace Bytecode;
+
+#if defined(__GNUC__) || defined(__clang__)
+#define VM_COMPUTED_GOTO 1
+#else
+#define VM_COMPUTED_GOTO 0
+#endif
+
+VM::VM(const Program &program_): program(program_), stack(new Slot[STACK_SLOTS]), frames(new Frame[CALL_DEPTH]), globals(program_.globals, Slot{ .i = 0 }) {
+	for(auto &func: program.functions)
+		entries.push_back(program.code.data() + func.code);
+}
+
+bool VM::Run(const std::string &entry, Slot &result){
+	auto func = program.Find(entry);
+	if(func == NONE || func == program.init){
+		error = "no function " + entry + " to run";
+		return false;
+	}
+	if(program.functions[func].params){
+		error = entry + " can't take parameters";
+		return false;
+	}
+
+	Slot ignored;
+	if(program.init != NONE && !Execute(program.init, ignored)) return false;
+	return Execute(func, result);
+}
+
+bool VM::Execute(std::uint32_t func, Slot &result){
+	auto functions = program.functions.data();
+	auto constants = program.constants.data();
+	auto global = globals.data();
+	auto code = entries.data();
+	Slot *regs = stack.get();
+	Slot *stackEnd = regs + STACK_SLOTS;
+	size_t depth = 0;
+	std::uint32_t current = func;
+
+	const Instruction *pc = code[func];
+	const Instruction *ip;
+	if(functions[func].frameSize > STACK_SLOTS){
+		error = "stack overflow in " + functions[func].name;
+		return false;
+	}
+
+	#define R(x) regs[ip->x]
+	#define FAIL(what) do{ error = std::string(what) + " in " + functions[current].name; return false; }while(0)
+
+#if VM_COMPUTED_GOTO
+	static const void *labels[] = {
+		#define VM_LABEL(name, format) &&op_##name,
+		BYTECODE_OPCODES(VM_LABEL)
+		#undef VM_LABEL
+	};
+	#define CASE(name) op_##name:
+	#define NEXT() do{ ip = pc++; goto *labels[(size_t)ip->op]; }while(0)
+
+	NEXT();
+#else
+	#define CASE(name) case Op::name:
+	#define NEXT() continue
+
+	for(;;){
+		ip = pc++;
+		switch(ip->op){
+#endif
+
+	CASE(MOV) R(a) = R(b); NEXT();
+	CASE(LOADK) R(a) = constants[ip->Wide()]; NEXT();
+	CASE(GET) R(a) = global[ip->Wide()]; NEXT();
+	CASE(SET) global[ip->Wide()] = R(a); NEXT();
+	CASE(GADDR) R(a).p = global + ip->Wide(); NEXT();
+	CASE(ADDR) R(a).p = regs + ip->b; NEXT();
+	CASE(LOAD) R(a) = R(b).p[R(c).i]; NEXT();
+	CASE(STORE) R(a).p[R(b).i] = R(c); NEXT();
+	CASE(BOUND) if((std::uint64_t)R(a).i >= ip->Wide()) FAIL("index out of bounds"); NEXT();
+
+	//Integer arithmetic wraps like the generated code, it's done unsigned to stay defined in C++
+	CASE(ADD32) R(a).i = (std::int32_t)(std::uint32_t)((std::uint64_t)R(b).i + (std::uint64_t)R(c).i); NEXT();
+	CASE(SUB32) R(a).i = (std::int32_t)(std::uint32_t)((std::uint64_t)R(b).i - (std::uint64_t)R(c).i); NEXT();
+	CASE(MUL32) R(a).i = (std::int32_t)((std::uint32_t)R(b).i * (std::uint32_t)R(c).i); NEXT();
+	CASE(DIV32){
+		auto l = R(b).i, r = R(c).i;
+		if(!r) FAIL("division by zero");
+		if(r == -1 && l == INT32_MIN) FAIL("division overflow");
+		R(a).i = l / r;
+		NEXT();
+	}
+	CASE(ADD64) R(a).i = (std::int64_t)((std::uint64_t)R(b).i + (std::uint64_t)R(c).i); NEXT();
+	CASE(SUB64) R(a).i = (std::int64_t)((std::uint64_t)R(b).i - (std::uint64_t)R(c).i); NEXT();
+	CASE(MUL64) R(a).i = (std::int64_t)((std::uint64_t)R(b).i * (std::uint64_t)R(c).i); NEXT();
+	CASE(DIV64){
+		auto l = R(b).i, r = R(c).i;
+		if(!r) FAIL("division by zero");
+		if(r == -1 && l == INT64_MIN) FAIL("division overflow");
+		R(a).i = l / r;
+		NEXT();
+	}
+	CASE(FADD) R(a).f = R(b).f + R(c).f; NEXT();
+	CASE(FSUB) R(a).f = R(b).f - R(c).f; NEXT();
+	CASE(FMUL) R(a).f = R(b).f * R(c).f; NEXT();
+	CASE(FDIV) R(a).f = R(b).f / R(c).f; NEXT();
+
+	//Comparisons give an i1, true is -1
+	CASE(EQ) R(a).i = -(std::int64_t)(R(b).i == R(c).i); NEXT();
+	CASE(NE) R(a).i = -(std::int64_t)(R(b).i != R(c).i); NEXT();
+	CASE(LT) R(a).i = -(std::int64_t)(R(b).i < R(c).i); NEXT();
+	CASE(LE) R(a).i = -(std::int64_t)(R(b).i <= R(c).i); NEXT();
+	CASE(GT) R(a).i = -(std::int64_t)(R(b).i > R(c).i); NEXT();
+	CASE(GE) R(a).i = -(std::int64_t)(R(b).i >= R(c).i); NEXT();
+	CASE(FEQ) R(a).i = -(std::int64_t)(R(b).f == R(c).f); NEXT();
+	CASE(FNE) R(a).i = -(std::int64_t)(R(b).f < R(c).f || R(b).f > R(c).f); NEXT();
+	CASE(FLT) R(a).i = -(std::int64_t)(R(b).f < R(c).f); NEXT();
+	CASE(FLE) R(a).i = -(std::int64_t)(R(b).f <= R(c).f); NEXT();
+	CASE(FGT) R(a).i = -(std::int64_t)(R(b).f > R(c).f); NEXT();
+	CASE(FGE) R(a).i = -(std::int64_t)(R(b).f >= R(c).f); NEXT();
+
+	CASE(SEXT1) R(a).i = -(R(b).i & 1); NEXT();
+	CASE(SEXT8) R(a).i = (std::int8_t)R(b).i; NEXT();
+	CASE(SEXT16) R(a).i = (std::int16_t)R(b).i; NEXT();
+	CASE(SEXT32) R(a).i = (std::int32_t)R(b).i; NEXT();
+	CASE(ZEXT1) R(a).i = R(b).i & 1; NEXT();
+	CASE(ITOF) R(a).f = (double)R(b).i; NEXT();
+	CASE(ITOF32) R(a).f = (float)R(b).i; NEXT();
+	//Out of range is poison in the generated code, here it's 0
+	CASE(FTOI){
+		double val = R(b).f;
+		R(a).i = val >= -0x1p63 && val < 0x1p63 ? (std::int64_t)val : 0;
+		NEXT();
+	}
+	CASE(FTOF32) R(a).f = (float)R(b).f; NEXT();
+
+	CASE(JMP) pc += (std::int32_t)ip->Wide(); NEXT();
+	CASE(JZ) if(!R(a).i) pc += (std::int32_t)ip->Wide(); NEXT();
+	CASE(JNZ) if(R(a).i) pc += (std::int32_t)ip->Wide(); NEXT();
+
+	//The callee's frame starts at the caller's register a, where the arguments were put
+	CASE(CALL){
+		auto callee = ip->Wide();
+		Slot *frame = regs + ip->a;
+		if(depth == CALL_DEPTH || functions[callee].frameSize > stackEnd - frame) FAIL("stack overflow");
+
+		frames[depth++] = Frame{ pc, regs, current };
+		regs = frame;
+		current = callee;
+		pc = code[callee];
+		NEXT();
+	}
+	//The callee takes over the frame, the arguments move down to where its parameters go
+	CASE(TAILCALL){
+		auto callee = ip->Wide();
+		if(functions[callee].frameSize > stackEnd - regs) FAIL("stack overflow");
+
+		const Slot *args = regs + ip->a;
+		for(std::uint16_t i = 0; i < functions[callee].params; ++i)
+			regs[i] = args[i];
+		current = callee;
+		pc = code[callee];
+		NEXT();
+	}
+	//The result goes to the first register of the frame, which is where the caller expects it
+	CASE(RET){
+		regs[0] = R(a);
+		if(!depth){
+			result = regs[0];
+			return true;
+		}
+		auto &caller = frames[--depth];
+		pc = caller.pc;
+		regs = caller.regs;
+		current = caller.func;
+		NEXT();
+	}
+	CASE(RETVOID){
+		if(!depth){
+			result = Slot{ .i = 0 };
+			return true;
+		}
+		auto &caller = frames[--depth];
+		pc = caller.pc;
+		regs = caller.regs;
+		current = caller.func;
+		NEXT();
+	}
+
+#if !VM_COMPUTED_GOTO
+			case Op::COUNT: break;
+		}
+	}
+#endif
+
+	#undef R
+	#undef FAIL
+	#undef CASE
+	#undef NEXT
+	return false;
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <string>
+#include <memory>
+#include <vector>
+#include <cstdint>
+
+#include "vm/bytecode.hpp"
+
+//Runs a verified bytecode program. Dispatch is threaded through a table of label addresses
+//where the compiler has computed goto, each handler jumps straight to the next one's, and
+//falls back to a switch in a loop elsewhere.
+class VM{
+	public:
+	//Registers of all live frames, array locals included
+	static constexpr size_t STACK_SLOTS = 1 << 22;
+	static constexpr size_t CALL_DEPTH = 1 << 18;
+
+	explicit VM(const Bytecode::Program &program_);
+
+	//Runs the global initializers and then entry, which has to take no parameters.
+	//Returns false on a run time error, see Error()
+	bool Run(const std::string &entry, Bytecode::Slot &result);
+	const std::string &Error() const { return error; }
+
+	private:
+	struct Frame{
+		const Bytecode::Instruction *pc;
+		Bytecode::Slot *regs;
+		std::uint32_t func;
+	};
+
+	const Bytecode::Program &program;
+	//First instruction of every function
+	std::vector<const Bytecode::Instruction*> entries;
+	std::unique_ptr<Bytecode::Slot[]> stack;
+	std::unique_ptr<Frame[]> frames;
+	std::vector<Bytecode::Slot> globals;
+	std::string error;
+
+	bool Execute(std::uint32_t func, Bytecode::Slot &result);
+};
@@ -0,0 +1,68 @@
+#include <iostream>
+#include <llvm/IR/Module.h>
+#include <llvm/IR/LLVMContext.h>
+#include <llvm/IR/Instructions.h>
+#include <llvm/Bitcode/BitcodeReader.h>
+
+#include "parser/parser.hpp"
+#include "util/diagnostics.hpp"
+
+//Arithmetic on float arrays has to stay in float. Widening it to double and back halves the
+//lanes a loop vectorizer gets out of the same registers
+static const char *source = R"(
+float a[64];
+float b[64];
+void scale(float k){
+	int i = 0;
+	while(i < 64){
+		a[i] = a[i] * k + b[i];
+		i = i + 1;
+	}
+}
+int main(){
+	scale(2.0);
+	return 0;
+}
+)";
+
+int main(){
+	Tokenizer tokenizer;
+	tokenizer.AddLine(source);
+	Diagnostics diag;
+	Parser parser(tokenizer, "floatarith.c", diag);
+	parser.SetInlining(false);
+	if(!parser.Parse()){
+		diag.Flush();
+		return 1;
+	}
+
+	auto bitcode = parser.CodegenBitcode();
+	llvm::LLVMContext context;
+	auto module = llvm::parseBitcodeFile(llvm::MemoryBufferRef(bitcode, "floatarith.c"), context);
+	if(!module){
+		llvm::consumeError(module.takeError());
+		std::cerr << "could not read the generated bitcode\n";
+		return 1;
+	}
+	auto func = (*module)->getFunction("scale");
+	if(!func || func->isDeclaration()){
+		std::cerr << "scale was not generated\n";
+		return 1;
+	}
+
+	size_t floatOps = 0;
+	for(auto &block: *func){
+		for(auto &inst: block){
+			if(llvm::isa<llvm::FPExtInst>(inst) || llvm::isa<llvm::FPTruncInst>(inst)){
+				std::cerr << "scale converts between float and double\n";
+				return 1;
+			}
+			if(llvm::isa<llvm::BinaryOperator>(inst) && inst.getType()->isFloatTy()) floatOps++;
+		}
+	}
+	if(floatOps != 2){
+		std::cerr << "scale has " << floatOps << " float operations instead of 2\n";
+		return 1;
+	}
+	return 0;
+}
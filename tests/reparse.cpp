@@ -0,0 +1,105 @@
+#include <sstream>
+#include <iostream>
+
+#include "parser/parser.hpp"
+#include "parser/astdump.hpp"
+#include "util/diagnostics.hpp"
+
+//Deletes every line and puts it back, then indents every line, one edit at a time, and checks
+//that the tree Reparse() patches dumps the same as a full parse of the edited text
+static const char *source = R"(int counter = 0;
+int g = 7; int h = 2;
+struct pair{
+	int a;
+	int b;
+};
+inline int sq(int x){
+	return x * x;
+}
+int add(int a, int b){
+	return a + b;
+}
+double scale(double v, int k){
+	return v * k;
+}
+void bump(){
+	counter = counter + 1;
+}
+int fact(int n){
+	if(n <= 1){
+		return 1;
+	}
+	return n * fact(n - 1);
+}
+export int main(){
+	int s = add(sq(3), 4);
+	while(s > 100){
+		s = s - g;
+	}
+	bump();
+	double d = scale(1.5, s);
+	return fact(5) + s + h;
+})";
+
+static std::string Dump(Parser &parser, const Tokenizer &tokenizer){
+	std::ostringstream out;
+	AstDumper(out, AstDumper::Format::JSON, tokenizer).Dump(*parser.GetRoot());
+	return out.str();
+}
+
+int main(){
+	std::vector<std::string> lines;
+	std::istringstream in(source);
+	for(std::string line; std::getline(in, line);)
+		lines.push_back(line);
+
+	//The same edits go to all buffers, a fresh parser is run over the last after each one. The
+	//lazy copy's tree is only read every few edits, so the offset shifts pile up in between
+	Tokenizer patched, lazyPatched, fresh;
+	for(auto &line: lines){
+		patched.AddLine(line);
+		lazyPatched.AddLine(line);
+		fresh.AddLine(line);
+	}
+	Diagnostics patchedDiag, lazyDiag;
+	Parser parser(patched, "reparse.c", patchedDiag), lazy(lazyPatched, "reparse.c", lazyDiag);
+	parser.Parse();
+	lazy.Parse();
+
+	//The last line has no newline to be deleted with it
+	std::vector<TextEdit> edits;
+	for(size_t line = 1; line < lines.size(); ++line){
+		edits.push_back(TextEdit{ line, 1, line + 1, 1, "" });
+		edits.push_back(TextEdit{ line, 1, line, 1, lines[line - 1] + "\n" });
+	}
+	//Then indent every line, outside the struct none of these needs a full parse
+	for(size_t line = 1; line <= lines.size(); ++line)
+		edits.push_back(TextEdit{ line, 1, line, 1, " " });
+
+	size_t incremental = 0, mismatched = 0;
+	for(size_t i = 0; i < edits.size(); ++i){
+		auto &edit = edits[i];
+		incremental += parser.Reparse(edit);
+		lazy.Reparse(edit);
+		fresh.ApplyEdit(edit);
+
+		Diagnostics freshDiag;
+		Parser reference(fresh, "reparse.c", freshDiag);
+		reference.Parse();
+		auto expected = Dump(reference, fresh);
+		if(i % 8 == 7 && Dump(lazy, lazyPatched) != expected){
+			std::cerr << "line " << edit.startLine << ": tree differs from a full parse when it is only read every 8 edits\n";
+			mismatched++;
+		}
+		if(Dump(parser, patched) == expected) continue;
+
+		std::cerr << "line " << edit.startLine << ": tree differs from a full parse after the line was " << (edit.text.empty() ? "deleted" : edit.text == " " ? "indented" : "put back") << "\n";
+		mismatched++;
+	}
+	//Most of these edits stay inside one function, they shouldn't all fall back to a full parse
+	if(!incremental){
+		std::cerr << "none of the " << edits.size() << " edits was patched incrementally\n";
+		return 1;
+	}
+	return mismatched ? 1 : 0;
+}